@@ -206,6 +206,15 @@ HEADERS += src/ds3file.h
 SOURCES += src/glbfile.cpp
 HEADERS += src/glbfile.h
 
+SOURCES += src/ddsencoder.cpp
+HEADERS += src/ddsencoder.h
+
+SOURCES += src/exportmesh.cpp
+HEADERS += src/exportmesh.h
+
+SOURCES += src/jobscheduler.cpp
+HEADERS += src/jobscheduler.h
+
 SOURCES += src/theme.cpp
 HEADERS += src/theme.h
 
@@ -272,6 +281,12 @@ HEADERS += src/riggenerator.h
 SOURCES += src/skinnedmeshcreator.cpp
 HEADERS += src/skinnedmeshcreator.h
 
+SOURCES += src/skinning.cpp
+HEADERS += src/skinning.h
+
+SOURCES += src/motionpreview.cpp
+HEADERS += src/motionpreview.h
+
 SOURCES += src/jointnodetree.cpp
 HEADERS += src/jointnodetree.h
 
@@ -400,6 +415,12 @@ HEADERS += src/meshstitcher.h
 SOURCES += src/strokemeshbuilder.cpp
 HEADERS += src/strokemeshbuilder.h
 
+SOURCES += src/deformmap.cpp
+HEADERS += src/deformmap.h
+
+SOURCES += src/profiler.cpp
+HEADERS += src/profiler.h
+
 SOURCES += src/meshcombiner.cpp
 HEADERS += src/meshcombiner.h
 
@@ -499,7 +520,39 @@ HEADERS += src/bonedocument.h
 SOURCES += src/materiallayer.cpp
 HEADERS += src/materiallayer.h
 
-SOURCES += src/main.cpp
+# qmake CONFIG+=benchmark builds the headless dust3d-benchmark instead of the editor
+benchmark {
+	TARGET = dust3d-benchmark
+
+	SOURCES += src/benchmark.cpp
+	HEADERS += src/benchmark.h
+
+	SOURCES += src/generationbenchmark.cpp
+	HEADERS += src/generationbenchmark.h
+
+	SOURCES += src/strokemeshbenchmark.cpp
+	HEADERS += src/strokemeshbenchmark.h
+
+	SOURCES += src/skinningbenchmark.cpp
+	HEADERS += src/skinningbenchmark.h
+
+	SOURCES += src/meshrecombinerbenchmark.cpp
+	HEADERS += src/meshrecombinerbenchmark.h
+
+	SOURCES += src/legacymeshrecombiner.cpp
+	HEADERS += src/legacymeshrecombiner.h
+
+	SOURCES += src/benchmarkmain.cpp
+
+	win32 {
+		LIBS += -lpsapi
+	}
+	macx {
+		CONFIG -= app_bundle
+	}
+} else {
+	SOURCES += src/main.cpp
+}
 
 HEADERS += src/version.h
 
@@ -510,6 +563,7 @@ HEADERS += thirdparty/FastMassSpring/ClothApp/MassSpringSolver.h
 INCLUDEPATH += thirdparty/instant-meshes
 INCLUDEPATH += thirdparty/instant-meshes/instant-meshes-dust3d/src
 INCLUDEPATH += thirdparty/instant-meshes/instant-meshes-dust3d/ext/tbb/include
+DEFINES += CGAL_LINKED_WITH_TBB
 INCLUDEPATH += thirdparty/instant-meshes/instant-meshes-dust3d/ext/dset
 INCLUDEPATH += thirdparty/instant-meshes/instant-meshes-dust3d/ext/pss
 INCLUDEPATH += thirdparty/instant-meshes/instant-meshes-dust3d/ext/pcg32
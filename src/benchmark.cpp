@@ -0,0 +1,293 @@
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QThread>
+#include <QXmlStreamReader>
+#include <QDebug>
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+#include "json.hpp"
+#include "benchmark.h"
+#include "ds3file.h"
+#include "snapshotxml.h"
+#include "imageforever.h"
+#include "fileforever.h"
+#include "version.h"
+
+static std::atomic<quint64> g_allocationCount(0);
+
+// The benchmark executable replaces the global allocation functions to count the heap allocations
+void *operator new(std::size_t size)
+{
+    ++g_allocationCount;
+    void *pointer = std::malloc(0 == size ? 1 : size);
+    if (nullptr == pointer)
+        throw std::bad_alloc();
+    return pointer;
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void *pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+quint64 Benchmark::allocationCount()
+{
+    return g_allocationCount;
+}
+
+void Benchmark::setIterations(int iterations)
+{
+    m_iterations = std::max(iterations, 1);
+}
+
+int Benchmark::iterations() const
+{
+    return m_iterations;
+}
+
+void Benchmark::setModelFilenames(const QStringList &filenames)
+{
+    m_modelFilenames = filenames;
+}
+
+const QStringList &Benchmark::modelFilenames() const
+{
+    return m_modelFilenames;
+}
+
+void Benchmark::addResult(const QString &suite, const QString &name, const QString &metric, Kind kind, double value)
+{
+    qDebug().noquote() << suite << name << metric << value;
+    m_results.push_back({suite, name, metric, kind, value});
+}
+
+const std::vector<Benchmark::Result> &Benchmark::results() const
+{
+    return m_results;
+}
+
+const char *Benchmark::kindToString(Kind kind)
+{
+    switch (kind) {
+        case Kind::Time:
+            return "time";
+        case Kind::Rate:
+            return "rate";
+        case Kind::Memory:
+            return "memory";
+        case Kind::Count:
+            return "count";
+    }
+    return "count";
+}
+
+bool Benchmark::saveReport(const QString &filename) const
+{
+    nlohmann::json report;
+    report["version"] = APP_HUMAN_VER;
+    report["platform"] = APP_PLATFORM;
+    report["date"] = QDateTime::currentDateTime().toString(Qt::ISODate).toUtf8().constData();
+    report["threads"] = QThread::idealThreadCount();
+    report["iterations"] = m_iterations;
+    report["results"] = nlohmann::json::array();
+    for (const auto &result: m_results) {
+        nlohmann::json item;
+        item["suite"] = result.suite.toUtf8().constData();
+        item["name"] = result.name.toUtf8().constData();
+        item["metric"] = result.metric.toUtf8().constData();
+        item["kind"] = kindToString(result.kind);
+        item["value"] = result.value;
+        report["results"].push_back(item);
+    }
+
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << "Open report file failed:" << filename;
+        return false;
+    }
+    std::string content = report.dump(4);
+    file.write(content.c_str(), content.size());
+    return true;
+}
+
+int Benchmark::compareWithBaseline(const QString &filename, double tolerance) const
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << "Open baseline file failed:" << filename;
+        return -1;
+    }
+    QByteArray content = file.readAll();
+    auto baseline = nlohmann::json::parse(content.constData(), content.constData() + content.size(), nullptr, false);
+    if (baseline.is_discarded() || baseline.find("results") == baseline.end()) {
+        qDebug() << "Parse baseline file failed:" << filename;
+        return -1;
+    }
+
+    std::map<std::tuple<QString, QString, QString>, double> baselineValues;
+    for (const auto &item: baseline["results"]) {
+        if (item.find("suite") == item.end() || item.find("name") == item.end() ||
+                item.find("metric") == item.end() || item.find("value") == item.end())
+            continue;
+        baselineValues[std::make_tuple(QString::fromStdString(item["suite"].get<std::string>()),
+            QString::fromStdString(item["name"].get<std::string>()),
+            QString::fromStdString(item["metric"].get<std::string>()))] = item["value"].get<double>();
+    }
+
+    int regressionCount = 0;
+    for (const auto &result: m_results) {
+        auto findBaseline = baselineValues.find(std::make_tuple(result.suite, result.name, result.metric));
+        if (findBaseline == baselineValues.end()) {
+            qDebug().noquote() << "new" << result.suite << result.name << result.metric << result.value;
+            continue;
+        }
+        double baselineValue = findBaseline->second;
+        bool isRegression = false;
+        switch (result.kind) {
+            case Kind::Time:
+            case Kind::Memory:
+                isRegression = result.value > baselineValue * (1.0 + tolerance);
+                break;
+            case Kind::Rate:
+                isRegression = result.value < baselineValue * (1.0 - tolerance);
+                break;
+            case Kind::Count:
+                isRegression = result.value != baselineValue;
+                break;
+        }
+        if (isRegression)
+            ++regressionCount;
+        double change = qFuzzyIsNull(baselineValue) ? 0.0 : (result.value - baselineValue) * 100.0 / baselineValue;
+        qDebug().noquote() << (isRegression ? "REGRESSION" : "ok") << result.suite << result.name << result.metric
+            << baselineValue << "->" << result.value << QString("(%1%2%)").arg(change >= 0 ? "+" : "").arg(change, 0, 'f', 1);
+    }
+    return regressionCount;
+}
+
+QStringList Benchmark::bundledModelFilenames()
+{
+    QStringList filenames;
+    QDir dir(":/resources");
+    for (const auto &name: dir.entryList({"model-*.ds3"}, QDir::Files, QDir::Name))
+        filenames.append(dir.filePath(name));
+    return filenames;
+}
+
+QString Benchmark::modelName(const QString &filename)
+{
+    return QFileInfo(filename).completeBaseName();
+}
+
+bool Benchmark::loadModel(const QString &filename, Snapshot *snapshot)
+{
+    Ds3FileReader ds3Reader(filename);
+    bool modelLoaded = false;
+    for (int i = 0; i < ds3Reader.items().size(); ++i) {
+        Ds3ReaderItem item = ds3Reader.items().at(i);
+        if (item.type == "asset") {
+            if (item.name.startsWith("images/")) {
+                QString itemFilename = item.name.split("/")[1];
+                QUuid imageId = QUuid(itemFilename.split(".")[0]);
+                if (!imageId.isNull())
+                    (void)ImageForever::addEncoded(ds3Reader.itemData(item.name), imageId);
+            } else if (item.name.startsWith("files/")) {
+                QString itemFilename = item.name.split("/")[1];
+                QUuid fileId = QUuid(itemFilename.split(".")[0]);
+                if (!fileId.isNull()) {
+                    QByteArray data;
+                    ds3Reader.loadItem(item.name, &data);
+                    (void)FileForever::add(item.name, data, fileId);
+                }
+            }
+        } else if (item.type == "model") {
+            QByteArray data = ds3Reader.itemData(item.name);
+            QXmlStreamReader stream(data);
+            loadSkeletonFromXmlStream(snapshot, stream);
+            modelLoaded = true;
+        }
+    }
+    return modelLoaded;
+}
+
+double Benchmark::median(std::vector<double> values)
+{
+    if (values.empty())
+        return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t middle = values.size() / 2;
+    if (values.size() % 2 == 0)
+        return (values[middle - 1] + values[middle]) * 0.5;
+    return values[middle];
+}
+
+void Benchmark::resetPeakResidentBytes()
+{
+#if defined(Q_OS_LINUX)
+    // Writing 5 to clear_refs resets VmHWM to the current resident size
+    QFile file("/proc/self/clear_refs");
+    if (file.open(QIODevice::WriteOnly))
+        file.write("5");
+#endif
+}
+
+qint64 Benchmark::peakResidentBytes()
+{
+#if defined(Q_OS_LINUX)
+    QFile file("/proc/self/status");
+    if (!file.open(QIODevice::ReadOnly))
+        return 0;
+    for (const auto &line: file.readAll().split('\n')) {
+        if (line.startsWith("VmHWM:"))
+            return line.mid(6).trimmed().split(' ')[0].toLongLong() * 1024;
+    }
+    return 0;
+#elif defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize;
+#elif defined(Q_OS_UNIX)
+    struct rusage usage;
+    if (0 != getrusage(RUSAGE_SELF, &usage))
+        return 0;
+#if defined(Q_OS_MACOS)
+    return usage.ru_maxrss;
+#else
+    return (qint64)usage.ru_maxrss * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,55 @@
+#ifndef DUST3D_BENCHMARK_H
+#define DUST3D_BENCHMARK_H
+#include <QString>
+#include <QStringList>
+#include <vector>
+#include "snapshot.h"
+
+class Benchmark
+{
+public:
+    enum class Kind
+    {
+        Time,
+        Rate,
+        Memory,
+        Count
+    };
+
+    struct Result
+    {
+        QString suite;
+        QString name;
+        QString metric;
+        Kind kind;
+        double value;
+    };
+
+    void setIterations(int iterations);
+    int iterations() const;
+    void setModelFilenames(const QStringList &filenames);
+    const QStringList &modelFilenames() const;
+    void addResult(const QString &suite, const QString &name, const QString &metric, Kind kind, double value);
+    const std::vector<Result> &results() const;
+    bool saveReport(const QString &filename) const;
+    // Returns the number of results which got worse than the baseline beyond the tolerance,
+    // times and memory must not grow, rates must not drop, counts must stay the same
+    int compareWithBaseline(const QString &filename, double tolerance) const;
+
+    static QStringList bundledModelFilenames();
+    static QString modelName(const QString &filename);
+    static bool loadModel(const QString &filename, Snapshot *snapshot);
+    static double median(std::vector<double> values);
+    // Only Linux can reset the peak, other platforms report the peak of the whole process
+    static void resetPeakResidentBytes();
+    static qint64 peakResidentBytes();
+    // Number of operator new calls since start, Qt containers allocate with malloc and are not counted
+    static quint64 allocationCount();
+    static const char *kindToString(Kind kind);
+private:
+    int m_iterations = 3;
+    QStringList m_modelFilenames;
+    std::vector<Result> m_results;
+};
+
+#endif
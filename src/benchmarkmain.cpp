@@ -0,0 +1,126 @@
+#include <QApplication>
+#include <QDebug>
+#include <QtGlobal>
+#include <cstring>
+#include "benchmark.h"
+#include "generationbenchmark.h"
+#include "strokemeshbenchmark.h"
+#include "skinningbenchmark.h"
+#include "meshrecombinerbenchmark.h"
+#include "profiler.h"
+
+struct BenchmarkSuite
+{
+    const char *name;
+    void (*run)(Benchmark *benchmark);
+};
+
+static const BenchmarkSuite g_suites[] = {
+    {"generation", runGenerationBenchmark},
+    {"strokeMesh", runStrokeMeshBenchmark},
+    {"skinning", runSkinningBenchmark},
+    {"meshRecombiner", runMeshRecombinerBenchmark},
+};
+
+/*
+Usage:
+dust3d-benchmark [-suite <name>]... [-iterations <n>] [-report <report.json>]
+    [-baseline <baseline.json>] [-tolerance <ratio>] [-profile <trace.json>] [model.ds3]...
+
+Without suites all of them run, without models the bundled resources/model-*.ds3 are used.
+The exit code is 1 when any result regressed against the baseline.
+*/
+
+int main(int argc, char ** argv)
+{
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+
+    QStringList suiteNames;
+    QStringList modelFilenames;
+    QString reportFilename;
+    QString baselineFilename;
+    QString profileTraceFilename;
+    double tolerance = 0.1;
+    int iterations = 3;
+
+    for (int i = 1; i < argc; ++i) {
+        if ('-' == argv[i][0]) {
+            if (0 == strcmp(argv[i], "-suite")) {
+                ++i;
+                if (i < argc)
+                    suiteNames.append(argv[i]);
+                continue;
+            } else if (0 == strcmp(argv[i], "-iterations")) {
+                ++i;
+                if (i < argc)
+                    iterations = QString(argv[i]).toInt();
+                continue;
+            } else if (0 == strcmp(argv[i], "-report")) {
+                ++i;
+                if (i < argc)
+                    reportFilename = argv[i];
+                continue;
+            } else if (0 == strcmp(argv[i], "-baseline")) {
+                ++i;
+                if (i < argc)
+                    baselineFilename = argv[i];
+                continue;
+            } else if (0 == strcmp(argv[i], "-tolerance")) {
+                ++i;
+                if (i < argc)
+                    tolerance = QString(argv[i]).toDouble();
+                continue;
+            } else if (0 == strcmp(argv[i], "-profile")) {
+                ++i;
+                if (i < argc)
+                    profileTraceFilename = argv[i];
+                continue;
+            }
+            qDebug() << "Unknown option:" << argv[i];
+            continue;
+        }
+        QString arg = argv[i];
+        if (arg.endsWith(".ds3"))
+            modelFilenames.append(arg);
+    }
+
+    if (modelFilenames.empty())
+        modelFilenames = Benchmark::bundledModelFilenames();
+
+    if (!profileTraceFilename.isEmpty())
+        Profiler::setEnabled(true);
+
+    Benchmark benchmark;
+    benchmark.setIterations(iterations);
+    benchmark.setModelFilenames(modelFilenames);
+
+    for (const auto &suite: g_suites) {
+        if (!suiteNames.empty() && !suiteNames.contains(suite.name))
+            continue;
+        qDebug() << "Running benchmark suite:" << suite.name;
+        suite.run(&benchmark);
+    }
+
+    if (!profileTraceFilename.isEmpty()) {
+        if (!Profiler::saveTrace(profileTraceFilename))
+            qDebug() << "Save profile trace failed:" << profileTraceFilename;
+        qDebug().noquote() << Profiler::summary();
+    }
+
+    if (!reportFilename.isEmpty()) {
+        if (!benchmark.saveReport(reportFilename))
+            return 1;
+    }
+
+    if (!baselineFilename.isEmpty()) {
+        int regressionCount = benchmark.compareWithBaseline(baselineFilename, tolerance);
+        if (0 != regressionCount) {
+            qDebug() << "Regressions:" << regressionCount;
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,203 @@
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <QDataStream>
+#include <algorithm>
+#include <limits>
+#include <cstdlib>
+#include <vector>
+#include "ddsencoder.h"
+
+static inline quint16 packColor565(int r, int g, int b)
+{
+    return (quint16)(((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+}
+
+static inline void unpackColor565(quint16 color, int *rgb)
+{
+    int r = (color >> 11) & 0x1f;
+    int g = (color >> 5) & 0x3f;
+    int b = color & 0x1f;
+    rgb[0] = (r << 3) | (r >> 2);
+    rgb[1] = (g << 2) | (g >> 4);
+    rgb[2] = (b << 3) | (b >> 2);
+}
+
+static void encodeAlphaBlock(const quint8 *alphas, quint8 *output)
+{
+    int minAlpha = 255;
+    int maxAlpha = 0;
+    for (int i = 0; i < 16; ++i) {
+        minAlpha = std::min(minAlpha, (int)alphas[i]);
+        maxAlpha = std::max(maxAlpha, (int)alphas[i]);
+    }
+    output[0] = (quint8)maxAlpha;
+    output[1] = (quint8)minAlpha;
+    quint64 indices = 0;
+    if (maxAlpha != minAlpha) {
+        // Eight alpha mode: index 0 is max, 1 is min, 2..7 interpolate from max to min
+        int palette[8];
+        palette[0] = maxAlpha;
+        palette[1] = minAlpha;
+        for (int i = 1; i <= 6; ++i)
+            palette[1 + i] = ((7 - i) * maxAlpha + i * minAlpha) / 7;
+        for (int i = 0; i < 16; ++i) {
+            int bestIndex = 0;
+            int bestDistance = 256;
+            for (int j = 0; j < 8; ++j) {
+                int distance = std::abs(palette[j] - (int)alphas[i]);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    bestIndex = j;
+                }
+            }
+            indices |= (quint64)bestIndex << (3 * i);
+        }
+    }
+    for (int i = 0; i < 6; ++i)
+        output[2 + i] = (quint8)(indices >> (8 * i));
+}
+
+static void encodeColorBlock(const quint8 *colors, quint8 *output)
+{
+    int minColor[3] = {255, 255, 255};
+    int maxColor[3] = {0, 0, 0};
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            minColor[c] = std::min(minColor[c], (int)colors[i * 3 + c]);
+            maxColor[c] = std::max(maxColor[c], (int)colors[i * 3 + c]);
+        }
+    }
+    // Inset the bounding box a little to reduce the error introduced by the extremes
+    for (int c = 0; c < 3; ++c) {
+        int inset = (maxColor[c] - minColor[c]) >> 4;
+        minColor[c] = std::min(255, minColor[c] + inset);
+        maxColor[c] = std::max(0, maxColor[c] - inset);
+    }
+    quint16 color0 = packColor565(maxColor[0], maxColor[1], maxColor[2]);
+    quint16 color1 = packColor565(minColor[0], minColor[1], minColor[2]);
+    if (color0 < color1)
+        std::swap(color0, color1);
+    quint32 indices = 0;
+    if (color0 != color1) {
+        // Four color mode requires color0 > color1
+        int palette[4][3];
+        unpackColor565(color0, palette[0]);
+        unpackColor565(color1, palette[1]);
+        for (int c = 0; c < 3; ++c) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (int i = 0; i < 16; ++i) {
+            int bestIndex = 0;
+            int bestDistance = std::numeric_limits<int>::max();
+            for (int j = 0; j < 4; ++j) {
+                int distance = 0;
+                for (int c = 0; c < 3; ++c) {
+                    int delta = palette[j][c] - (int)colors[i * 3 + c];
+                    distance += delta * delta;
+                }
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    bestIndex = j;
+                }
+            }
+            indices |= (quint32)bestIndex << (2 * i);
+        }
+    }
+    output[0] = (quint8)(color0 & 0xff);
+    output[1] = (quint8)(color0 >> 8);
+    output[2] = (quint8)(color1 & 0xff);
+    output[3] = (quint8)(color1 >> 8);
+    for (int i = 0; i < 4; ++i)
+        output[4 + i] = (quint8)(indices >> (8 * i));
+}
+
+class DxtBlockRowEncoder
+{
+public:
+    DxtBlockRowEncoder(const QImage *image, quint8 *output) :
+        m_image(image),
+        m_output(output)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        int width = m_image->width();
+        int height = m_image->height();
+        int blockColumns = (width + 3) / 4;
+        quint8 colors[16 * 3];
+        quint8 alphas[16];
+        for (size_t blockRow = range.begin(); blockRow != range.end(); ++blockRow) {
+            for (int blockColumn = 0; blockColumn < blockColumns; ++blockColumn) {
+                for (int i = 0; i < 16; ++i) {
+                    // Clamp to the edge for images smaller than a block
+                    int x = std::min(blockColumn * 4 + i % 4, width - 1);
+                    int y = std::min((int)blockRow * 4 + i / 4, height - 1);
+                    QRgb pixel = ((const QRgb *)m_image->constScanLine(y))[x];
+                    colors[i * 3 + 0] = (quint8)qRed(pixel);
+                    colors[i * 3 + 1] = (quint8)qGreen(pixel);
+                    colors[i * 3 + 2] = (quint8)qBlue(pixel);
+                    alphas[i] = (quint8)qAlpha(pixel);
+                }
+                quint8 *block = m_output + (blockRow * blockColumns + blockColumn) * 16;
+                encodeAlphaBlock(alphas, block);
+                encodeColorBlock(colors, block + 8);
+            }
+        }
+    }
+private:
+    const QImage *m_image = nullptr;
+    quint8 *m_output = nullptr;
+};
+
+bool encodeDds(const QImage &image, QByteArray &ddsByteArray)
+{
+    if (image.isNull())
+        return false;
+    
+    std::vector<QImage> levels;
+    levels.push_back(image.convertToFormat(QImage::Format_ARGB32));
+    while (levels.back().width() > 1 || levels.back().height() > 1) {
+        const QImage &previous = levels.back();
+        levels.push_back(previous.scaled(std::max(1, previous.width() / 2),
+            std::max(1, previous.height() / 2),
+            Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+    }
+    
+    auto levelSize = [](const QImage &level) {
+        return (size_t)((level.width() + 3) / 4) * ((level.height() + 3) / 4) * 16;
+    };
+    
+    ddsByteArray.clear();
+    QDataStream stream(&ddsByteArray, QIODevice::WriteOnly);
+    stream.setByteOrder(QDataStream::LittleEndian);
+    
+    // DDS_HEADER, see https://docs.microsoft.com/en-us/windows/win32/direct3ddds/dds-header
+    stream << (quint32)0x20534444; // "DDS "
+    stream << (quint32)124;
+    stream << (quint32)(0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000);
+    stream << (quint32)image.height();
+    stream << (quint32)image.width();
+    stream << (quint32)levelSize(levels[0]);
+    stream << (quint32)0;
+    stream << (quint32)levels.size();
+    for (int i = 0; i < 11; ++i)
+        stream << (quint32)0;
+    stream << (quint32)32;
+    stream << (quint32)0x4; // DDPF_FOURCC
+    stream << (quint32)0x35545844; // "DXT5"
+    for (int i = 0; i < 5; ++i)
+        stream << (quint32)0;
+    stream << (quint32)(0x8 | 0x1000 | 0x400000);
+    for (int i = 0; i < 4; ++i)
+        stream << (quint32)0;
+    
+    for (const auto &level: levels) {
+        std::vector<quint8> blocks(levelSize(level));
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, (level.height() + 3) / 4),
+            DxtBlockRowEncoder(&level, blocks.data()));
+        stream.writeRawData((const char *)blocks.data(), blocks.size());
+    }
+    
+    return true;
+}
@@ -0,0 +1,9 @@
+#ifndef DUST3D_DDS_ENCODER_H
+#define DUST3D_DDS_ENCODER_H
+#include <QImage>
+#include <QByteArray>
+
+// Encode image as DXT5 (BC3) compressed DDS with full mipmap chain
+bool encodeDds(const QImage &image, QByteArray &ddsByteArray);
+
+#endif
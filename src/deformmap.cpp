@@ -0,0 +1,57 @@
+#include <cmath>
+#include <algorithm>
+#include "deformmap.h"
+
+DeformMap::DeformMap(const QImage &image)
+{
+    if (image.isNull())
+        return;
+    
+    // Convert once to 8-bit gray, so sampling doesn't need to go through the format converting pixel accessor
+    QImage argbImage = image.convertToFormat(QImage::Format_ARGB32);
+    m_width = argbImage.width();
+    m_height = argbImage.height();
+    m_grays.resize((size_t)m_width * m_height);
+    for (int y = 0; y < m_height; ++y) {
+        const QRgb *line = (const QRgb *)argbImage.constScanLine(y);
+        quint8 *grays = &m_grays[(size_t)y * m_width];
+        for (int x = 0; x < m_width; ++x)
+            grays[x] = (quint8)qGray(line[x]);
+    }
+}
+
+bool DeformMap::isNull() const
+{
+    return m_grays.empty();
+}
+
+int DeformMap::width() const
+{
+    return m_width;
+}
+
+int DeformMap::height() const
+{
+    return m_height;
+}
+
+float DeformMap::sample(float x, float y) const
+{
+    // Bilinear sampling, returns the gray level mapped to [-1, 1]
+    float maxX = (float)(m_width - 1);
+    float maxY = (float)(m_height - 1);
+    x = std::max(0.0f, std::min(x, maxX));
+    y = std::max(0.0f, std::min(y, maxY));
+    int x0 = (int)x;
+    int y0 = (int)y;
+    int x1 = std::min(x0 + 1, m_width - 1);
+    int y1 = std::min(y0 + 1, m_height - 1);
+    float fx = x - x0;
+    float fy = y - y0;
+    const quint8 *line0 = &m_grays[(size_t)y0 * m_width];
+    const quint8 *line1 = &m_grays[(size_t)y1 * m_width];
+    float top = line0[x0] + (line0[x1] - line0[x0]) * fx;
+    float bottom = line1[x0] + (line1[x1] - line1[x0]) * fx;
+    float gray = top + (bottom - top) * fy;
+    return (gray - 127) / 127;
+}
@@ -0,0 +1,21 @@
+#ifndef DUST3D_DEFORM_MAP_H
+#define DUST3D_DEFORM_MAP_H
+#include <QImage>
+#include <vector>
+
+class DeformMap
+{
+public:
+    DeformMap(const QImage &image);
+    bool isNull() const;
+    int width() const;
+    int height() const;
+    float sample(float x, float y) const;
+    
+private:
+    int m_width = 0;
+    int m_height = 0;
+    std::vector<quint8> m_grays;
+};
+
+#endif
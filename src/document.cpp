@@ -19,6 +19,7 @@
 #include "scriptrunner.h"
 #include "imageforever.h"
 #include "meshgenerator.h"
+#include "jobscheduler.h"
 
 unsigned long Document::m_maxSnapshot = 1000;
 
@@ -55,6 +56,7 @@ void Document::applyPreferenceInterpolationChange()
 Document::~Document()
 {
     delete m_resultMesh;
+    delete m_resultDraftMesh;
     delete m_paintedMesh;
     delete m_resultMeshNodesCutFaces;
     delete m_postProcessedObject;
@@ -70,6 +72,7 @@ Document::~Document()
     delete textureAmbientOcclusionImageByteArray;
     delete m_resultTextureMesh;
     delete m_resultRigWeightMesh;
+    delete m_scriptSnapshot;
 }
 
 void Document::uiReady()
@@ -667,7 +670,10 @@ void Document::addFromSnapshot(const Snapshot &snapshot, enum SnapshotSource sou
     }
     std::map<QUuid, QUuid> cutFaceLinkedIdModifyMap;
     for (const auto &partKv: snapshot.parts) {
-        const auto newUuid = QUuid::createUuid();
+        // Script generated ids are stable between runs, keep them so the generated caches can be reused
+        QUuid oldPartId = QUuid(partKv.first);
+        const auto newUuid = (SnapshotSource::Script == source && partMap.find(oldPartId) == partMap.end()) ?
+            oldPartId : QUuid::createUuid();
         SkeletonPart &part = partMap[newUuid];
         part.id = newUuid;
         oldNewIdMap[QUuid(partKv.first)] = part.id;
@@ -831,7 +837,9 @@ void Document::addFromSnapshot(const Snapshot &snapshot, enum SnapshotSource sou
     for (const auto &componentKv: snapshot.components) {
         QString linkData = valueOfKeyInMapOrEmpty(componentKv.second, "linkData");
         QString linkDataType = valueOfKeyInMapOrEmpty(componentKv.second, "linkDataType");
-        SkeletonComponent component(QUuid(), linkData, linkDataType);
+        QUuid oldComponentId = QUuid(componentKv.first);
+        SkeletonComponent component((SnapshotSource::Script == source && componentMap.find(oldComponentId) == componentMap.end()) ?
+            oldComponentId : QUuid(), linkData, linkDataType);
         oldNewIdMap[QUuid(componentKv.first)] = component.id;
         component.name = valueOfKeyInMapOrEmpty(componentKv.second, "name");
         component.expanded = isTrueValueString(valueOfKeyInMapOrEmpty(componentKv.second, "expanded"));
@@ -986,6 +994,14 @@ Model *Document::takeResultMesh()
     return resultMesh;
 }
 
+Model *Document::takeResultDraftMesh()
+{
+    if (nullptr == m_resultDraftMesh)
+        return nullptr;
+    Model *resultDraftMesh = new Model(*m_resultDraftMesh);
+    return resultDraftMesh;
+}
+
 Model *Document::takePaintedMesh()
 {
     if (nullptr == m_paintedMesh)
@@ -1015,6 +1031,21 @@ Model *Document::takeResultRigWeightMesh()
     return resultMesh;
 }
 
+void Document::meshDraftReady()
+{
+    if (nullptr == m_meshGenerator)
+        return;
+    
+    Model *draftMesh = m_meshGenerator->takeDraftMesh();
+    if (nullptr == draftMesh)
+        return;
+    
+    delete m_resultDraftMesh;
+    m_resultDraftMesh = draftMesh;
+    
+    emit resultDraftMeshChanged();
+}
+
 void Document::meshReady()
 {
     Model *resultMesh = m_meshGenerator->takeResultMesh();
@@ -1048,6 +1079,9 @@ void Document::meshReady()
     delete m_resultMesh;
     m_resultMesh = resultMesh;
     
+    delete m_resultDraftMesh;
+    m_resultDraftMesh = nullptr;
+    
     delete m_resultMeshNodesCutFaces;
     m_resultMeshNodesCutFaces = m_meshGenerator->takeNodesCutFaces();
     
@@ -1130,6 +1164,11 @@ void Document::regenerateMesh()
     generateMesh();
 }
 
+void Document::setDraftMeshEnabled(bool enabled)
+{
+    m_draftMeshEnabled = enabled;
+}
+
 void Document::toggleSmoothNormal()
 {
     m_smoothNormal = !m_smoothNormal;
@@ -1157,8 +1196,6 @@ void Document::generateMesh()
     
     m_isResultMeshObsolete = false;
     
-    QThread *thread = new QThread;
-    
     Snapshot *snapshot = new Snapshot;
     toSnapshot(snapshot);
     resetDirtyFlags();
@@ -1172,12 +1209,10 @@ void Document::generateMesh()
     if (!m_smoothNormal) {
         m_meshGenerator->setSmoothShadingThresholdAngleDegrees(0);
     }
-    m_meshGenerator->moveToThread(thread);
-    connect(thread, &QThread::started, m_meshGenerator, &MeshGenerator::process);
+    m_meshGenerator->setDraftEnabled(m_draftMeshEnabled);
+    connect(m_meshGenerator, &MeshGenerator::draftReady, this, &Document::meshDraftReady);
     connect(m_meshGenerator, &MeshGenerator::finished, this, &Document::meshReady);
-    connect(m_meshGenerator, &MeshGenerator::finished, thread, &QThread::quit);
-    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
-    thread->start();
+    JobScheduler::instance().schedule(m_meshGenerator, JobScheduler::Priority::Interactive);
 }
 
 void Document::generateTexture()
@@ -1198,14 +1233,9 @@ void Document::generateTexture()
     Snapshot *snapshot = new Snapshot;
     toSnapshot(snapshot);
     
-    QThread *thread = new QThread;
     m_textureGenerator = new TextureGenerator(*m_postProcessedObject, snapshot);
-    m_textureGenerator->moveToThread(thread);
-    connect(thread, &QThread::started, m_textureGenerator, &TextureGenerator::process);
     connect(m_textureGenerator, &TextureGenerator::finished, this, &Document::textureReady);
-    connect(m_textureGenerator, &TextureGenerator::finished, thread, &QThread::quit);
-    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
-    thread->start();
+    JobScheduler::instance().schedule(m_textureGenerator);
 }
 
 void Document::textureReady()
@@ -1258,14 +1288,9 @@ void Document::postProcess()
     qDebug() << "Post processing..";
     emit postProcessing();
 
-    QThread *thread = new QThread;
     m_postProcessor = new MeshResultPostProcessor(*m_currentObject);
-    m_postProcessor->moveToThread(thread);
-    connect(thread, &QThread::started, m_postProcessor, &MeshResultPostProcessor::process);
     connect(m_postProcessor, &MeshResultPostProcessor::finished, this, &Document::postProcessedMeshResultReady);
-    connect(m_postProcessor, &MeshResultPostProcessor::finished, thread, &QThread::quit);
-    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
-    thread->start();
+    JobScheduler::instance().schedule(m_postProcessor);
 }
 
 void Document::postProcessedMeshResultReady()
@@ -1312,7 +1337,6 @@ void Document::paint()
     
     //qDebug() << "Mouse picking..";
 
-    QThread *thread = new QThread;
     m_texturePainter = new TexturePainter(m_mouseRayNear, m_mouseRayFar);
     if (nullptr == m_texturePainterContext) {
         m_texturePainterContext = new TexturePainterContext;
@@ -1331,12 +1355,8 @@ void Document::paint()
         m_texturePainter->setRadius(m_mousePickRadius);
         m_texturePainter->setMaskNodeIds(m_mousePickMaskNodeIds);
     }
-    m_texturePainter->moveToThread(thread);
-    connect(thread, &QThread::started, m_texturePainter, &TexturePainter::process);
     connect(m_texturePainter, &TexturePainter::finished, this, &Document::paintReady);
-    connect(m_texturePainter, &TexturePainter::finished, thread, &QThread::quit);
-    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
-    thread->start();
+    JobScheduler::instance().schedule(m_texturePainter, JobScheduler::Priority::Interactive);
 }
 
 void Document::paintReady()
@@ -1759,6 +1779,10 @@ void Document::setPartColorState(QUuid partId, bool hasColor, QColor color)
 
 void Document::saveSnapshot()
 {
+    // Any other change makes the last script result no longer describe the document
+    delete m_scriptSnapshot;
+    m_scriptSnapshot = nullptr;
+    
     HistoryItem item;
     QElapsedTimer elapsedTimer;
     elapsedTimer.start();
@@ -1915,14 +1939,12 @@ void Document::generateRig()
     
     qDebug() << "Rig generating..";
     
-    QThread *thread = new QThread;
-    m_rigGenerator = new RigGenerator(rigType, *m_postProcessedObject);
-    m_rigGenerator->moveToThread(thread);
-    connect(thread, &QThread::started, m_rigGenerator, &RigGenerator::process);
+    // The rig only needs the nodes and vertices of the generated mesh, so it doesn't wait for
+    // the uv unwrapping and texture baking, which keep the vertices and run at the same time.
+    // A locked object is not generated, it is the post processed one which got loaded
+    m_rigGenerator = new RigGenerator(rigType, objectLocked ? *m_postProcessedObject : *m_currentObject);
     connect(m_rigGenerator, &RigGenerator::finished, this, &Document::rigReady);
-    connect(m_rigGenerator, &RigGenerator::finished, thread, &QThread::quit);
-    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
-    thread->start();
+    JobScheduler::instance().schedule(m_rigGenerator);
 }
 
 void Document::rigReady()
@@ -1964,7 +1986,7 @@ const std::vector<RigBone> *Document::resultRigBones() const
     return m_resultRigBones;
 }
 
-const std::map<int, RigVertexWeights> *Document::resultRigWeights() const
+const RigWeights *Document::resultRigWeights() const
 {
     return m_resultRigWeights;
 }
@@ -2024,7 +2046,7 @@ void Document::generateMotions()
     }
     
     const std::vector<RigBone> *rigBones = resultRigBones();
-    const std::map<int, RigVertexWeights> *rigWeights = resultRigWeights();
+    const RigWeights *rigWeights = resultRigWeights();
     
     if (nullptr == rigBones || nullptr == rigWeights) {
         return;
@@ -2049,13 +2071,8 @@ void Document::generateMotions()
     
     qDebug() << "Motions generating..";
     
-    QThread *thread = new QThread;
-    m_motionsGenerator->moveToThread(thread);
-    connect(thread, &QThread::started, m_motionsGenerator, &MotionsGenerator::process);
     connect(m_motionsGenerator, &MotionsGenerator::finished, this, &Document::motionsReady);
-    connect(m_motionsGenerator, &MotionsGenerator::finished, thread, &QThread::quit);
-    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
-    thread->start();
+    JobScheduler::instance().schedule(m_motionsGenerator);
 }
 
 void Document::motionsReady()
@@ -2153,7 +2170,6 @@ void Document::generateMaterialPreviews()
         return;
     }
 
-    QThread *thread = new QThread;
     m_materialPreviewsGenerator = new MaterialPreviewsGenerator();
     bool hasDirtyMaterial = false;
     for (auto &materialIt: materialMap) {
@@ -2166,18 +2182,13 @@ void Document::generateMaterialPreviews()
     if (!hasDirtyMaterial) {
         delete m_materialPreviewsGenerator;
         m_materialPreviewsGenerator = nullptr;
-        delete thread;
         return;
     }
     
     qDebug() << "Material previews generating..";
     
-    m_materialPreviewsGenerator->moveToThread(thread);
-    connect(thread, &QThread::started, m_materialPreviewsGenerator, &MaterialPreviewsGenerator::process);
     connect(m_materialPreviewsGenerator, &MaterialPreviewsGenerator::finished, this, &Document::materialPreviewsReady);
-    connect(m_materialPreviewsGenerator, &MaterialPreviewsGenerator::finished, thread, &QThread::quit);
-    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
-    thread->start();
+    JobScheduler::instance().schedule(m_materialPreviewsGenerator);
 }
 
 void Document::materialPreviewsReady()
@@ -2330,20 +2341,14 @@ void Document::runScript()
     
     qDebug() << "Script running..";
     
-    QThread *thread = new QThread;
-
     m_scriptRunner = new ScriptRunner();
-    m_scriptRunner->moveToThread(thread);
     m_scriptRunner->setScript(new QString(m_script));
     m_scriptRunner->setVariables(new std::map<QString, std::map<QString, QString>>(
         m_mergedVariables.empty() ? m_cachedVariables : m_mergedVariables
         ));
-    connect(thread, &QThread::started, m_scriptRunner, &ScriptRunner::process);
     connect(m_scriptRunner, &ScriptRunner::finished, this, &Document::scriptResultReady);
-    connect(m_scriptRunner, &ScriptRunner::finished, thread, &QThread::quit);
-    connect(thread, &QThread::finished, thread, &QThread::deleteLater);
     emit scriptRunning();
-    thread->start();
+    JobScheduler::instance().schedule(m_scriptRunner, JobScheduler::Priority::Interactive);
 }
 
 void Document::scriptResultReady()
@@ -2367,9 +2372,9 @@ void Document::scriptResultReady()
     }
     
     if (nullptr != snapshot) {
-        fromSnapshot(*snapshot);
-        delete snapshot;
+        applyScriptSnapshot(*snapshot);
         saveSnapshot();
+        m_scriptSnapshot = snapshot;
     }
     
     if (nullptr != defaultVariables) {
@@ -2393,6 +2398,71 @@ void Document::scriptResultReady()
     }
 }
 
+static void groupSnapshotItemsByPart(const std::map<QString, std::map<QString, QString>> &items,
+    std::map<QString, std::map<QString, std::map<QString, QString>>> &partItems)
+{
+    for (const auto &it: items)
+        partItems[valueOfKeyInMapOrEmpty(it.second, "partId")].insert(it);
+}
+
+void Document::applyScriptSnapshot(const Snapshot &snapshot)
+{
+    // Parts and components which are the same as in the last script result, and not changed
+    // since then or still waiting to be generated, are kept clean to reuse the generated caches
+    std::set<QUuid> cleanPartIds;
+    std::set<QUuid> cleanComponentIds;
+    if (nullptr != m_scriptSnapshot) {
+        std::map<QString, std::map<QString, std::map<QString, QString>>> oldPartNodes;
+        std::map<QString, std::map<QString, std::map<QString, QString>>> newPartNodes;
+        std::map<QString, std::map<QString, std::map<QString, QString>>> oldPartEdges;
+        std::map<QString, std::map<QString, std::map<QString, QString>>> newPartEdges;
+        groupSnapshotItemsByPart(m_scriptSnapshot->nodes, oldPartNodes);
+        groupSnapshotItemsByPart(snapshot.nodes, newPartNodes);
+        groupSnapshotItemsByPart(m_scriptSnapshot->edges, oldPartEdges);
+        groupSnapshotItemsByPart(snapshot.edges, newPartEdges);
+        for (const auto &partIt: snapshot.parts) {
+            QUuid partId = QUuid(partIt.first);
+            auto findPart = partMap.find(partId);
+            if (findPart == partMap.end() || findPart->second.dirty)
+                continue;
+            auto findOldPart = m_scriptSnapshot->parts.find(partIt.first);
+            if (findOldPart == m_scriptSnapshot->parts.end() ||
+                    findOldPart->second != partIt.second ||
+                    oldPartNodes[partIt.first] != newPartNodes[partIt.first] ||
+                    oldPartEdges[partIt.first] != newPartEdges[partIt.first])
+                continue;
+            cleanPartIds.insert(partId);
+        }
+        for (const auto &componentIt: snapshot.components) {
+            QUuid componentId = QUuid(componentIt.first);
+            auto findComponent = componentMap.find(componentId);
+            if (findComponent == componentMap.end() || findComponent->second.dirty)
+                continue;
+            auto findOldComponent = m_scriptSnapshot->components.find(componentIt.first);
+            if (findOldComponent == m_scriptSnapshot->components.end() ||
+                    findOldComponent->second != componentIt.second)
+                continue;
+            cleanComponentIds.insert(componentId);
+        }
+    }
+    
+    batchChangeBegin();
+    reset();
+    addFromSnapshot(snapshot, SnapshotSource::Script);
+    for (const auto &partId: cleanPartIds) {
+        auto findPart = partMap.find(partId);
+        if (findPart != partMap.end())
+            findPart->second.dirty = false;
+    }
+    for (const auto &componentId: cleanComponentIds) {
+        auto findComponent = componentMap.find(componentId);
+        if (findComponent != componentMap.end())
+            findComponent->second.dirty = false;
+    }
+    emit uncheckAll();
+    batchChangeEnd();
+}
+
 const QString &Document::script() const
 {
     return m_script;
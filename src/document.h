@@ -119,6 +119,7 @@ signals:
     void nodeCutFaceChanged(QUuid nodeId);
     void partPreviewChanged(QUuid partId);
     void resultMeshChanged();
+    void resultDraftMeshChanged();
     void resultPartPreviewsChanged();
     void paintedMeshChanged();
     void turnaroundChanged();
@@ -233,18 +234,22 @@ public:
     {
         Unknown,
         Paste,
-        Import
+        Import,
+        Script
     };
     void addFromSnapshot(const Snapshot &snapshot, enum SnapshotSource source=SnapshotSource::Paste);
     const Material *findMaterial(QUuid materialId) const;
     const Motion *findMotion(QUuid motionId) const;
     Model *takeResultMesh();
+    Model *takeResultDraftMesh();
+    // Headless exports have nobody looking at the draft
+    void setDraftMeshEnabled(bool enabled);
     Model *takePaintedMesh();
     bool isMeshGenerationSucceed();
     Model *takeResultTextureMesh();
     Model *takeResultRigWeightMesh();
     const std::vector<RigBone> *resultRigBones() const;
-    const std::map<int, RigVertexWeights> *resultRigWeights() const;
+    const RigWeights *resultRigWeights() const;
     void updateTurnaround(const QImage &image);
     void clearTurnaround();
     void updateTextureImage(QImage *image);
@@ -287,6 +292,7 @@ public slots:
     void generateMesh();
     void regenerateMesh();
     void meshReady();
+    void meshDraftReady();
     void generateTexture();
     void textureReady();
     void postProcess();
@@ -362,10 +368,12 @@ private:
     void checkExportReadyState();
     void removeRigResults();
     bool updateDefaultVariables(const std::map<QString, std::map<QString, QString>> &defaultVariables);
+    void applyScriptSnapshot(const Snapshot &snapshot);
 private:
     bool m_isResultMeshObsolete = false;
     MeshGenerator *m_meshGenerator = nullptr;
     Model *m_resultMesh = nullptr;
+    Model *m_resultDraftMesh = nullptr;
     Model *m_paintedMesh = nullptr;
     std::map<QUuid, std::map<QString, QVector2D>> *m_resultMeshNodesCutFaces = nullptr;
     bool m_isMeshGenerationSucceed = true;
@@ -379,10 +387,11 @@ private:
     Model *m_resultTextureMesh = nullptr;
     unsigned long long m_textureImageUpdateVersion = 0;
     bool m_smoothNormal = !Preferences::instance().flatShading();
+    bool m_draftMeshEnabled = true;
     RigGenerator *m_rigGenerator = nullptr;
     Model *m_resultRigWeightMesh = nullptr;
     std::vector<RigBone> *m_resultRigBones = nullptr;
-    std::map<int, RigVertexWeights> *m_resultRigWeights = nullptr;
+    RigWeights *m_resultRigWeights = nullptr;
     bool m_isRigObsolete = false;
     Object *m_riggedObject = new Object;
     bool m_currentRigSucceed = false;
@@ -394,6 +403,7 @@ private:
     std::map<QString, std::map<QString, QString>> m_mergedVariables;
     ScriptRunner *m_scriptRunner = nullptr;
     bool m_isScriptResultObsolete = false;
+    Snapshot *m_scriptSnapshot = nullptr;
     TexturePainter *m_texturePainter = nullptr;
     bool m_isMouseTargetResultObsolete = false;
     PaintMode m_paintMode = PaintMode::None;
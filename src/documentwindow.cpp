@@ -55,6 +55,7 @@
 #include "flowlayout.h"
 #include "bonedocument.h"
 #include "document.h"
+#include "profiler.h"
 
 int DocumentWindow::m_autoRecovered = false;
 
@@ -795,6 +796,27 @@ DocumentWindow::DocumentWindow()
     m_showDebugDialogAction = new QAction(tr("Debug"), this);
     connect(m_showDebugDialogAction, &QAction::triggered, g_logBrowser, &LogBrowser::showDialog);
     m_windowMenu->addAction(m_showDebugDialogAction);
+    
+    QMenu *profilerMenu = m_windowMenu->addMenu(tr("Profiler"));
+    
+    m_toggleProfilerAction = new QAction(tr("Record Generation Profile"), this);
+    m_toggleProfilerAction->setCheckable(true);
+    connect(m_toggleProfilerAction, &QAction::toggled, [=](bool checked) {
+        if (checked == Profiler::isEnabled())
+            return;
+        if (checked)
+            Profiler::reset();
+        Profiler::setEnabled(checked);
+    });
+    profilerMenu->addAction(m_toggleProfilerAction);
+    
+    m_exportProfileTraceAction = new QAction(tr("Export Trace..."), this);
+    connect(m_exportProfileTraceAction, &QAction::triggered, this, &DocumentWindow::exportProfileTrace);
+    profilerMenu->addAction(m_exportProfileTraceAction);
+    
+    connect(profilerMenu, &QMenu::aboutToShow, [=]() {
+        m_toggleProfilerAction->setChecked(Profiler::isEnabled());
+    });
 
     m_helpMenu = menuBar()->addMenu(tr("&Help"));
     
@@ -1076,7 +1098,7 @@ DocumentWindow::DocumentWindow()
     connect(m_document, &Document::skeletonChanged, m_document, &Document::generateMesh);
     connect(m_document, &Document::textureChanged, m_document, &Document::generateTexture);
     connect(m_document, &Document::resultMeshChanged, m_document, &Document::postProcess);
-    connect(m_document, &Document::postProcessedResultChanged, m_document, &Document::generateRig);
+    connect(m_document, &Document::resultMeshChanged, m_document, &Document::generateRig);
     connect(m_document, &Document::rigChanged, m_document, &Document::generateRig);
     connect(m_document, &Document::postProcessedResultChanged, m_document, &Document::generateTexture);
     connect(m_document, &Document::resultTextureChanged, [=]() {
@@ -1107,6 +1129,13 @@ DocumentWindow::DocumentWindow()
         m_modelRenderWidget->updateMesh(resultMesh);
     });
     
+    connect(m_document, &Document::resultDraftMeshChanged, [=]() {
+        auto resultDraftMesh = m_document->takeResultDraftMesh();
+        if (m_modelRemoveColor && resultDraftMesh)
+            resultDraftMesh->removeColor();
+        m_modelRenderWidget->updateMesh(resultDraftMesh);
+    });
+    
     connect(m_document, &Document::motionsChanged, m_document, &Document::generateMotions);
 
     connect(shapeGraphicsWidget, &SkeletonGraphicsWidget::cursorChanged, [=]() {
@@ -1520,10 +1549,7 @@ void DocumentWindow::importPath(const QString &path)
                 QString imageIdString = filename.split(".")[0];
                 QUuid imageId = QUuid(imageIdString);
                 if (!imageId.isNull()) {
-                    QByteArray data;
-                    ds3Reader.loadItem(item.name, &data);
-                    QImage image = QImage::fromData(data, "PNG");
-                    (void)ImageForever::add(&image, imageId);
+                    (void)ImageForever::addEncoded(ds3Reader.itemData(item.name), imageId);
                 }
             }
         }
@@ -1533,8 +1559,7 @@ void DocumentWindow::importPath(const QString &path)
         Ds3ReaderItem item = ds3Reader.items().at(i);
         if (item.type == "model") {
             {
-                QByteArray data;
-                ds3Reader.loadItem(item.name, &data);
+                QByteArray data = ds3Reader.itemData(item.name);
                 QXmlStreamReader stream(data);
             
                 Snapshot snapshot;
@@ -1543,8 +1568,7 @@ void DocumentWindow::importPath(const QString &path)
                 documentChanged = true;
             }
             {
-                QByteArray data;
-                ds3Reader.loadItem(item.name, &data);
+                QByteArray data = ds3Reader.itemData(item.name);
                 QXmlStreamReader stream(data);
                 
                 Snapshot snapshot;
@@ -1654,10 +1678,7 @@ void DocumentWindow::openPathAs(const QString &path, const QString &asName)
                     QString imageIdString = filename.split(".")[0];
                     QUuid imageId = QUuid(imageIdString);
                     if (!imageId.isNull()) {
-                        QByteArray data;
-                        ds3Reader.loadItem(item.name, &data);
-                        QImage image = QImage::fromData(data, "PNG");
-                        (void)ImageForever::add(&image, imageId);
+                        (void)ImageForever::addEncoded(ds3Reader.itemData(item.name), imageId);
                     }
                 } else if (item.name.startsWith("files/")) {
                     QString filename = item.name.split("/")[1];
@@ -1675,8 +1696,7 @@ void DocumentWindow::openPathAs(const QString &path, const QString &asName)
         for (int i = 0; i < ds3Reader.items().size(); ++i) {
             Ds3ReaderItem item = ds3Reader.items().at(i);
             if (item.type == "model") {
-                QByteArray data;
-                ds3Reader.loadItem(item.name, &data);
+                QByteArray data = ds3Reader.itemData(item.name);
                 QXmlStreamReader stream(data);
                 Snapshot snapshot;
                 loadSkeletonFromXmlStream(&snapshot, stream);
@@ -1684,40 +1704,32 @@ void DocumentWindow::openPathAs(const QString &path, const QString &asName)
                 m_document->saveSnapshot();
             } else if (item.type == "asset") {
                 if (item.name == "canvas.png") {
-                    QByteArray data;
-                    ds3Reader.loadItem(item.name, &data);
+                    QByteArray data = ds3Reader.itemData(item.name);
                     m_document->updateTurnaround(QImage::fromData(data, "PNG"));
                 } else if (item.name == "object_color.png") {
-                    QByteArray data;
-                    ds3Reader.loadItem(item.name, &data);
+                    QByteArray data = ds3Reader.itemData(item.name);
                     m_document->updateTextureImage(new QImage(QImage::fromData(data, "PNG")));
                 } else if (item.name == "object_normal.png") {
-                    QByteArray data;
-                    ds3Reader.loadItem(item.name, &data);
+                    QByteArray data = ds3Reader.itemData(item.name);
                     m_document->updateTextureNormalImage(new QImage(QImage::fromData(data, "PNG")));
                 } else if (item.name == "object_metallic.png") {
-                    QByteArray data;
-                    ds3Reader.loadItem(item.name, &data);
+                    QByteArray data = ds3Reader.itemData(item.name);
                     m_document->updateTextureMetalnessImage(new QImage(QImage::fromData(data, "PNG")));
                 } else if (item.name == "object_roughness.png") {
-                    QByteArray data;
-                    ds3Reader.loadItem(item.name, &data);
+                    QByteArray data = ds3Reader.itemData(item.name);
                     m_document->updateTextureRoughnessImage(new QImage(QImage::fromData(data, "PNG")));
                 } else if (item.name == "object_ao.png") {
-                    QByteArray data;
-                    ds3Reader.loadItem(item.name, &data);
+                    QByteArray data = ds3Reader.itemData(item.name);
                     m_document->updateTextureAmbientOcclusionImage(new QImage(QImage::fromData(data, "PNG")));
                 }
             } else if (item.type == "script") {
                 if (item.name == "model.js") {
-                    QByteArray script;
-                    ds3Reader.loadItem(item.name, &script);
-                    m_document->initScript(QString::fromUtf8(script.constData()));
+                    QByteArray script = ds3Reader.itemData(item.name);
+                    m_document->initScript(QString::fromUtf8(script.constData(), script.size()));
                 }
             } else if (item.type == "variable") {
                 if (item.name == "variables.xml") {
-                    QByteArray data;
-                    ds3Reader.loadItem(item.name, &data);
+                    QByteArray data = ds3Reader.itemData(item.name);
                     QXmlStreamReader stream(data);
                     std::map<QString, std::map<QString, QString>> variables;
                     loadVariablesFromXmlStream(&variables, stream);
@@ -1731,8 +1743,7 @@ void DocumentWindow::openPathAs(const QString &path, const QString &asName)
             Ds3ReaderItem item = ds3Reader.items().at(i);
             if (item.type == "object") {
                 if (item.name == "object.xml") {
-                    QByteArray data;
-                    ds3Reader.loadItem(item.name, &data);
+                    QByteArray data = ds3Reader.itemData(item.name);
                     QXmlStreamReader stream(data);
                     Object *object = new Object;
                     loadObjectFromXmlStream(object, stream);
@@ -1810,6 +1821,19 @@ void DocumentWindow::exportRenderedResult()
     exportImageToFilename(filename);
 }
 
+void DocumentWindow::exportProfileTrace()
+{
+    QString filename = QFileDialog::getSaveFileName(this, QString(), QString(),
+       tr("Chrome Trace (*.json)"));
+    if (filename.isEmpty()) {
+        return;
+    }
+    ensureFileExtension(&filename, ".json");
+    if (!Profiler::saveTrace(filename))
+        qDebug() << "Save profile trace failed:" << filename;
+    qDebug().noquote() << Profiler::summary();
+}
+
 void DocumentWindow::exportObjResult()
 {
     QString filename = QFileDialog::getSaveFileName(this, QString(), QString(),
@@ -1824,6 +1848,7 @@ void DocumentWindow::exportObjResult()
 void DocumentWindow::exportObjToFilename(const QString &filename)
 {
     QApplication::setOverrideCursor(Qt::WaitCursor);
+    ProfileScope profileScope("objExport");
     Model *resultMesh = m_document->takeResultMesh();
     if (nullptr != resultMesh) {
         resultMesh->exportAsObj(filename);
@@ -1885,6 +1910,7 @@ void DocumentWindow::exportFbxToFilename(const QString &filename)
         return;
     }
     QApplication::setOverrideCursor(Qt::WaitCursor);
+    ProfileScope profileScope("fbxExport");
     Object skeletonResult = m_document->currentPostProcessedObject();
     std::vector<std::pair<QString, std::vector<std::pair<float, JointNodeTree>>>> exportMotions;
     for (const auto &motionIt: m_document->motionMap) {
@@ -1897,6 +1923,8 @@ void DocumentWindow::exportFbxToFilename(const QString &filename)
         m_document->textureRoughnessImage,
         m_document->textureAmbientOcclusionImage,
         exportMotions.empty() ? nullptr : &exportMotions);
+    if (m_fbxCompressionLevel >= 0)
+        fbxFileWriter.setCompressionLevel(m_fbxCompressionLevel);
     fbxFileWriter.save();
     QApplication::restoreOverrideCursor();
 }
@@ -1930,6 +1958,7 @@ void DocumentWindow::exportGlbToFilename(const QString &filename)
         return;
     }
     QApplication::setOverrideCursor(Qt::WaitCursor);
+    ProfileScope profileScope("glbExport");
     Object skeletonResult = m_document->currentPostProcessedObject();
     std::vector<std::pair<QString, std::vector<std::pair<float, JointNodeTree>>>> exportMotions;
     for (const auto &motionIt: m_document->motionMap) {
@@ -1964,7 +1993,7 @@ void DocumentWindow::exportDs3objToFilename(const QString &filename)
     }
     
     const std::vector<RigBone> *rigBones = m_document->resultRigBones();
-    const std::map<int, RigVertexWeights> *rigWeights = m_document->resultRigWeights();
+    const RigWeights *rigWeights = m_document->resultRigWeights();
     if (nullptr != rigBones && nullptr != rigWeights) {
         QByteArray rigXml;
         QXmlStreamWriter stream(&rigXml);
@@ -2251,6 +2280,12 @@ void DocumentWindow::showCutFaceSettingPopup(const QPoint &globalPos, std::set<Q
 void DocumentWindow::setExportWaitingList(const QStringList &filenames)
 {
     m_waitingForExportToFilenames = filenames;
+    m_document->setDraftMeshEnabled(m_waitingForExportToFilenames.empty());
+}
+
+void DocumentWindow::setFbxCompressionLevel(int level)
+{
+    m_fbxCompressionLevel = level;
 }
 
 void DocumentWindow::checkExportWaitingList()
@@ -74,6 +74,7 @@ public slots:
     void exportFbxResult();
     void exportTextures();
     void exportDs3objResult();
+    void exportProfileTrace();
     void newWindow();
     void newDocument();
     void saveAs();
@@ -99,6 +100,7 @@ public slots:
     void showPreferences();
     void showCutFaceSettingPopup(const QPoint &globalPos, std::set<QUuid> nodeIds);
     void setExportWaitingList(const QStringList &filenames);
+    void setFbxCompressionLevel(int level);
     void checkExportWaitingList();
     void exportImageToFilename(const QString &filename);
     void exportObjToFilename(const QString &filename);
@@ -141,6 +143,8 @@ private:
     bool m_isLastMeshGenerationSucceed = true;
     quint64 m_currentUpdatedMeshId = 0;
     QStringList m_waitingForExportToFilenames;
+    // Negative keeps the default level of the fbx writer
+    int m_fbxCompressionLevel = -1;
     color_widgets::ColorWheel *m_colorWheelWidget = nullptr;
 private:
     QString m_currentFilename;
@@ -184,6 +188,8 @@ private:
     QMenu *m_windowMenu = nullptr;
     QAction *m_showPartsListAction = nullptr;
     QAction *m_showDebugDialogAction = nullptr;
+    QAction *m_toggleProfilerAction = nullptr;
+    QAction *m_exportProfileTraceAction = nullptr;
     QAction *m_showMaterialsAction = nullptr;
     QAction *m_showRigAction = nullptr;
     QAction *m_showMotionsAction = nullptr;
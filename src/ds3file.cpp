@@ -1,32 +1,34 @@
 #include <QFile>
-#include <QTextStream>
 #include <QXmlStreamReader>
+#include <cstring>
+#include <cctype>
 #include "ds3file.h"
 
 QString Ds3FileReader::m_applicationName = QString("DUST3D");
 QString Ds3FileReader::m_fileFormatVersion = QString("1.0");
 QString Ds3FileReader::m_headFormat = QString("xml");
 
-QString Ds3FileReader::readFirstLine()
-{
-    QString firstLine;
-    QFile file(m_filename);
-    if (file.open(QIODevice::ReadOnly)) {
-       QTextStream in(&file);
-       if (!in.atEnd()) {
-          firstLine = in.readLine();
-       }
-       file.close();
-    }
-    return firstLine;
-}
-
 Ds3FileReader::Ds3FileReader(const QString &filename) :
     m_headerIsGood(false),
     m_binaryOffset(0)
 {
     m_filename = filename;
-    QString firstLine = readFirstLine();
+    m_file.setFileName(m_filename);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    // Item data is served straight from the mapping, resources which can't be mapped are read once
+    m_dataSize = m_file.size();
+    m_data = m_file.map(0, m_dataSize);
+    if (nullptr == m_data) {
+        m_content = m_file.readAll();
+        m_data = (const uchar *)m_content.constData();
+        m_dataSize = m_content.size();
+    }
+    const char *begin = (const char *)m_data;
+    const char *lineEnd = (const char *)memchr(begin, '\n', m_dataSize);
+    long long firstLineSize = nullptr == lineEnd ? m_dataSize : lineEnd - begin;
+    QString firstLine = QString::fromUtf8(begin, firstLineSize).trimmed();
     QStringList tokens = firstLine.split(" ");
     if (tokens.length() < 4) {
         return;
@@ -41,11 +43,14 @@ Ds3FileReader::Ds3FileReader(const QString &filename) :
         return;
     }
     m_binaryOffset = tokens[3].toLongLong();
-    QFile file(m_filename);
-    if (!file.open(QIODevice::ReadOnly)) {
+    if (m_binaryOffset <= firstLineSize || m_binaryOffset > m_dataSize) {
         return;
     }
-    QString header = QString::fromUtf8(file.read(m_binaryOffset).constData()).mid(firstLine.size()).trimmed();
+    // The xml declaration must come first, so skip the line break after the first line
+    long long headerBegin = firstLineSize;
+    while (headerBegin < m_binaryOffset && isspace((unsigned char)begin[headerBegin]))
+        ++headerBegin;
+    QByteArray header = QByteArray::fromRawData(begin + headerBegin, m_binaryOffset - headerBegin);
     QXmlStreamReader xml(header);
     bool ds3TagEntered = false;
     while (!xml.atEnd()) {
@@ -73,23 +78,34 @@ Ds3FileReader::Ds3FileReader(const QString &filename) :
     }
 }
 
-void Ds3FileReader::loadItem(const QString &name, QByteArray *byteArray)
+Ds3FileReader::~Ds3FileReader()
+{
+    if (m_content.isEmpty() && nullptr != m_data)
+        m_file.unmap(const_cast<uchar *>(m_data));
+}
+
+QByteArray Ds3FileReader::itemData(const QString &name) const
 {
-    byteArray->clear();
+    // Refers to the mapped file, only valid as long as the reader lives
     if (!m_headerIsGood)
-        return;
-    if (m_itemsMap.find(name) == m_itemsMap.end()) {
-        return;
-    }
-    Ds3ReaderItem readerItem = m_itemsMap[name];
-    QFile file(m_filename);
-    if (!file.open(QIODevice::ReadOnly)) {
-        return;
+        return QByteArray();
+    auto findItem = m_itemsMap.find(name);
+    if (findItem == m_itemsMap.end()) {
+        return QByteArray();
     }
-    if (!file.seek(m_binaryOffset + readerItem.offset)) {
-        return;
+    const Ds3ReaderItem &readerItem = findItem->second;
+    long long begin = m_binaryOffset + readerItem.offset;
+    if (readerItem.offset < 0 || readerItem.size < 0 ||
+            begin + readerItem.size > m_dataSize) {
+        return QByteArray();
     }
-    *byteArray = file.read(readerItem.size);
+    return QByteArray::fromRawData((const char *)m_data + begin, (int)readerItem.size);
+}
+
+void Ds3FileReader::loadItem(const QString &name, QByteArray *byteArray)
+{
+    QByteArray data = itemData(name);
+    *byteArray = QByteArray(data.constData(), data.size());
 }
 
 const QList<Ds3ReaderItem> &Ds3FileReader::items()
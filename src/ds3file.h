@@ -3,6 +3,7 @@
 #include <QObject>
 #include <QString>
 #include <QByteArray>
+#include <QFile>
 #include <map>
 
 /*
@@ -29,7 +30,9 @@ class Ds3FileReader : public QObject
     Q_OBJECT
 public:
     Ds3FileReader(const QString &filename);
+    ~Ds3FileReader();
     void loadItem(const QString &name, QByteArray *byteArray);
+    QByteArray itemData(const QString &name) const;
     const QList<Ds3ReaderItem> &items();
     static QString m_applicationName;
     static QString m_fileFormatVersion;
@@ -39,7 +42,10 @@ private:
     QList<Ds3ReaderItem> m_items;
     QString m_filename;
 private:
-    QString readFirstLine();
+    QFile m_file;
+    const uchar *m_data = nullptr;
+    long long m_dataSize = 0;
+    QByteArray m_content;
     bool m_headerIsGood;
     long long m_binaryOffset;
 };
@@ -0,0 +1,249 @@
+#include <unordered_map>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "exportmesh.h"
+
+struct ExportVertexKey
+{
+    size_t sourceVertex;
+    quint32 bits[5];
+    
+    bool operator==(const ExportVertexKey &other) const
+    {
+        return sourceVertex == other.sourceVertex &&
+            0 == memcmp(bits, other.bits, sizeof(bits));
+    }
+};
+
+struct ExportVertexKeyHash
+{
+    size_t operator()(const ExportVertexKey &key) const
+    {
+        size_t hash = std::hash<size_t>()(key.sourceVertex);
+        for (int i = 0; i < 5; ++i)
+            hash ^= std::hash<quint32>()(key.bits[i]) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        return hash;
+    }
+};
+
+static inline quint32 floatBits(float value)
+{
+    // Fold negative zero, so it welds with positive zero
+    if (0.0f == value)
+        value = 0.0f;
+    quint32 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+void buildExportMesh(const Object &object,
+    bool withNormals,
+    bool withUvs,
+    bool optimizeForRendering,
+    ExportMesh &exportMesh)
+{
+    const std::vector<std::vector<QVector3D>> *triangleVertexNormals = withNormals ? object.triangleVertexNormals() : nullptr;
+    const std::vector<std::vector<QVector2D>> *triangleVertexUvs = withUvs ? object.triangleVertexUvs() : nullptr;
+    
+    exportMesh = ExportMesh();
+    exportMesh.indices.reserve(object.triangles.size() * 3);
+    
+    std::unordered_map<ExportVertexKey, size_t, ExportVertexKeyHash> vertexMap;
+    vertexMap.reserve(object.vertices.size() * 2);
+    for (size_t triangleIndex = 0; triangleIndex < object.triangles.size(); ++triangleIndex) {
+        const auto &triangle = object.triangles[triangleIndex];
+        for (size_t corner = 0; corner < 3; ++corner) {
+            ExportVertexKey key;
+            key.sourceVertex = triangle[corner];
+            memset(key.bits, 0, sizeof(key.bits));
+            QVector3D normal;
+            QVector2D uv;
+            if (nullptr != triangleVertexNormals) {
+                normal = (*triangleVertexNormals)[triangleIndex][corner];
+                key.bits[0] = floatBits(normal.x());
+                key.bits[1] = floatBits(normal.y());
+                key.bits[2] = floatBits(normal.z());
+            }
+            if (nullptr != triangleVertexUvs) {
+                uv = (*triangleVertexUvs)[triangleIndex][corner];
+                key.bits[3] = floatBits(uv.x());
+                key.bits[4] = floatBits(uv.y());
+            }
+            auto insertResult = vertexMap.insert({key, exportMesh.positions.size()});
+            if (insertResult.second) {
+                exportMesh.positions.push_back(object.vertices[triangle[corner]]);
+                exportMesh.sourceVertices.push_back(triangle[corner]);
+                if (nullptr != triangleVertexNormals)
+                    exportMesh.normals.push_back(normal);
+                if (nullptr != triangleVertexUvs)
+                    exportMesh.uvs.push_back(uv);
+            }
+            exportMesh.indices.push_back(insertResult.first->second);
+        }
+    }
+    
+    if (optimizeForRendering) {
+        optimizeVertexCache(exportMesh);
+        optimizeVertexFetch(exportMesh);
+    }
+}
+
+// Tom Forsyth, Linear-Speed Vertex Cache Optimisation
+// https://tomforsyth1000.github.io/papers/fast_vert_cache_opt.html
+
+static const int kCacheSize = 32;
+
+static float vertexScore(int cachePosition, int remainingValence)
+{
+    if (0 == remainingValence)
+        return -1.0f;
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            // The triangle just used, fixed score so it doesn't get reused right away
+            score = 0.75f;
+        } else {
+            score = std::pow(1.0f - (float)(cachePosition - 3) / (kCacheSize - 3), 1.5f);
+        }
+    }
+    score += 2.0f / std::sqrt((float)remainingValence);
+    return score;
+}
+
+void optimizeVertexCache(ExportMesh &exportMesh)
+{
+    size_t vertexCount = exportMesh.positions.size();
+    size_t triangleCount = exportMesh.indices.size() / 3;
+    if (0 == triangleCount)
+        return;
+    
+    std::vector<int> valences(vertexCount, 0);
+    for (const auto &index: exportMesh.indices)
+        valences[index]++;
+    std::vector<size_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < vertexCount; ++i)
+        adjacencyOffsets[i + 1] = adjacencyOffsets[i] + valences[i];
+    std::vector<size_t> adjacencyTriangles(exportMesh.indices.size());
+    {
+        std::vector<size_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < exportMesh.indices.size(); ++i)
+            adjacencyTriangles[fill[exportMesh.indices[i]]++] = i / 3;
+    }
+    
+    std::vector<int> cachePositions(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i)
+        vertexScores[i] = vertexScore(-1, valences[i]);
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        triangleScores[t] = vertexScores[exportMesh.indices[t * 3]] +
+            vertexScores[exportMesh.indices[t * 3 + 1]] +
+            vertexScores[exportMesh.indices[t * 3 + 2]];
+    }
+    
+    // The two caches swap after each triangle, so neither allocates inside the loop
+    std::vector<size_t> cache;
+    cache.reserve(kCacheSize + 3);
+    std::vector<size_t> newCache;
+    newCache.reserve(kCacheSize + 3);
+    std::vector<size_t> newIndices;
+    newIndices.reserve(exportMesh.indices.size());
+    
+    size_t bestTriangle = std::max_element(triangleScores.begin(), triangleScores.end()) - triangleScores.begin();
+    size_t nextUnemitted = 0;
+    for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount) {
+        if (bestTriangle >= triangleCount || emitted[bestTriangle]) {
+            // Nothing left around the cache, continue from the first triangle not emitted yet
+            while (emitted[nextUnemitted])
+                ++nextUnemitted;
+            bestTriangle = nextUnemitted;
+        }
+        emitted[bestTriangle] = true;
+        
+        newCache.clear();
+        for (size_t corner = 0; corner < 3; ++corner) {
+            size_t vertex = exportMesh.indices[bestTriangle * 3 + corner];
+            newIndices.push_back(vertex);
+            newCache.push_back(vertex);
+            valences[vertex]--;
+            // Remove the emitted triangle from the remaining adjacency of the vertex
+            size_t begin = adjacencyOffsets[vertex];
+            size_t end = begin + valences[vertex];
+            for (size_t i = begin; i <= end; ++i) {
+                if (adjacencyTriangles[i] == bestTriangle) {
+                    std::swap(adjacencyTriangles[i], adjacencyTriangles[end]);
+                    break;
+                }
+            }
+        }
+        for (const auto &vertex: cache) {
+            if (std::find(newCache.begin(), newCache.end(), vertex) == newCache.end())
+                newCache.push_back(vertex);
+        }
+        for (size_t i = kCacheSize; i < newCache.size(); ++i)
+            cachePositions[newCache[i]] = -1;
+        if (newCache.size() > (size_t)kCacheSize)
+            newCache.resize(kCacheSize);
+        for (size_t i = 0; i < newCache.size(); ++i)
+            cachePositions[newCache[i]] = (int)i;
+        for (const auto &vertex: cache) {
+            if (-1 == cachePositions[vertex])
+                vertexScores[vertex] = vertexScore(-1, valences[vertex]);
+        }
+        cache.swap(newCache);
+        
+        float bestScore = -1.0f;
+        bestTriangle = triangleCount;
+        for (const auto &vertex: cache)
+            vertexScores[vertex] = vertexScore(cachePositions[vertex], valences[vertex]);
+        for (const auto &vertex: cache) {
+            size_t begin = adjacencyOffsets[vertex];
+            size_t end = begin + valences[vertex];
+            for (size_t i = begin; i < end; ++i) {
+                size_t t = adjacencyTriangles[i];
+                triangleScores[t] = vertexScores[exportMesh.indices[t * 3]] +
+                    vertexScores[exportMesh.indices[t * 3 + 1]] +
+                    vertexScores[exportMesh.indices[t * 3 + 2]];
+                if (triangleScores[t] > bestScore) {
+                    bestScore = triangleScores[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+    }
+    
+    exportMesh.indices.swap(newIndices);
+}
+
+template <class T>
+static void reorderVertices(std::vector<T> &values, const std::vector<size_t> &remap, size_t newVertexCount)
+{
+    if (values.empty())
+        return;
+    std::vector<T> reordered(newVertexCount);
+    for (size_t i = 0; i < remap.size(); ++i) {
+        if (remap.size() != remap[i])
+            reordered[remap[i]] = values[i];
+    }
+    values.swap(reordered);
+}
+
+void optimizeVertexFetch(ExportMesh &exportMesh)
+{
+    // Number vertices in the order they are first referenced
+    size_t vertexCount = exportMesh.positions.size();
+    std::vector<size_t> remap(vertexCount, vertexCount);
+    size_t nextVertex = 0;
+    for (auto &index: exportMesh.indices) {
+        if (vertexCount == remap[index])
+            remap[index] = nextVertex++;
+        index = remap[index];
+    }
+    
+    reorderVertices(exportMesh.positions, remap, nextVertex);
+    reorderVertices(exportMesh.normals, remap, nextVertex);
+    reorderVertices(exportMesh.uvs, remap, nextVertex);
+    reorderVertices(exportMesh.sourceVertices, remap, nextVertex);
+}
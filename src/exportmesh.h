@@ -0,0 +1,27 @@
+#ifndef DUST3D_EXPORT_MESH_H
+#define DUST3D_EXPORT_MESH_H
+#include <QVector3D>
+#include <QVector2D>
+#include <vector>
+#include "object.h"
+
+// Indexed vertex buffer shared by the exporters, triangle corners with identical
+// source vertex, normal and uv are welded into one vertex
+struct ExportMesh
+{
+    std::vector<QVector3D> positions;
+    std::vector<QVector3D> normals;
+    std::vector<QVector2D> uvs;
+    std::vector<size_t> sourceVertices;
+    std::vector<size_t> indices;
+};
+
+void buildExportMesh(const Object &object,
+    bool withNormals,
+    bool withUvs,
+    bool optimizeForRendering,
+    ExportMesh &exportMesh);
+void optimizeVertexCache(ExportMesh &exportMesh);
+void optimizeVertexFetch(ExportMesh &exportMesh);
+
+#endif
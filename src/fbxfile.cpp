@@ -2203,7 +2203,7 @@ void FbxFileWriter::createDefinitions(size_t deformerCount,
 
 FbxFileWriter::FbxFileWriter(Object &object,
         const std::vector<RigBone> *resultRigBones,
-        const std::map<int, RigVertexWeights> *resultRigWeights,
+        const RigWeights *resultRigWeights,
         const QString &filename,
         QImage *textureImage,
         QImage *normalImage,
@@ -2415,14 +2415,16 @@ FbxFileWriter::FbxFileWriter(Object &object,
     if (resultRigBones && !resultRigBones->empty()) {
         std::vector<std::pair<std::vector<int32_t>, std::vector<double>>> bindPerBone(resultRigBones->size());
         if (resultRigWeights && !resultRigWeights->empty()) {
-            for (const auto &item: *resultRigWeights) {
+            for (size_t vertexIndex = 0; vertexIndex < resultRigWeights->vertexCount(); ++vertexIndex) {
+                const quint16 *boneIndices = resultRigWeights->boneIndices(vertexIndex);
+                const float *boneWeights = resultRigWeights->boneWeights(vertexIndex);
                 for (int i = 0; i < MAX_WEIGHT_NUM; ++i) {
-                    const auto &boneIndex = item.second.boneIndices[i];
+                    const auto &boneIndex = boneIndices[i];
                     Q_ASSERT(boneIndex < bindPerBone.size());
                     if (0 == boneIndex)
                         break;
-                    bindPerBone[boneIndex].first.push_back(item.first);
-                    bindPerBone[boneIndex].second.push_back(item.second.boneWeights[i]);
+                    bindPerBone[boneIndex].first.push_back(vertexIndex);
+                    bindPerBone[boneIndex].second.push_back(boneWeights[i]);
                 }
             }
         }
@@ -4127,9 +4129,15 @@ int64_t FbxFileWriter::to64Id(const QUuid &uuid)
     return insertResult.first->second;
 }
 
+void FbxFileWriter::setCompressionLevel(int level)
+{
+    m_compressionLevel = level;
+}
+
 bool FbxFileWriter::save()
 {
     //m_fbxDocument.print();
+    m_fbxDocument.setCompressionLevel(m_compressionLevel);
     m_fbxDocument.write(m_filename.toStdString());
     return true;
 }
@@ -16,7 +16,7 @@ class FbxFileWriter : public QObject
 public:
     FbxFileWriter(Object &object,
         const std::vector<RigBone> *resultRigBones,
-        const std::map<int, RigVertexWeights> *resultRigWeights,
+        const RigWeights *resultRigWeights,
         const QString &filename,
         QImage *textureImage=nullptr,
         QImage *normalImage=nullptr,
@@ -25,6 +25,8 @@ public:
         QImage *ambientOcclusionImage=nullptr,
         const std::vector<std::pair<QString, std::vector<std::pair<float, JointNodeTree>>>> *motions=nullptr);
     bool save();
+    // Deflate level of array properties, 0 writes them uncompressed
+    void setCompressionLevel(int level);
 
 private:
     void createFbxHeader();
@@ -53,6 +55,7 @@ private:
     QString m_baseName;
     fbx::FBXDocument m_fbxDocument;
     std::map<QString, int64_t> m_uuidTo64Map;
+    int m_compressionLevel = 6;
     static std::vector<double> m_identityMatrix;
 };
 
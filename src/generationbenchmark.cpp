@@ -0,0 +1,179 @@
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QImage>
+#include <QDebug>
+#include <map>
+#include "generationbenchmark.h"
+#include "meshgenerator.h"
+#include "meshresultpostprocessor.h"
+#include "texturegenerator.h"
+#include "riggenerator.h"
+#include "glbfile.h"
+#include "fbxfile.h"
+#include "util.h"
+
+static double elapsedMilliseconds(const QElapsedTimer &timer)
+{
+    return timer.nsecsElapsed() / 1000000.0;
+}
+
+// Runs the same stages as Document does after loading a model, then exports the result as glb and fbx
+static size_t runPipeline(const Snapshot &snapshot, RigType rigType, GeneratedCacheContext *cacheContext,
+    const QString &exportDirectory, std::map<QString, double> *milliseconds)
+{
+    QElapsedTimer timer;
+    
+    timer.start();
+    MeshGenerator *meshGenerator = new MeshGenerator(new Snapshot(snapshot));
+    meshGenerator->setGeneratedCacheContext(cacheContext);
+    meshGenerator->generate();
+    Object *object = meshGenerator->takeObject();
+    delete meshGenerator;
+    (*milliseconds)["mesh"] = elapsedMilliseconds(timer);
+    if (nullptr == object)
+        return 0;
+    
+    timer.restart();
+    MeshResultPostProcessor *postProcessor = new MeshResultPostProcessor(*object);
+    postProcessor->poseProcess();
+    Object *postProcessedObject = postProcessor->takePostProcessedObject();
+    delete postProcessor;
+    (*milliseconds)["postProcess"] = elapsedMilliseconds(timer);
+    
+    timer.restart();
+    TextureGenerator *textureGenerator = new TextureGenerator(*postProcessedObject, new Snapshot(snapshot));
+    textureGenerator->generate();
+    QImage *textureImage = textureGenerator->takeResultTextureColorImage();
+    QImage *textureNormalImage = textureGenerator->takeResultTextureNormalImage();
+    QImage *textureMetalnessImage = textureGenerator->takeResultTextureMetalnessImage();
+    QImage *textureRoughnessImage = textureGenerator->takeResultTextureRoughnessImage();
+    QImage *textureAmbientOcclusionImage = textureGenerator->takeResultTextureAmbientOcclusionImage();
+    delete textureGenerator;
+    (*milliseconds)["texture"] = elapsedMilliseconds(timer);
+    
+    std::vector<RigBone> *rigBones = nullptr;
+    RigWeights *rigWeights = nullptr;
+    if (RigType::None != rigType) {
+        timer.restart();
+        RigGenerator *rigGenerator = new RigGenerator(rigType, *object);
+        rigGenerator->generate();
+        rigBones = rigGenerator->takeResultBones();
+        rigWeights = rigGenerator->takeResultWeights();
+        delete rigGenerator;
+        (*milliseconds)["rig"] = elapsedMilliseconds(timer);
+    }
+    
+    timer.restart();
+    QImage *textureMetalnessRoughnessAmbientOcclusionImage = 
+        TextureGenerator::combineMetalnessRoughnessAmbientOcclusionImages(textureMetalnessImage,
+            textureRoughnessImage,
+            textureAmbientOcclusionImage);
+    GlbFileWriter glbFileWriter(*postProcessedObject, rigBones, rigWeights, exportDirectory + "/benchmark.glb",
+        textureImage, textureNormalImage, textureMetalnessRoughnessAmbientOcclusionImage);
+    if (!glbFileWriter.save())
+        qDebug() << "Benchmark glb export failed";
+    delete textureMetalnessRoughnessAmbientOcclusionImage;
+    (*milliseconds)["glbExport"] = elapsedMilliseconds(timer);
+    
+    timer.restart();
+    FbxFileWriter fbxFileWriter(*postProcessedObject, rigBones, rigWeights, exportDirectory + "/benchmark.fbx",
+        textureImage,
+        textureNormalImage,
+        textureMetalnessImage,
+        textureRoughnessImage,
+        textureAmbientOcclusionImage);
+    if (!fbxFileWriter.save())
+        qDebug() << "Benchmark fbx export failed";
+    (*milliseconds)["fbxExport"] = elapsedMilliseconds(timer);
+    
+    size_t triangleCount = postProcessedObject->triangles.size();
+    
+    delete rigBones;
+    delete rigWeights;
+    delete textureImage;
+    delete textureNormalImage;
+    delete textureMetalnessImage;
+    delete textureRoughnessImage;
+    delete textureAmbientOcclusionImage;
+    delete postProcessedObject;
+    delete object;
+    
+    return triangleCount;
+}
+
+static void addStageResults(Benchmark *benchmark, const QString &name, const QString &mode,
+    const std::map<QString, std::vector<double>> &stageMilliseconds)
+{
+    for (const auto &it: stageMilliseconds) {
+        benchmark->addResult("generation", name, mode + "." + it.first + ".milliseconds",
+            Benchmark::Kind::Time, Benchmark::median(it.second));
+    }
+}
+
+void runGenerationBenchmark(Benchmark *benchmark)
+{
+    QTemporaryDir exportDirectory;
+    if (!exportDirectory.isValid()) {
+        qDebug() << "Create temporary export directory failed";
+        return;
+    }
+    
+    for (const auto &filename: benchmark->modelFilenames()) {
+        QString name = Benchmark::modelName(filename);
+        
+        QElapsedTimer loadTimer;
+        loadTimer.start();
+        Snapshot snapshot;
+        if (!Benchmark::loadModel(filename, &snapshot)) {
+            qDebug() << "Load model failed:" << filename;
+            continue;
+        }
+        benchmark->addResult("generation", name, "load.milliseconds", Benchmark::Kind::Time, elapsedMilliseconds(loadTimer));
+        
+        RigType rigType = RigTypeFromString(valueOfKeyInMapOrEmpty(snapshot.canvas, "rigType").toUtf8().constData());
+        
+        Benchmark::resetPeakResidentBytes();
+        
+        // Cold runs start from an empty cache as after opening a file, each run gets a new cache context
+        size_t triangleCount = 0;
+        std::map<QString, std::vector<double>> coldStageMilliseconds;
+        std::vector<double> coldTotalMilliseconds;
+        for (int i = 0; i < benchmark->iterations(); ++i) {
+            GeneratedCacheContext *cacheContext = new GeneratedCacheContext;
+            std::map<QString, double> milliseconds;
+            QElapsedTimer timer;
+            timer.start();
+            triangleCount = runPipeline(snapshot, rigType, cacheContext, exportDirectory.path(), &milliseconds);
+            coldTotalMilliseconds.push_back(elapsedMilliseconds(timer));
+            delete cacheContext;
+            for (const auto &it: milliseconds)
+                coldStageMilliseconds[it.first].push_back(it.second);
+        }
+        addStageResults(benchmark, name, "cold", coldStageMilliseconds);
+        benchmark->addResult("generation", name, "cold.total.milliseconds", Benchmark::Kind::Time, Benchmark::median(coldTotalMilliseconds));
+        
+        // Warm runs share one cache context which got filled by an untimed run, as when regenerating an unchanged document
+        GeneratedCacheContext *cacheContext = new GeneratedCacheContext;
+        {
+            std::map<QString, double> milliseconds;
+            runPipeline(snapshot, rigType, cacheContext, exportDirectory.path(), &milliseconds);
+        }
+        std::map<QString, std::vector<double>> warmStageMilliseconds;
+        std::vector<double> warmTotalMilliseconds;
+        for (int i = 0; i < benchmark->iterations(); ++i) {
+            std::map<QString, double> milliseconds;
+            QElapsedTimer timer;
+            timer.start();
+            runPipeline(snapshot, rigType, cacheContext, exportDirectory.path(), &milliseconds);
+            warmTotalMilliseconds.push_back(elapsedMilliseconds(timer));
+            for (const auto &it: milliseconds)
+                warmStageMilliseconds[it.first].push_back(it.second);
+        }
+        delete cacheContext;
+        addStageResults(benchmark, name, "warm", warmStageMilliseconds);
+        benchmark->addResult("generation", name, "warm.total.milliseconds", Benchmark::Kind::Time, Benchmark::median(warmTotalMilliseconds));
+        
+        benchmark->addResult("generation", name, "triangles", Benchmark::Kind::Count, triangleCount);
+        benchmark->addResult("generation", name, "peakResident.bytes", Benchmark::Kind::Memory, Benchmark::peakResidentBytes());
+    }
+}
@@ -0,0 +1,7 @@
+#ifndef DUST3D_GENERATION_BENCHMARK_H
+#define DUST3D_GENERATION_BENCHMARK_H
+#include "benchmark.h"
+
+void runGenerationBenchmark(Benchmark *benchmark);
+
+#endif
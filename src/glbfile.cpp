@@ -1,3 +1,5 @@
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 #include <QFile>
 #include <QQuaternion>
 #include <QByteArray>
@@ -5,11 +7,16 @@
 #include <QFileInfo>
 #include <QDir>
 #include <QtCore/qbuffer.h>
+#include <QtEndian>
+#include <cmath>
+#include <cstring>
 #include "glbfile.h"
 #include "version.h"
 #include "util.h"
 #include "jointnodetree.h"
 #include "model.h"
+#include "ddsencoder.h"
+#include "exportmesh.h"
 
 // Play with glTF online:
 // https://gltf-viewer.donmccurdy.com/
@@ -21,10 +28,70 @@
 // https://en.m.wikipedia.org/wiki/Rotation_formalisms_in_three_dimensions?wprov=sfla1
 
 bool GlbFileWriter::m_enableComment = false;
+bool GlbFileWriter::m_enableCompressedTextures = false;
+bool GlbFileWriter::m_enableQuantization = false;
+
+template <class T>
+static QByteArray packLittleEndian(const std::vector<T> &values)
+{
+    QByteArray byteArray;
+    byteArray.resize(values.size() * sizeof(T));
+    if (values.empty())
+        return byteArray;
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    memcpy(byteArray.data(), values.data(), byteArray.size());
+#else
+    qToLittleEndian<T>(values.data(), values.size(), byteArray.data());
+#endif
+    return byteArray;
+}
+
+static inline qint16 quantizeSnorm16(float value)
+{
+    return (qint16)std::round(qBound(-1.0f, value, 1.0f) * 32767.0f);
+}
+
+static inline qint8 quantizeSnorm8(float value)
+{
+    return (qint8)std::round(qBound(-1.0f, value, 1.0f) * 127.0f);
+}
+
+static inline quint16 quantizeUnorm16(float value)
+{
+    return (quint16)std::round(qBound(0.0f, value, 1.0f) * 65535.0f);
+}
+
+class TextureEncoder
+{
+public:
+    TextureEncoder(const std::vector<const QImage *> *images,
+            std::vector<QByteArray> *pngByteArrays,
+            std::vector<QByteArray> *ddsByteArrays) :
+        m_images(images),
+        m_pngByteArrays(pngByteArrays),
+        m_ddsByteArrays(ddsByteArrays)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t i = range.begin(); i != range.end(); ++i) {
+            const QImage *image = (*m_images)[i];
+            QBuffer buffer(&(*m_pngByteArrays)[i]);
+            // Quality 80 maps to zlib level 1, much faster than the default level for large textures
+            image->save(&buffer, "PNG", 80);
+            if (nullptr != m_ddsByteArrays)
+                encodeDds(*image, (*m_ddsByteArrays)[i]);
+        }
+    }
+private:
+    const std::vector<const QImage *> *m_images = nullptr;
+    std::vector<QByteArray> *m_pngByteArrays = nullptr;
+    std::vector<QByteArray> *m_ddsByteArrays = nullptr;
+};
 
 GlbFileWriter::GlbFileWriter(Object &object,
         const std::vector<RigBone> *resultRigBones,
-        const std::map<int, RigVertexWeights> *resultRigWeights,
+        const RigWeights *resultRigWeights,
         const QString &filename,
         QImage *textureImage,
         QImage *normalImage,
@@ -45,16 +112,6 @@ GlbFileWriter::GlbFileWriter(Object &object,
     if (m_outputAnimation) {
         m_outputAnimation = nullptr != motions && !motions->empty();
     }
-
-    QDataStream binStream(&m_binByteArray, QIODevice::WriteOnly);
-    binStream.setFloatingPointPrecision(QDataStream::SinglePrecision);
-    binStream.setByteOrder(QDataStream::LittleEndian);
-    
-    auto alignBin = [this, &binStream] {
-        while (0 != this->m_binByteArray.size() % 4) {
-            binStream << (quint8)0;
-        }
-    };
     
     QDataStream jsonStream(&m_jsonByteArray, QIODevice::WriteOnly);
     jsonStream.setFloatingPointPrecision(QDataStream::SinglePrecision);
@@ -67,18 +124,44 @@ GlbFileWriter::GlbFileWriter(Object &object,
     };
     
     int bufferViewIndex = 0;
-    int bufferViewFromOffset;
     
     JointNodeTree jointNodeTree(resultRigBones);
     const auto &boneNodes = jointNodeTree.nodes();
     
+    bool isSkinned = resultRigBones && resultRigWeights && !resultRigBones->empty();
+    
+    // Quantized positions are stored as shorts inside the bounding cube of the mesh,
+    // the uniform dequantization transform goes to the mesh node, or into the inverse bind matrices
+    // for skinned mesh, because the node transform of skinned mesh is ignored
+    bool quantizePositions = m_enableQuantization && !object.vertices.empty();
+    QVector3D quantizationCenter;
+    float quantizationScale = 1.0;
+    QMatrix4x4 dequantizationMatrix;
+    if (quantizePositions) {
+        QVector3D minPosition = object.vertices[0];
+        QVector3D maxPosition = object.vertices[0];
+        for (const auto &position: object.vertices) {
+            for (int i = 0; i < 3; ++i) {
+                minPosition[i] = std::min(minPosition[i], position[i]);
+                maxPosition[i] = std::max(maxPosition[i], position[i]);
+            }
+        }
+        quantizationCenter = (minPosition + maxPosition) * 0.5;
+        QVector3D halfExtent = (maxPosition - minPosition) * 0.5;
+        quantizationScale = std::max(halfExtent.x(), std::max(halfExtent.y(), halfExtent.z()));
+        if (quantizationScale <= 0)
+            quantizationScale = 1.0;
+        dequantizationMatrix.translate(quantizationCenter);
+        dequantizationMatrix.scale(quantizationScale / 32767);
+    }
+    
     m_json["asset"]["version"] = "2.0";
     m_json["asset"]["generator"] = APP_NAME " " APP_HUMAN_VER;
     m_json["scenes"][0]["nodes"] = {0};
     
     constexpr int skeletonNodeStartIndex = 2;
     
-    if (resultRigBones && resultRigWeights && !resultRigBones->empty()) {
+    if (isSkinned) {
         m_json["nodes"][0]["children"] = {
             1,
             skeletonNodeStartIndex
@@ -116,18 +199,16 @@ GlbFileWriter::GlbFileWriter(Object &object,
         
         m_json["skins"][0]["skeleton"] = skeletonNodeStartIndex;
         m_json["skins"][0]["inverseBindMatrices"] = bufferViewIndex;
-        bufferViewFromOffset = (int)m_binByteArray.size();
-        m_json["bufferViews"][bufferViewIndex]["buffer"] = 0;
-        m_json["bufferViews"][bufferViewIndex]["byteOffset"] = bufferViewFromOffset;
+        std::vector<float> inverseBindMatrices;
+        inverseBindMatrices.reserve(boneNodes.size() * 16);
         for (auto i = 0u; i < boneNodes.size(); i++) {
-            const float *floatArray = boneNodes[i].inverseBindMatrix.constData();
-            for (auto j = 0u; j < 16; j++) {
-                binStream << (float)floatArray[j];
-            }
+            QMatrix4x4 inverseBindMatrix = boneNodes[i].inverseBindMatrix;
+            if (quantizePositions)
+                inverseBindMatrix = inverseBindMatrix * dequantizationMatrix;
+            const float *floatArray = inverseBindMatrix.constData();
+            inverseBindMatrices.insert(inverseBindMatrices.end(), floatArray, floatArray + 16);
         }
-        m_json["bufferViews"][bufferViewIndex]["byteLength"] = m_binByteArray.size() - bufferViewFromOffset;
-        Q_ASSERT((int)boneNodes.size() * 16 * sizeof(float) == m_binByteArray.size() - bufferViewFromOffset);
-        alignBin();
+        addBufferView(bufferViewIndex, packLittleEndian(inverseBindMatrices));
         if (m_enableComment)
             m_json["accessors"][bufferViewIndex]["__comment"] = QString("/accessors/%1: mat").arg(QString::number(bufferViewIndex)).toUtf8().constData();
         m_json["accessors"][bufferViewIndex]["bufferView"] = bufferViewIndex;
@@ -138,19 +219,27 @@ GlbFileWriter::GlbFileWriter(Object &object,
         bufferViewIndex++;
     } else {
         m_json["nodes"][0]["mesh"] = 0;
-    }
-
-    std::vector<QVector3D> triangleVertexPositions;
-    std::vector<size_t> triangleVertexOldIndices;
-    for (const auto &triangleIndices: object.triangles) {
-        for (size_t j = 0; j < 3; ++j) {
-            triangleVertexOldIndices.push_back(triangleIndices[j]);
-            triangleVertexPositions.push_back(object.vertices[triangleIndices[j]]);
+        if (quantizePositions) {
+            m_json["nodes"][0]["translation"] = {
+                quantizationCenter.x(),
+                quantizationCenter.y(),
+                quantizationCenter.z()
+            };
+            m_json["nodes"][0]["scale"] = {
+                quantizationScale / 32767,
+                quantizationScale / 32767,
+                quantizationScale / 32767
+            };
         }
     }
 
+    ExportMesh exportMesh;
+    buildExportMesh(object, m_outputNormal, m_outputUv, true, exportMesh);
+    
+    bool hasQuantizedAttribute = false;
+    
     int primitiveIndex = 0;
-    if (!triangleVertexPositions.empty()) {
+    if (!exportMesh.indices.empty()) {
         
         m_json["meshes"][0]["primitives"][primitiveIndex]["indices"] = bufferViewIndex;
         m_json["meshes"][0]["primitives"][primitiveIndex]["material"] = primitiveIndex;
@@ -183,184 +272,232 @@ GlbFileWriter::GlbFileWriter(Object &object,
         
         primitiveIndex++;
 
-        bufferViewFromOffset = (int)m_binByteArray.size();
-        for (size_t index = 0; index < triangleVertexPositions.size(); index += 3) {
-            binStream << (quint16)index << (quint16)(index + 1) << (quint16)(index + 2);
+        // Unsigned short indices stop at 65534, 65535 is the primitive restart value
+        if (exportMesh.positions.size() < 65536) {
+            std::vector<quint16> indices(exportMesh.indices.begin(), exportMesh.indices.end());
+            addBufferView(bufferViewIndex, packLittleEndian(indices), 34963);
+            m_json["accessors"][bufferViewIndex]["componentType"] = 5123;
+        } else {
+            std::vector<quint32> indices(exportMesh.indices.begin(), exportMesh.indices.end());
+            addBufferView(bufferViewIndex, packLittleEndian(indices), 34963);
+            m_json["accessors"][bufferViewIndex]["componentType"] = 5125;
         }
-        m_json["bufferViews"][bufferViewIndex]["buffer"] = 0;
-        m_json["bufferViews"][bufferViewIndex]["byteOffset"] = bufferViewFromOffset;
-        m_json["bufferViews"][bufferViewIndex]["byteLength"] = (int)triangleVertexPositions.size() * sizeof(quint16);
-        m_json["bufferViews"][bufferViewIndex]["target"] = 34963;
-        Q_ASSERT((int)triangleVertexPositions.size() * sizeof(quint16) == m_binByteArray.size() - bufferViewFromOffset);
-        alignBin();
         if (m_enableComment)
             m_json["accessors"][bufferViewIndex]["__comment"] = QString("/accessors/%1: triangle indices").arg(QString::number(bufferViewIndex)).toUtf8().constData();
         m_json["accessors"][bufferViewIndex]["bufferView"] = bufferViewIndex;
         m_json["accessors"][bufferViewIndex]["byteOffset"] = 0;
-        m_json["accessors"][bufferViewIndex]["componentType"] = 5123;
-        m_json["accessors"][bufferViewIndex]["count"] = triangleVertexPositions.size();
+        m_json["accessors"][bufferViewIndex]["count"] = exportMesh.indices.size();
         m_json["accessors"][bufferViewIndex]["type"] = "SCALAR";
         bufferViewIndex++;
         
-        bufferViewFromOffset = (int)m_binByteArray.size();
-        m_json["bufferViews"][bufferViewIndex]["buffer"] = 0;
-        m_json["bufferViews"][bufferViewIndex]["byteOffset"] = bufferViewFromOffset;
-        float minX = 100;
-        float maxX = -100;
-        float minY = 100;
-        float maxY = -100;
-        float minZ = 100;
-        float maxZ = -100;
-        for (const auto &position: triangleVertexPositions) {
-            if (position.x() < minX)
-                minX = position.x();
-            if (position.x() > maxX)
-                maxX = position.x();
-            if (position.y() < minY)
-                minY = position.y();
-            if (position.y() > maxY)
-                maxY = position.y();
-            if (position.z() < minZ)
-                minZ = position.z();
-            if (position.z() > maxZ)
-                maxZ = position.z();
-            binStream << (float)position.x() << (float)position.y() << (float)position.z();
+        if (quantizePositions) {
+            // Padded to four shorts, vertex attributes must be aligned to four bytes
+            std::vector<qint16> positions(exportMesh.positions.size() * 4, 0);
+            qint16 minQuantized[3] = {32767, 32767, 32767};
+            qint16 maxQuantized[3] = {-32767, -32767, -32767};
+            for (size_t i = 0; i < exportMesh.positions.size(); ++i) {
+                QVector3D normalized = (exportMesh.positions[i] - quantizationCenter) / quantizationScale;
+                for (int j = 0; j < 3; ++j) {
+                    qint16 value = quantizeSnorm16(normalized[j]);
+                    positions[i * 4 + j] = value;
+                    minQuantized[j] = std::min(minQuantized[j], value);
+                    maxQuantized[j] = std::max(maxQuantized[j], value);
+                }
+            }
+            addBufferView(bufferViewIndex, packLittleEndian(positions), 34962, 4 * sizeof(qint16));
+            m_json["accessors"][bufferViewIndex]["componentType"] = 5122;
+            m_json["accessors"][bufferViewIndex]["max"] = {maxQuantized[0], maxQuantized[1], maxQuantized[2]};
+            m_json["accessors"][bufferViewIndex]["min"] = {minQuantized[0], minQuantized[1], minQuantized[2]};
+            hasQuantizedAttribute = true;
+        } else {
+            float minX = 100;
+            float maxX = -100;
+            float minY = 100;
+            float maxY = -100;
+            float minZ = 100;
+            float maxZ = -100;
+            std::vector<float> positions;
+            positions.reserve(exportMesh.positions.size() * 3);
+            for (const auto &position: exportMesh.positions) {
+                if (position.x() < minX)
+                    minX = position.x();
+                if (position.x() > maxX)
+                    maxX = position.x();
+                if (position.y() < minY)
+                    minY = position.y();
+                if (position.y() > maxY)
+                    maxY = position.y();
+                if (position.z() < minZ)
+                    minZ = position.z();
+                if (position.z() > maxZ)
+                    maxZ = position.z();
+                positions.push_back(position.x());
+                positions.push_back(position.y());
+                positions.push_back(position.z());
+            }
+            addBufferView(bufferViewIndex, packLittleEndian(positions), 34962);
+            m_json["accessors"][bufferViewIndex]["componentType"] = 5126;
+            m_json["accessors"][bufferViewIndex]["max"] = {maxX, maxY, maxZ};
+            m_json["accessors"][bufferViewIndex]["min"] = {minX, minY, minZ};
         }
-        Q_ASSERT((int)triangleVertexPositions.size() * 3 * sizeof(float) == m_binByteArray.size() - bufferViewFromOffset);
-        m_json["bufferViews"][bufferViewIndex]["byteLength"] =  triangleVertexPositions.size() * 3 * sizeof(float);
-        m_json["bufferViews"][bufferViewIndex]["target"] = 34962;
-        alignBin();
         if (m_enableComment)
             m_json["accessors"][bufferViewIndex]["__comment"] = QString("/accessors/%1: xyz").arg(QString::number(bufferViewIndex)).toUtf8().constData();
         m_json["accessors"][bufferViewIndex]["bufferView"] = bufferViewIndex;
         m_json["accessors"][bufferViewIndex]["byteOffset"] = 0;
-        m_json["accessors"][bufferViewIndex]["componentType"] = 5126;
-        m_json["accessors"][bufferViewIndex]["count"] =  triangleVertexPositions.size();
+        m_json["accessors"][bufferViewIndex]["count"] =  exportMesh.positions.size();
         m_json["accessors"][bufferViewIndex]["type"] = "VEC3";
-        m_json["accessors"][bufferViewIndex]["max"] = {maxX, maxY, maxZ};
-        m_json["accessors"][bufferViewIndex]["min"] = {minX, minY, minZ};
         bufferViewIndex++;
         
         if (m_outputNormal) {
-            bufferViewFromOffset = (int)m_binByteArray.size();
-            m_json["bufferViews"][bufferViewIndex]["buffer"] = 0;
-            m_json["bufferViews"][bufferViewIndex]["byteOffset"] = bufferViewFromOffset;
             QStringList normalList;
-            for (const auto &normals: (*triangleVertexNormals)) {
-                for (const auto &it: normals) {
-                    binStream << (float)it.x() << (float)it.y() << (float)it.z();
-                    if (m_enableComment && m_outputNormal)
-                        normalList.append(QString("<%1,%2,%3>").arg(QString::number(it.x())).arg(QString::number(it.y())).arg(QString::number(it.z())));
+            if (m_enableComment) {
+                for (const auto &it: exportMesh.normals)
+                    normalList.append(QString("<%1,%2,%3>").arg(QString::number(it.x())).arg(QString::number(it.y())).arg(QString::number(it.z())));
+            }
+            if (m_enableQuantization) {
+                // Padded to four bytes, vertex attributes must be aligned to four bytes
+                std::vector<qint8> normals;
+                normals.reserve(exportMesh.normals.size() * 4);
+                for (const auto &it: exportMesh.normals) {
+                    normals.push_back(quantizeSnorm8(it.x()));
+                    normals.push_back(quantizeSnorm8(it.y()));
+                    normals.push_back(quantizeSnorm8(it.z()));
+                    normals.push_back(0);
+                }
+                addBufferView(bufferViewIndex, packLittleEndian(normals), 34962, 4 * sizeof(qint8));
+                m_json["accessors"][bufferViewIndex]["componentType"] = 5120;
+                m_json["accessors"][bufferViewIndex]["normalized"] = true;
+                hasQuantizedAttribute = true;
+            } else {
+                std::vector<float> normals;
+                normals.reserve(exportMesh.normals.size() * 3);
+                for (const auto &it: exportMesh.normals) {
+                    normals.push_back(it.x());
+                    normals.push_back(it.y());
+                    normals.push_back(it.z());
                 }
+                addBufferView(bufferViewIndex, packLittleEndian(normals), 34962);
+                m_json["accessors"][bufferViewIndex]["componentType"] = 5126;
             }
-            Q_ASSERT((int)triangleVertexNormals->size() * 3 * 3 * sizeof(float) == m_binByteArray.size() - bufferViewFromOffset);
-            m_json["bufferViews"][bufferViewIndex]["byteLength"] =  triangleVertexNormals->size() * 3 * 3 * sizeof(float);
-            m_json["bufferViews"][bufferViewIndex]["target"] = 34962;
-            alignBin();
             if (m_enableComment)
                 m_json["accessors"][bufferViewIndex]["__comment"] = QString("/accessors/%1: normal %2").arg(QString::number(bufferViewIndex)).arg(normalList.join(" ")).toUtf8().constData();
             m_json["accessors"][bufferViewIndex]["bufferView"] = bufferViewIndex;
             m_json["accessors"][bufferViewIndex]["byteOffset"] = 0;
-            m_json["accessors"][bufferViewIndex]["componentType"] = 5126;
-            m_json["accessors"][bufferViewIndex]["count"] =  triangleVertexNormals->size() * 3;
+            m_json["accessors"][bufferViewIndex]["count"] =  exportMesh.normals.size();
             m_json["accessors"][bufferViewIndex]["type"] = "VEC3";
             bufferViewIndex++;
         }
         
         if (m_outputUv) {
-            bufferViewFromOffset = (int)m_binByteArray.size();
-            m_json["bufferViews"][bufferViewIndex]["buffer"] = 0;
-            m_json["bufferViews"][bufferViewIndex]["byteOffset"] = bufferViewFromOffset;
-            for (const auto &uvs: (*triangleVertexUvs)) {
-                for (const auto &it: uvs)
-                    binStream << (float)it.x() << (float)it.y();
+            bool uvInUnitRange = true;
+            for (const auto &it: exportMesh.uvs) {
+                if (it.x() < 0 || it.x() > 1 || it.y() < 0 || it.y() > 1) {
+                    uvInUnitRange = false;
+                    break;
+                }
+            }
+            if (m_enableQuantization && uvInUnitRange) {
+                std::vector<quint16> uvs;
+                uvs.reserve(exportMesh.uvs.size() * 2);
+                for (const auto &it: exportMesh.uvs) {
+                    uvs.push_back(quantizeUnorm16(it.x()));
+                    uvs.push_back(quantizeUnorm16(it.y()));
+                }
+                addBufferView(bufferViewIndex, packLittleEndian(uvs), 34962);
+                m_json["accessors"][bufferViewIndex]["componentType"] = 5123;
+                m_json["accessors"][bufferViewIndex]["normalized"] = true;
+                hasQuantizedAttribute = true;
+            } else {
+                std::vector<float> uvs;
+                uvs.reserve(exportMesh.uvs.size() * 2);
+                for (const auto &it: exportMesh.uvs) {
+                    uvs.push_back(it.x());
+                    uvs.push_back(it.y());
+                }
+                addBufferView(bufferViewIndex, packLittleEndian(uvs), 34962);
+                m_json["accessors"][bufferViewIndex]["componentType"] = 5126;
             }
-            m_json["bufferViews"][bufferViewIndex]["byteLength"] = m_binByteArray.size() - bufferViewFromOffset;
-            alignBin();
             if (m_enableComment)
                 m_json["accessors"][bufferViewIndex]["__comment"] = QString("/accessors/%1: uv").arg(QString::number(bufferViewIndex)).toUtf8().constData();
             m_json["accessors"][bufferViewIndex]["bufferView"] = bufferViewIndex;
             m_json["accessors"][bufferViewIndex]["byteOffset"] = 0;
-            m_json["accessors"][bufferViewIndex]["componentType"] = 5126;
-            m_json["accessors"][bufferViewIndex]["count"] =  triangleVertexUvs->size() * 3;
+            m_json["accessors"][bufferViewIndex]["count"] =  exportMesh.uvs.size();
             m_json["accessors"][bufferViewIndex]["type"] = "VEC2";
             bufferViewIndex++;
         }
         
         if (resultRigWeights && !resultRigWeights->empty()) {
-            bufferViewFromOffset = (int)m_binByteArray.size();
-            m_json["bufferViews"][bufferViewIndex]["buffer"] = 0;
-            m_json["bufferViews"][bufferViewIndex]["byteOffset"] = bufferViewFromOffset;
             QStringList boneList;
+            std::vector<quint16> joints(exportMesh.sourceVertices.size() * MAX_WEIGHT_NUM, 0);
             int weightItIndex = 0;
-            for (const auto &oldIndex: triangleVertexOldIndices) {
-                auto i = 0u;
+            for (const auto &oldIndex: exportMesh.sourceVertices) {
                 if (m_enableComment)
                     boneList.append(QString("%1:<").arg(QString::number(weightItIndex)));
-                auto findWeight = resultRigWeights->find(oldIndex);
-                if (findWeight != resultRigWeights->end()) {
-                    for (; i < MAX_WEIGHT_NUM; i++) {
-                        quint16 nodeIndex = (quint16)findWeight->second.boneIndices[i];
-                        binStream << (quint16)nodeIndex;
-                        if (m_enableComment)
-                            boneList.append(QString("%1").arg(nodeIndex));
-                    }
-                }
-                for (; i < MAX_WEIGHT_NUM; i++) {
-                    binStream << (quint16)0;
-                    if (m_enableComment)
-                        boneList.append(QString("%1").arg(0));
+                if (oldIndex < resultRigWeights->vertexCount()) {
+                    const quint16 *boneIndices = resultRigWeights->boneIndices(oldIndex);
+                    std::copy(boneIndices, boneIndices + MAX_WEIGHT_NUM, joints.begin() + weightItIndex * MAX_WEIGHT_NUM);
                 }
-                if (m_enableComment)
+                if (m_enableComment) {
+                    for (auto i = 0u; i < MAX_WEIGHT_NUM; i++)
+                        boneList.append(QString("%1").arg(joints[weightItIndex * MAX_WEIGHT_NUM + i]));
                     boneList.append(QString(">"));
+                }
                 weightItIndex++;
             }
-            m_json["bufferViews"][bufferViewIndex]["byteLength"] = m_binByteArray.size() - bufferViewFromOffset;
-            alignBin();
+            addBufferView(bufferViewIndex, packLittleEndian(joints));
             if (m_enableComment)
                 m_json["accessors"][bufferViewIndex]["__comment"] = QString("/accessors/%1: bone indices %2").arg(QString::number(bufferViewIndex)).arg(boneList.join(" ")).toUtf8().constData();
             m_json["accessors"][bufferViewIndex]["bufferView"] = bufferViewIndex;
             m_json["accessors"][bufferViewIndex]["byteOffset"] = 0;
             m_json["accessors"][bufferViewIndex]["componentType"] = 5123;
-            m_json["accessors"][bufferViewIndex]["count"] =  triangleVertexOldIndices.size();
+            m_json["accessors"][bufferViewIndex]["count"] =  exportMesh.sourceVertices.size();
             m_json["accessors"][bufferViewIndex]["type"] = "VEC4";
             bufferViewIndex++;
             
-            bufferViewFromOffset = (int)m_binByteArray.size();
-            m_json["bufferViews"][bufferViewIndex]["buffer"] = 0;
-            m_json["bufferViews"][bufferViewIndex]["byteOffset"] = bufferViewFromOffset;
             QStringList weightList;
+            std::vector<float> weights(exportMesh.sourceVertices.size() * MAX_WEIGHT_NUM, 0.0);
             weightItIndex = 0;
-            for (const auto &oldIndex: triangleVertexOldIndices) {
-                auto i = 0u;
+            for (const auto &oldIndex: exportMesh.sourceVertices) {
                 if (m_enableComment)
                     weightList.append(QString("%1:<").arg(QString::number(weightItIndex)));
-                auto findWeight = resultRigWeights->find(oldIndex);
-                if (findWeight != resultRigWeights->end()) {
-                    for (; i < MAX_WEIGHT_NUM; i++) {
-                        float weight = (float)findWeight->second.boneWeights[i];
-                        binStream << (float)weight;
-                        if (m_enableComment)
-                            weightList.append(QString("%1").arg(QString::number((float)weight)));
-                    }
+                if (oldIndex < resultRigWeights->vertexCount()) {
+                    const float *boneWeights = resultRigWeights->boneWeights(oldIndex);
+                    std::copy(boneWeights, boneWeights + MAX_WEIGHT_NUM, weights.begin() + weightItIndex * MAX_WEIGHT_NUM);
                 }
-                for (; i < MAX_WEIGHT_NUM; i++) {
-                    binStream << (float)0.0;
-                    if (m_enableComment)
-                        weightList.append(QString("%1").arg(QString::number(0.0)));
-                }
-                if (m_enableComment)
+                if (m_enableComment) {
+                    for (auto i = 0u; i < MAX_WEIGHT_NUM; i++)
+                        weightList.append(QString("%1").arg(QString::number(weights[weightItIndex * MAX_WEIGHT_NUM + i])));
                     weightList.append(QString(">"));
+                }
                 weightItIndex++;
             }
-            m_json["bufferViews"][bufferViewIndex]["byteLength"] = m_binByteArray.size() - bufferViewFromOffset;
-            alignBin();
+            if (m_enableQuantization) {
+                // Normalized bytes must still sum up to one, so the rounding error goes to the biggest weight
+                std::vector<quint8> quantizedWeights(weights.size(), 0);
+                for (size_t offset = 0; offset < weights.size(); offset += MAX_WEIGHT_NUM) {
+                    int sum = 0;
+                    size_t biggest = offset;
+                    for (size_t i = offset; i < offset + MAX_WEIGHT_NUM; ++i) {
+                        quantizedWeights[i] = (quint8)std::round(qBound(0.0f, weights[i], 1.0f) * 255.0f);
+                        sum += quantizedWeights[i];
+                        if (weights[i] > weights[biggest])
+                            biggest = i;
+                    }
+                    if (sum > 0)
+                        quantizedWeights[biggest] = (quint8)qBound(0, (int)quantizedWeights[biggest] + 255 - sum, 255);
+                }
+                addBufferView(bufferViewIndex, packLittleEndian(quantizedWeights));
+                m_json["accessors"][bufferViewIndex]["componentType"] = 5121;
+                m_json["accessors"][bufferViewIndex]["normalized"] = true;
+            } else {
+                addBufferView(bufferViewIndex, packLittleEndian(weights));
+                m_json["accessors"][bufferViewIndex]["componentType"] = 5126;
+            }
             if (m_enableComment)
                 m_json["accessors"][bufferViewIndex]["__comment"] = QString("/accessors/%1: bone weights %2").arg(QString::number(bufferViewIndex)).arg(weightList.join(" ")).toUtf8().constData();
             m_json["accessors"][bufferViewIndex]["bufferView"] = bufferViewIndex;
             m_json["accessors"][bufferViewIndex]["byteOffset"] = 0;
-            m_json["accessors"][bufferViewIndex]["componentType"] = 5126;
-            m_json["accessors"][bufferViewIndex]["count"] = triangleVertexOldIndices.size();
+            m_json["accessors"][bufferViewIndex]["count"] = exportMesh.sourceVertices.size();
             m_json["accessors"][bufferViewIndex]["type"] = "VEC4";
             bufferViewIndex++;
         }
@@ -373,15 +510,14 @@ GlbFileWriter::GlbFileWriter(Object &object,
             m_json["animations"][animationIndex]["name"] = motion.first.toUtf8().constData();
             
             int input = bufferViewIndex;
-            bufferViewFromOffset = (int)m_binByteArray.size();
-            m_json["bufferViews"][bufferViewIndex]["buffer"] = 0;
-            m_json["bufferViews"][bufferViewIndex]["byteOffset"] = bufferViewFromOffset;
             float minTime = 1000000.0;
             float maxTime = 0.0;
             QStringList timeList;
             float timePoint = 0;
+            std::vector<float> times;
+            times.reserve(motion.second.size());
             for (const auto &keyframe: motion.second) {
-                binStream << (float)timePoint;
+                times.push_back(timePoint);
                 if (timePoint < minTime)
                     minTime = timePoint;
                 if (timePoint > maxTime)
@@ -390,8 +526,7 @@ GlbFileWriter::GlbFileWriter(Object &object,
                     timeList.append(QString::number(timePoint));
                 timePoint += keyframe.first;
             }
-            m_json["bufferViews"][bufferViewIndex]["byteLength"] = m_binByteArray.size() - bufferViewFromOffset;
-            alignBin();
+            addBufferView(bufferViewIndex, packLittleEndian(times));
             if (m_enableComment)
                 m_json["accessors"][bufferViewIndex]["__comment"] = QString("/accessors/%1: times %2").arg(QString::number(bufferViewIndex)).arg(timeList.join(" ")).toUtf8().constData();
             m_json["accessors"][bufferViewIndex]["bufferView"] = bufferViewIndex;
@@ -422,10 +557,9 @@ GlbFileWriter::GlbFileWriter(Object &object,
             
             for (const auto &jointIndex: rotatedJoints) {
                 int output = bufferViewIndex;
-                bufferViewFromOffset = (int)m_binByteArray.size();
-                m_json["bufferViews"][bufferViewIndex]["buffer"] = 0;
-                m_json["bufferViews"][bufferViewIndex]["byteOffset"] = bufferViewFromOffset;
                 QStringList rotationList;
+                std::vector<float> rotations;
+                rotations.reserve(motion.second.size() * 4);
                 for (int frame = 0; frame < (int)motion.second.size(); frame++) {
                     const auto &keyframe = motion.second[frame];
                     const auto &rotation = keyframe.second.nodes()[jointIndex].rotation;
@@ -433,12 +567,14 @@ GlbFileWriter::GlbFileWriter(Object &object,
                     float y = rotation.y();
                     float z = rotation.z();
                     float w = rotation.scalar();
-                    binStream << (float)x << (float)y << (float)z << (float)w;
+                    rotations.push_back(x);
+                    rotations.push_back(y);
+                    rotations.push_back(z);
+                    rotations.push_back(w);
                     if (m_enableComment)
                         rotationList.append(QString("%1:<%2,%3,%4,%5>").arg(QString::number(frame)).arg(QString::number(x)).arg(QString::number(y)).arg(QString::number(z)).arg(QString::number(w)));
                 }
-                m_json["bufferViews"][bufferViewIndex]["byteLength"] = m_binByteArray.size() - bufferViewFromOffset;
-                alignBin();
+                addBufferView(bufferViewIndex, packLittleEndian(rotations));
                 if (m_enableComment)
                     m_json["accessors"][bufferViewIndex]["__comment"] = QString("/accessors/%1: rotation %2").arg(QString::number(bufferViewIndex)).arg(rotationList.join(" ")).toUtf8().constData();
                 m_json["accessors"][bufferViewIndex]["bufferView"] = bufferViewIndex;
@@ -447,7 +583,7 @@ GlbFileWriter::GlbFileWriter(Object &object,
                 m_json["accessors"][bufferViewIndex]["count"] =  motion.second.size();
                 m_json["accessors"][bufferViewIndex]["type"] = "VEC4";
                 bufferViewIndex++;
-
+                
                 m_json["animations"][animationIndex]["samplers"][sampler]["input"] = input;
                 m_json["animations"][animationIndex]["samplers"][sampler]["interpolation"] = "LINEAR";
                 m_json["animations"][animationIndex]["samplers"][sampler]["output"] = output;
@@ -461,16 +597,16 @@ GlbFileWriter::GlbFileWriter(Object &object,
                 
                 for (const auto &jointIndex: translatedJoints) {
                     int output = bufferViewIndex;
-                    bufferViewFromOffset = (int)m_binByteArray.size();
-                    m_json["bufferViews"][bufferViewIndex]["buffer"] = 0;
-                    m_json["bufferViews"][bufferViewIndex]["byteOffset"] = bufferViewFromOffset;
+                    std::vector<float> translations;
+                    translations.reserve(motion.second.size() * 3);
                     for (int frame = 0; frame < (int)motion.second.size(); frame++) {
                         const auto &keyframe = motion.second[frame];
                         const auto &translation = keyframe.second.nodes()[jointIndex].translation;
-                        binStream << (float)translation.x() << (float)translation.y() << (float)translation.z();
+                        translations.push_back(translation.x());
+                        translations.push_back(translation.y());
+                        translations.push_back(translation.z());
                     }
-                    m_json["bufferViews"][bufferViewIndex]["byteLength"] = m_binByteArray.size() - bufferViewFromOffset;
-                    alignBin();
+                    addBufferView(bufferViewIndex, packLittleEndian(translations));
                     if (m_enableComment)
                         m_json["accessors"][bufferViewIndex]["__comment"] = QString("/accessors/%1: translation").arg(QString::number(bufferViewIndex)).toUtf8().constData();
                     m_json["accessors"][bufferViewIndex]["bufferView"] = bufferViewIndex;
@@ -479,7 +615,7 @@ GlbFileWriter::GlbFileWriter(Object &object,
                     m_json["accessors"][bufferViewIndex]["count"] =  motion.second.size();
                     m_json["accessors"][bufferViewIndex]["type"] = "VEC3";
                     bufferViewIndex++;
-
+                    
                     m_json["animations"][animationIndex]["samplers"][sampler]["input"] = input;
                     m_json["animations"][animationIndex]["samplers"][sampler]["interpolation"] = "LINEAR";
                     m_json["animations"][animationIndex]["samplers"][sampler]["output"] = output;
@@ -503,75 +639,71 @@ GlbFileWriter::GlbFileWriter(Object &object,
     int imageIndex = 0;
     int textureIndex = 0;
     
+    std::vector<const QImage *> textureImages;
+    for (const QImage *image: {textureImage, normalImage, ormImage}) {
+        if (nullptr != image)
+            textureImages.push_back(image);
+    }
+    std::vector<QByteArray> pngByteArrays(textureImages.size());
+    std::vector<QByteArray> ddsByteArrays(textureImages.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, textureImages.size()),
+        TextureEncoder(&textureImages, &pngByteArrays,
+            m_enableCompressedTextures ? &ddsByteArrays : nullptr));
+    
     // Images should be put in the end of the buffer, because we are not using accessors
-    if (nullptr != textureImage) {
+    bool hasDdsImage = false;
+    for (size_t i = 0; i < textureImages.size(); ++i) {
         m_json["textures"][textureIndex]["sampler"] = 0;
         m_json["textures"][textureIndex]["source"] = imageIndex;
-    
-        bufferViewFromOffset = (int)m_binByteArray.size();
-        m_json["bufferViews"][bufferViewIndex]["buffer"] = 0;
-        m_json["bufferViews"][bufferViewIndex]["byteOffset"] = bufferViewFromOffset;
-        QByteArray pngByteArray;
-        QBuffer buffer(&pngByteArray);
-        textureImage->save(&buffer, "PNG");
-        binStream.writeRawData(pngByteArray.data(), pngByteArray.size());
-        alignBin();
-        m_json["bufferViews"][bufferViewIndex]["byteLength"] = m_binByteArray.size() - bufferViewFromOffset;
-        m_json["images"][imageIndex]["bufferView"] = bufferViewIndex;
-        m_json["images"][imageIndex]["mimeType"] = "image/png";
-        bufferViewIndex++;
         
-        imageIndex++;
-        textureIndex++;
-    }
-    if (nullptr != normalImage) {
-        m_json["textures"][textureIndex]["sampler"] = 0;
-        m_json["textures"][textureIndex]["source"] = imageIndex;
-    
-        bufferViewFromOffset = (int)m_binByteArray.size();
-        m_json["bufferViews"][bufferViewIndex]["buffer"] = 0;
-        m_json["bufferViews"][bufferViewIndex]["byteOffset"] = bufferViewFromOffset;
-        QByteArray pngByteArray;
-        QBuffer buffer(&pngByteArray);
-        normalImage->save(&buffer, "PNG");
-        binStream.writeRawData(pngByteArray.data(), pngByteArray.size());
-        alignBin();
-        m_json["bufferViews"][bufferViewIndex]["byteLength"] = m_binByteArray.size() - bufferViewFromOffset;
+        addBufferView(bufferViewIndex, pngByteArrays[i]);
         m_json["images"][imageIndex]["bufferView"] = bufferViewIndex;
         m_json["images"][imageIndex]["mimeType"] = "image/png";
         bufferViewIndex++;
-        
         imageIndex++;
-        textureIndex++;
-    }
-    if (nullptr != ormImage) {
-        m_json["textures"][textureIndex]["sampler"] = 0;
-        m_json["textures"][textureIndex]["source"] = imageIndex;
-    
-        bufferViewFromOffset = (int)m_binByteArray.size();
-        m_json["bufferViews"][bufferViewIndex]["buffer"] = 0;
-        m_json["bufferViews"][bufferViewIndex]["byteOffset"] = bufferViewFromOffset;
-        QByteArray pngByteArray;
-        QBuffer buffer(&pngByteArray);
-        ormImage->save(&buffer, "PNG");
-        binStream.writeRawData(pngByteArray.data(), pngByteArray.size());
-        alignBin();
-        m_json["bufferViews"][bufferViewIndex]["byteLength"] = m_binByteArray.size() - bufferViewFromOffset;
-        m_json["images"][imageIndex]["bufferView"] = bufferViewIndex;
-        m_json["images"][imageIndex]["mimeType"] = "image/png";
-        bufferViewIndex++;
         
-        imageIndex++;
+        if (!ddsByteArrays[i].isEmpty()) {
+            // The PNG stays as fallback source for loaders without MSFT_texture_dds
+            m_json["textures"][textureIndex]["extensions"]["MSFT_texture_dds"]["source"] = imageIndex;
+            
+            addBufferView(bufferViewIndex, ddsByteArrays[i]);
+            m_json["images"][imageIndex]["bufferView"] = bufferViewIndex;
+            m_json["images"][imageIndex]["mimeType"] = "image/vnd-ms.dds";
+            bufferViewIndex++;
+            imageIndex++;
+            
+            hasDdsImage = true;
+        }
+        
         textureIndex++;
     }
+    if (hasDdsImage)
+        m_json["extensionsUsed"].push_back("MSFT_texture_dds");
+    if (hasQuantizedAttribute) {
+        m_json["extensionsUsed"].push_back("KHR_mesh_quantization");
+        m_json["extensionsRequired"].push_back("KHR_mesh_quantization");
+    }
     
-    m_json["buffers"][0]["byteLength"] = m_binByteArray.size();
+    m_json["buffers"][0]["byteLength"] = m_binByteLength;
     
     auto jsonString = m_enableComment ? m_json.dump(4) : m_json.dump();
     jsonStream.writeRawData(jsonString.data(), jsonString.size());
     alignJson();
 }
 
+void GlbFileWriter::addBufferView(int bufferViewIndex, const QByteArray &data, int target, int byteStride)
+{
+    m_json["bufferViews"][bufferViewIndex]["buffer"] = 0;
+    m_json["bufferViews"][bufferViewIndex]["byteOffset"] = m_binByteLength;
+    m_json["bufferViews"][bufferViewIndex]["byteLength"] = data.size();
+    if (0 != byteStride)
+        m_json["bufferViews"][bufferViewIndex]["byteStride"] = byteStride;
+    if (0 != target)
+        m_json["bufferViews"][bufferViewIndex]["target"] = target;
+    m_binDatas.push_back(data);
+    m_binByteLength += (data.size() + 3) / 4 * 4;
+}
+
 bool GlbFileWriter::save()
 {
     QFile file(m_filename);
@@ -587,10 +719,10 @@ bool GlbFileWriter::save()
     uint32_t chunk1DescriptionSize = 8;
     uint32_t fileSize = headerSize +
         chunk0DescriptionSize + m_jsonByteArray.size() +
-        chunk1DescriptionSize + m_binByteArray.size();
+        chunk1DescriptionSize + m_binByteLength;
     
     qDebug() << "Chunk 0 data size:" << m_jsonByteArray.size();
-    qDebug() << "Chunk 1 data size:" << m_binByteArray.size();
+    qDebug() << "Chunk 1 data size:" << m_binByteLength;
     qDebug() << "File size:" << fileSize;
     
     //////////// Header ////////////
@@ -618,13 +750,18 @@ bool GlbFileWriter::save()
     //////////// Chunk 1 (Binary Buffer) ///
     
     // length
-    output << (uint32_t)m_binByteArray.size();
+    output << (uint32_t)m_binByteLength;
     
     // type
     output << (uint32_t)0x004E4942;
     
-    // data
-    output.writeRawData(m_binByteArray.data(), m_binByteArray.size());
+    // data, each buffer view padded to four bytes as laid out in the json
+    const char padding[4] = {0, 0, 0, 0};
+    for (const auto &data: m_binDatas) {
+        output.writeRawData(data.constData(), data.size());
+        if (0 != data.size() % 4)
+            output.writeRawData(padding, 4 - data.size() % 4);
+    }
     
     return true;
 }
@@ -17,7 +17,7 @@ class GlbFileWriter : public QObject
 public:
     GlbFileWriter(Object &object,
         const std::vector<RigBone> *resultRigBones,
-        const std::map<int, RigVertexWeights> *resultRigWeights,
+        const RigWeights *resultRigWeights,
         const QString &filename,
         QImage *textureImage=nullptr,
         QImage *normalImage=nullptr,
@@ -29,12 +29,19 @@ private:
     bool m_outputNormal = true;
     bool m_outputAnimation = true;
     bool m_outputUv = true;
-    QByteArray m_binByteArray;
+    // The packed buffer views stay in memory until save(), the json chunk goes before them in the file
+    std::vector<QByteArray> m_binDatas;
+    int m_binByteLength = 0;
     QByteArray m_jsonByteArray;
 private:
     nlohmann::json m_json;
+    void addBufferView(int bufferViewIndex, const QByteArray &data, int target=0, int byteStride=0);
 public:
     static bool m_enableComment;
+    // Also embed DXT5 DDS copies of the textures through MSFT_texture_dds
+    static bool m_enableCompressedTextures;
+    // Store mesh attributes as integers through KHR_mesh_quantization
+    static bool m_enableQuantization;
 };
 
 #endif
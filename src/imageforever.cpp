@@ -13,22 +13,47 @@ struct ImageForeverItem
 static std::map<QUuid, ImageForeverItem> g_foreverMap;
 static QMutex g_mapMutex;
 
-const QImage *ImageForever::get(const QUuid &id)
+// Images added from encoded data are decoded on first request,
+// the decoding happens outside of the lock so other lookups are not held up
+static const QImage *decodedImage(const QUuid &id)
 {
+    // A shallow copy taken under the lock, the entry may be removed while decoding
+    QByteArray imageByteArray;
+    {
+        QMutexLocker locker(&g_mapMutex);
+        auto findResult = g_foreverMap.find(id);
+        if (findResult == g_foreverMap.end())
+            return nullptr;
+        if (nullptr != findResult->second.image)
+            return findResult->second.image;
+        imageByteArray = *findResult->second.imageByteArray;
+    }
+    QImage *image = new QImage(QImage::fromData(imageByteArray));
     QMutexLocker locker(&g_mapMutex);
     auto findResult = g_foreverMap.find(id);
-    if (findResult == g_foreverMap.end())
+    if (findResult == g_foreverMap.end()) {
+        delete image;
         return nullptr;
-    return findResult->second.image;
+    }
+    if (nullptr != findResult->second.image) {
+        delete image;
+        return findResult->second.image;
+    }
+    findResult->second.image = image;
+    return image;
+}
+
+const QImage *ImageForever::get(const QUuid &id)
+{
+    return decodedImage(id);
 }
 
 void ImageForever::copy(const QUuid &id, QImage &image)
 {
-    QMutexLocker locker(&g_mapMutex);
-    auto findResult = g_foreverMap.find(id);
-    if (findResult == g_foreverMap.end())
+    const QImage *foreverImage = decodedImage(id);
+    if (nullptr == foreverImage)
         return;
-    image = *findResult->second.image;
+    image = *foreverImage;
 }
 
 const QByteArray *ImageForever::getPngByteArray(const QUuid &id)
@@ -57,6 +82,19 @@ QUuid ImageForever::add(const QImage *image, QUuid toId)
     return newId;
 }
 
+QUuid ImageForever::addEncoded(const QByteArray &imageByteArray, QUuid toId)
+{
+    QMutexLocker locker(&g_mapMutex);
+    if (imageByteArray.isEmpty())
+        return QUuid();
+    QUuid newId = toId.isNull() ? QUuid::createUuid() : toId;
+    if (g_foreverMap.find(newId) != g_foreverMap.end())
+        return newId;
+    // Deep copy, the source may be a view into a mapped file
+    g_foreverMap[newId] = {nullptr, newId, new QByteArray(imageByteArray.constData(), imageByteArray.size())};
+    return newId;
+}
+
 void ImageForever::remove(const QUuid &id)
 {
     QMutexLocker locker(&g_mapMutex);
@@ -11,6 +11,7 @@ public:
     static void copy(const QUuid &id, QImage &image);
     static const QByteArray *getPngByteArray(const QUuid &id);
     static QUuid add(const QImage *image, QUuid toId=QUuid());
+    static QUuid addEncoded(const QByteArray &imageByteArray, QUuid toId=QUuid());
     static void remove(const QUuid &id);
 };
 
@@ -0,0 +1,112 @@
+#include <QCoreApplication>
+#include <algorithm>
+#include "jobscheduler.h"
+
+JobScheduler &JobScheduler::instance()
+{
+    static JobScheduler *s_jobScheduler = nullptr;
+    if (nullptr == s_jobScheduler) {
+        s_jobScheduler = new JobScheduler;
+    }
+    return *s_jobScheduler;
+}
+
+JobScheduler::JobScheduler()
+{
+    // The workers mostly wait on tbb, the pool only needs to be big enough to not hold jobs back
+    size_t threadCount = (size_t)std::max(4, QThread::idealThreadCount());
+    for (size_t i = 0; i < threadCount; ++i) {
+        QThread *thread = new QThread;
+        thread->start();
+        m_threads.push_back(thread);
+        m_idleThreads.push_back(thread);
+    }
+    if (nullptr != QCoreApplication::instance())
+        connect(QCoreApplication::instance(), &QCoreApplication::aboutToQuit, this, &JobScheduler::stop);
+}
+
+JobScheduler::~JobScheduler()
+{
+    stop();
+    for (auto &it: m_jobs)
+        delete it.second;
+}
+
+void JobScheduler::stop()
+{
+    for (auto &thread: m_threads) {
+        thread->quit();
+        thread->wait();
+        delete thread;
+    }
+    m_threads.clear();
+    m_idleThreads.clear();
+}
+
+void JobScheduler::enqueue(quint64 jobId)
+{
+    if (Priority::Interactive == m_jobs[jobId]->priority)
+        m_interactiveJobs.push_back(jobId);
+    else
+        m_backgroundJobs.push_back(jobId);
+    startQueuedJobs();
+}
+
+bool JobScheduler::takeQueuedJob(std::deque<quint64> &queue, Job **job)
+{
+    while (!queue.empty()) {
+        quint64 jobId = queue.front();
+        queue.pop_front();
+        auto findJob = m_jobs.find(jobId);
+        if (findJob == m_jobs.end())
+            continue;
+        // The worker was deleted before its turn came
+        if (findJob->second->worker.isNull()) {
+            delete findJob->second;
+            m_jobs.erase(findJob);
+            continue;
+        }
+        *job = findJob->second;
+        return true;
+    }
+    return false;
+}
+
+void JobScheduler::startQueuedJobs()
+{
+    Job *job = nullptr;
+    while (!m_idleThreads.empty() && takeQueuedJob(m_interactiveJobs, &job)) {
+        QThread *thread = m_idleThreads.back();
+        m_idleThreads.pop_back();
+        start(job, thread);
+    }
+    while (m_idleThreads.size() > m_reservedInteractiveThreads && takeQueuedJob(m_backgroundJobs, &job)) {
+        QThread *thread = m_idleThreads.back();
+        m_idleThreads.pop_back();
+        start(job, thread);
+    }
+}
+
+void JobScheduler::start(Job *job, QThread *thread)
+{
+    job->thread = thread;
+    thread->setPriority(Priority::Interactive == job->priority ?
+        QThread::NormalPriority : QThread::LowPriority);
+    job->worker->moveToThread(thread);
+    QMetaObject::invokeMethod(job->worker, "process", Qt::QueuedConnection);
+}
+
+void JobScheduler::jobFinished(quint64 jobId)
+{
+    // Both finished and destroyed end up here, only the first one reclaims the thread
+    auto findJob = m_jobs.find(jobId);
+    if (findJob == m_jobs.end())
+        return;
+    Job *job = findJob->second;
+    m_jobs.erase(findJob);
+    if (nullptr != job->thread &&
+            std::find(m_threads.begin(), m_threads.end(), job->thread) != m_threads.end())
+        m_idleThreads.push_back(job->thread);
+    delete job;
+    startQueuedJobs();
+}
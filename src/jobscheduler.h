@@ -0,0 +1,72 @@
+#ifndef DUST3D_JOB_SCHEDULER_H
+#define DUST3D_JOB_SCHEDULER_H
+#include <QObject>
+#include <QThread>
+#include <QPointer>
+#include <vector>
+#include <deque>
+#include <map>
+
+// Runs the background workers of the documents on a pool of threads which are kept alive,
+// a worker is any QObject with a process() slot and a finished() signal.
+// Jobs only have a priority, the order between the stages and the coalescing of obsolete
+// requests are left to the document, which keeps at most one run of a stage in flight
+class JobScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    enum class Priority
+    {
+        Interactive = 0,
+        Background
+    };
+    
+    static JobScheduler &instance();
+    JobScheduler();
+    ~JobScheduler();
+    
+    template <class T>
+    void schedule(T *worker, Priority priority=Priority::Background)
+    {
+        quint64 jobId = m_nextJobId++;
+        Job *job = new Job;
+        job->worker = worker;
+        job->priority = priority;
+        m_jobs[jobId] = job;
+        connect(worker, &T::finished, this, [=]() {
+            jobFinished(jobId);
+        });
+        // A worker deleted without finishing would otherwise hold its thread forever
+        connect(worker, &QObject::destroyed, this, [=]() {
+            jobFinished(jobId);
+        });
+        enqueue(jobId);
+    }
+    
+    void stop();
+private:
+    struct Job
+    {
+        QPointer<QObject> worker;
+        Priority priority = Priority::Background;
+        QThread *thread = nullptr;
+    };
+    
+    void enqueue(quint64 jobId);
+    void jobFinished(quint64 jobId);
+    void startQueuedJobs();
+    bool takeQueuedJob(std::deque<quint64> &queue, Job **job);
+    void start(Job *job, QThread *thread);
+    
+    std::vector<QThread *> m_threads;
+    std::vector<QThread *> m_idleThreads;
+    std::map<quint64, Job *> m_jobs;
+    std::deque<quint64> m_interactiveJobs;
+    std::deque<quint64> m_backgroundJobs;
+    quint64 m_nextJobId = 0;
+    
+    // Background jobs leave these threads free, so interactive ones never wait behind them
+    static const size_t m_reservedInteractiveThreads = 1;
+};
+
+#endif
@@ -12,6 +12,8 @@
 #include "theme.h"
 #include "version.h"
 #include "document.h"
+#include "profiler.h"
+#include "glbfile.h"
 
 int main(int argc, char ** argv)
 {
@@ -67,6 +69,8 @@ int main(int argc, char ** argv)
     
     QStringList openFileList;
     QStringList waitingExportList;
+    QString profileTraceFilename;
+    int fbxCompressionLevel = -1;
     
     struct RenderOptions
     {
@@ -85,6 +89,26 @@ int main(int argc, char ** argv)
                 if (i < argc)
                     waitingExportList.append(argv[i]);
                 continue;
+            } else if (0 == strcmp(argv[i], "-profile")) {
+                ++i;
+                if (i < argc)
+                    profileTraceFilename = argv[i];
+                continue;
+            } else if (0 == strcmp(argv[i], "-ddstexture")) {
+                ++i;
+                if (i < argc)
+                    GlbFileWriter::m_enableCompressedTextures = isTrueValueString(QString(argv[i]));
+                continue;
+            } else if (0 == strcmp(argv[i], "-quantize")) {
+                ++i;
+                if (i < argc)
+                    GlbFileWriter::m_enableQuantization = isTrueValueString(QString(argv[i]));
+                continue;
+            } else if (0 == strcmp(argv[i], "-fbxcompression")) {
+                ++i;
+                if (i < argc)
+                    fbxCompressionLevel = qBound(0, QString(argv[i]).toInt(), 9);
+                continue;
             } else if (0 == strcmp(argv[i], "-wireframe")) {
                 ++i;
                 if (i < argc)
@@ -121,6 +145,9 @@ int main(int argc, char ** argv)
         }
     }
     
+    if (!profileTraceFilename.isEmpty())
+        Profiler::setEnabled(true);
+    
     int finishedExportFileNum = 0;
     int totalExportFileNum = 0;
     int succeedExportNum = 0;
@@ -148,6 +175,11 @@ int main(int argc, char ** argv)
                     if (isSuccessful)
                         ++succeedExportNum;
                     if (finishedExportFileNum == totalExportFileNum) {
+                        if (!profileTraceFilename.isEmpty()) {
+                            if (!Profiler::saveTrace(profileTraceFilename))
+                                qDebug() << "Save profile trace failed:" << profileTraceFilename;
+                            qDebug().noquote() << Profiler::summary();
+                        }
                         if (succeedExportNum == totalExportFileNum) {
                             app.exit();
                             return;
@@ -160,6 +192,8 @@ int main(int argc, char ** argv)
             for (int i = 0; i < openFileList.size(); ++i) {
                 QObject::connect(windowList[i]->document(), &Document::exportReady, windowList[i], &DocumentWindow::checkExportWaitingList);
                 windowList[i]->setExportWaitingList(waitingExportList);
+                if (fbxCompressionLevel >= 0)
+                    windowList[i]->setFbxCompressionLevel(fbxCompressionLevel);
             }
         }
         for (int i = 0; i < openFileList.size(); ++i) {
@@ -45,8 +45,7 @@ void MaterialPreviewsGenerator::generate()
     for (int i = 0; i < ds3Reader.items().size(); ++i) {
         Ds3ReaderItem item = ds3Reader.items().at(i);
         if (item.type == "model") {
-            QByteArray data;
-            ds3Reader.loadItem(item.name, &data);
+            QByteArray data = ds3Reader.itemData(item.name);
             QXmlStreamReader stream(data);
             loadSkeletonFromXmlStream(snapshot, stream);
             for (const auto &item: snapshot->parts) {
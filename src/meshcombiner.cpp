@@ -1,49 +1,125 @@
 #include <CGAL/Polygon_mesh_processing/corefinement.h>
 #include <CGAL/Polygon_mesh_processing/repair.h>
 #include <CGAL/Polygon_mesh_processing/triangulate_faces.h>
+#include <CGAL/Polygon_mesh_processing/bbox.h>
+#include <CGAL/boost/graph/helpers.h>
 #include <QDebug>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QAtomicInt>
 #include <map>
+#include <unordered_map>
 #include "meshcombiner.h"
 #include "positionkey.h"
 #include "booleanmesh.h"
 #include "util.h"
+#include "profiler.h"
+extern "C" {
+#include <crc64.h>
+}
 
 typedef CGAL::Exact_predicates_inexact_constructions_kernel CgalKernel;
 typedef CGAL::Surface_mesh<CgalKernel::Point_3> CgalMesh;
+typedef CgalMesh::Property_map<CgalMesh::Edge_index, bool> CgalEdgeFlags;
+
+#define MAX_CACHED_VALIDATIONS              4096
+#define PARALLEL_SELF_INTERSECTION_FACES    5000
+#define LOCALIZED_COMBINE_MARGIN            0.05
+
+// Parts which haven't changed produce the same geometry on every generation,
+// so the validation verdict is remembered by geometry hash
+static QMutex g_validationCacheMutex;
+static std::unordered_map<quint64, bool> g_validationCache;
+
+static quint64 hashGeometry(const std::vector<QVector3D> &vertices, const std::vector<std::vector<size_t>> &faces)
+{
+    uint64_t hash = 0;
+    for (const auto &vertex: vertices) {
+        float position[3] = {vertex.x(), vertex.y(), vertex.z()};
+        hash = crc64(hash, (const unsigned char *)position, sizeof(position));
+    }
+    for (const auto &face: faces) {
+        uint64_t faceSize = face.size();
+        hash = crc64(hash, (const unsigned char *)&faceSize, sizeof(faceSize));
+        hash = crc64(hash, (const unsigned char *)face.data(), face.size() * sizeof(size_t));
+    }
+    return hash;
+}
+
+static bool findCachedValidation(quint64 geometryHash, bool *isCombinable)
+{
+    QMutexLocker locker(&g_validationCacheMutex);
+    auto findResult = g_validationCache.find(geometryHash);
+    if (findResult == g_validationCache.end())
+        return false;
+    *isCombinable = findResult->second;
+    return true;
+}
+
+static void cacheValidation(quint64 geometryHash, bool isCombinable)
+{
+    QMutexLocker locker(&g_validationCacheMutex);
+    if (g_validationCache.size() >= MAX_CACHED_VALIDATIONS)
+        g_validationCache.clear();
+    g_validationCache[geometryHash] = isCombinable;
+}
+
+static bool doesSelfIntersect(const CgalMesh &cgalMesh)
+{
+    if (cgalMesh.number_of_faces() >= PARALLEL_SELF_INTERSECTION_FACES)
+        return CGAL::Polygon_mesh_processing::does_self_intersect<CGAL::Parallel_if_available_tag>(cgalMesh);
+    return CGAL::Polygon_mesh_processing::does_self_intersect(cgalMesh);
+}
+
+static bool validateCgalMesh(CgalMesh *cgalMesh)
+{
+    if (!CGAL::is_valid_polygon_mesh(*cgalMesh)) {
+        qDebug() << "Mesh is not valid polygon";
+        return false;
+    }
+    if (!CGAL::Polygon_mesh_processing::triangulate_faces(*cgalMesh)) {
+        qDebug() << "Mesh triangulate failed";
+        return false;
+    }
+    if (doesSelfIntersect(*cgalMesh)) {
+        qDebug() << "Mesh does_self_intersect";
+        return false;
+    }
+    std::vector<QVector3D> fetchedVertices;
+    std::vector<std::vector<size_t>> fetchedFaces;
+    fetchFromCgalMesh<CgalKernel>(cgalMesh, fetchedVertices, fetchedFaces);
+    if (!isManifold(fetchedFaces)) {
+        qDebug() << "Mesh does not self intersect but is not manifold";
+        return false;
+    }
+    return true;
+}
 
 MeshCombiner::Mesh::Mesh(const std::vector<QVector3D> &vertices, const std::vector<std::vector<size_t>> &faces, bool disableSelfIntersects)
 {
     CgalMesh *cgalMesh = nullptr;
     if (!faces.empty()) {
-        cgalMesh = buildCgalMesh<CgalKernel>(vertices, faces);
-        if (!disableSelfIntersects) {
-            if (!CGAL::is_valid_polygon_mesh(*cgalMesh)) {
-                qDebug() << "Mesh is not valid polygon";
-                delete cgalMesh;
-                cgalMesh = nullptr;
+        if (disableSelfIntersects) {
+            cgalMesh = buildCgalMesh<CgalKernel>(vertices, faces);
+        } else {
+            ProfileScope profileScope("meshValidation");
+            quint64 geometryHash = hashGeometry(vertices, faces);
+            bool isCombinable = false;
+            if (findCachedValidation(geometryHash, &isCombinable)) {
+                if (isCombinable) {
+                    cgalMesh = buildCgalMesh<CgalKernel>(vertices, faces);
+                    CGAL::Polygon_mesh_processing::triangulate_faces(*cgalMesh);
+                    m_isCombinable = true;
+                }
             } else {
-                if (CGAL::Polygon_mesh_processing::triangulate_faces(*cgalMesh)) {
-                    if (CGAL::Polygon_mesh_processing::does_self_intersect(*cgalMesh)) {
-                        qDebug() << "Mesh does_self_intersect";
-                        delete cgalMesh;
-                        cgalMesh = nullptr;
-                    } else {
-						std::vector<QVector3D> fetchedVertices;
-						std::vector<std::vector<size_t>> fetchedFaces;
-						fetchFromCgalMesh<CgalKernel>(cgalMesh, fetchedVertices, fetchedFaces);
-						if (!isManifold(fetchedFaces)) {
-							qDebug() << "Mesh does not self intersect but is not manifold";
-							delete cgalMesh;
-							cgalMesh = nullptr;
-						} else {
-							m_isCombinable = true;
-						}
-                    }
+                cgalMesh = buildCgalMesh<CgalKernel>(vertices, faces);
+                if (validateCgalMesh(cgalMesh)) {
+                    m_isCombinable = true;
                 } else {
-                    qDebug() << "Mesh triangulate failed";
                     delete cgalMesh;
                     cgalMesh = nullptr;
                 }
+                cacheValidation(geometryHash, m_isCombinable);
             }
         }
     }
@@ -85,6 +161,250 @@ bool MeshCombiner::Mesh::isCombinable() const
     return m_isCombinable;
 }
 
+static QAtomicInt g_separatedCombines;
+static QAtomicInt g_localizedCombines;
+
+// Copies the faces touching the region into the patch,
+// the rest of the mesh is certainly away from the other operand
+static bool extractPatch(const CgalMesh &mesh, const CGAL::Bbox_3 &region,
+    CgalMesh *patch, std::vector<bool> *faceInPatch, std::vector<bool> *vertexInPatch)
+{
+    faceInPatch->assign(mesh.num_faces(), false);
+    vertexInPatch->assign(mesh.num_vertices(), false);
+    std::vector<CgalMesh::Vertex_index> patchVertices(vertexInPatch->size());
+    for (const auto &face: mesh.faces()) {
+        CGAL::Bbox_3 faceBox;
+        for (const auto &vertex: CGAL::vertices_around_face(mesh.halfedge(face), mesh))
+            faceBox += mesh.point(vertex).bbox();
+        if (!CGAL::do_overlap(faceBox, region))
+            continue;
+        (*faceInPatch)[face] = true;
+        std::vector<CgalMesh::Vertex_index> faceVertices;
+        for (const auto &vertex: CGAL::vertices_around_face(mesh.halfedge(face), mesh)) {
+            if (!(*vertexInPatch)[vertex]) {
+                (*vertexInPatch)[vertex] = true;
+                patchVertices[vertex] = patch->add_vertex(mesh.point(vertex));
+            }
+            faceVertices.push_back(patchVertices[vertex]);
+        }
+        if (CgalMesh::null_face() == patch->add_face(faceVertices))
+            return false;
+    }
+    return true;
+}
+
+static void collectIntersectionVertices(const CgalMesh &patch, const CgalEdgeFlags &intersectionEdges,
+    std::map<CgalKernel::Point_3, CgalMesh::Vertex_index> *intersectionVertices)
+{
+    for (const auto &edge: patch.edges()) {
+        if (!intersectionEdges[edge])
+            continue;
+        for (int i = 0; i < 2; ++i) {
+            auto vertex = patch.vertex(edge, i);
+            intersectionVertices->insert({patch.point(vertex), vertex});
+        }
+    }
+}
+
+// Tells whether the face on the halfedge starts into the other operand, judged by the two faces
+// the other operand has around the same intersection edge; returns -1 when it can't be decided
+static int isHalfedgeFaceInside(const CgalMesh &mesh, CgalMesh::Halfedge_index halfedge,
+    const CgalMesh &other, const std::map<CgalKernel::Point_3, CgalMesh::Vertex_index> &otherVertices)
+{
+    const auto &source = mesh.point(mesh.source(halfedge));
+    const auto &target = mesh.point(mesh.target(halfedge));
+    const auto &apex = mesh.point(mesh.target(mesh.next(halfedge)));
+    auto findSource = otherVertices.find(source);
+    auto findTarget = otherVertices.find(target);
+    if (findSource == otherVertices.end() || findTarget == otherVertices.end())
+        return -1;
+    auto otherHalfedge = other.halfedge(findSource->second, findTarget->second);
+    if (otherHalfedge == CgalMesh::null_halfedge() ||
+            other.is_border(otherHalfedge) || other.is_border(other.opposite(otherHalfedge)))
+        return -1;
+    const auto &firstApex = other.point(other.target(other.next(otherHalfedge)));
+    const auto &secondApex = other.point(other.target(other.next(other.opposite(otherHalfedge))));
+    auto firstSide = CGAL::orientation(source, target, firstApex, apex);
+    auto secondSide = CGAL::orientation(target, source, secondApex, apex);
+    if (CGAL::COPLANAR == firstSide || CGAL::COPLANAR == secondSide)
+        return -1;
+    if (CGAL::NEGATIVE == CGAL::orientation(source, target, firstApex, secondApex))
+        return (CGAL::NEGATIVE == firstSide && CGAL::NEGATIVE == secondSide) ? 1 : 0;
+    return (CGAL::NEGATIVE == firstSide || CGAL::NEGATIVE == secondSide) ? 1 : 0;
+}
+
+// Splits the corefined patch along the intersection edges and tells each piece inside or outside of the other operand;
+// pieces reaching the patch border lie outside, the others are judged at one of their intersection edges
+static bool classifyPatchComponents(const CgalMesh &patch, const CgalEdgeFlags &intersectionEdges,
+    const CgalMesh &other, const std::map<CgalKernel::Point_3, CgalMesh::Vertex_index> &otherVertices,
+    std::vector<size_t> *faceComponents, std::vector<int> *componentInside)
+{
+    faceComponents->assign(patch.num_faces(), 0);
+    std::vector<bool> visited(faceComponents->size(), false);
+    std::vector<CgalMesh::Face_index> pendingFaces;
+    for (const auto &seed: patch.faces()) {
+        if (visited[seed])
+            continue;
+        size_t component = componentInside->size();
+        int inside = -1;
+        bool touchesBorder = false;
+        visited[seed] = true;
+        pendingFaces.push_back(seed);
+        while (!pendingFaces.empty()) {
+            auto face = pendingFaces.back();
+            pendingFaces.pop_back();
+            (*faceComponents)[face] = component;
+            for (const auto &halfedge: CGAL::halfedges_around_face(patch.halfedge(face), patch)) {
+                auto opposite = patch.opposite(halfedge);
+                if (patch.is_border(opposite)) {
+                    touchesBorder = true;
+                    continue;
+                }
+                if (intersectionEdges[patch.edge(halfedge)]) {
+                    if (-1 == inside)
+                        inside = isHalfedgeFaceInside(patch, halfedge, other, otherVertices);
+                    continue;
+                }
+                auto neighbor = patch.face(opposite);
+                if (visited[neighbor])
+                    continue;
+                visited[neighbor] = true;
+                pendingFaces.push_back(neighbor);
+            }
+        }
+        if (touchesBorder) {
+            if (1 == inside)
+                return false;
+            inside = 0;
+        }
+        if (-1 == inside)
+            return false;
+        componentInside->push_back(inside);
+    }
+    return true;
+}
+
+// Corefines only the faces around the overlap of the operands and stitches the untouched remainders back,
+// so merging a small part into a big body costs as much as the area they meet in;
+// returns nullptr when the region is too large to pay off or the pieces can't be told apart
+static CgalMesh *combineLocally(const CgalMesh &firstCgalMesh, const CGAL::Bbox_3 &firstBox,
+    const CgalMesh &secondCgalMesh, const CGAL::Bbox_3 &secondBox, MeshCombiner::Method method)
+{
+    double margin = 0.0;
+    double regionBounds[6];
+    for (int axis = 0; axis < 3; ++axis) {
+        regionBounds[axis] = std::max(firstBox.min(axis), secondBox.min(axis));
+        regionBounds[axis + 3] = std::min(firstBox.max(axis), secondBox.max(axis));
+        margin = std::max(margin, (regionBounds[axis + 3] - regionBounds[axis]) * LOCALIZED_COMBINE_MARGIN);
+    }
+    CGAL::Bbox_3 region(regionBounds[0] - margin, regionBounds[1] - margin, regionBounds[2] - margin,
+        regionBounds[3] + margin, regionBounds[4] + margin, regionBounds[5] + margin);
+    
+    CgalMesh firstPatch;
+    CgalMesh secondPatch;
+    std::vector<bool> firstFaceInPatch;
+    std::vector<bool> secondFaceInPatch;
+    std::vector<bool> firstVertexInPatch;
+    std::vector<bool> secondVertexInPatch;
+    if (!extractPatch(firstCgalMesh, region, &firstPatch, &firstFaceInPatch, &firstVertexInPatch) ||
+            !extractPatch(secondCgalMesh, region, &secondPatch, &secondFaceInPatch, &secondVertexInPatch))
+        return nullptr;
+    if ((firstPatch.number_of_faces() + secondPatch.number_of_faces()) * 2 >
+            firstCgalMesh.number_of_faces() + secondCgalMesh.number_of_faces())
+        return nullptr;
+    
+    auto firstIntersectionEdges = firstPatch.add_property_map<CgalMesh::Edge_index, bool>("e:intersection", false).first;
+    auto secondIntersectionEdges = secondPatch.add_property_map<CgalMesh::Edge_index, bool>("e:intersection", false).first;
+    try {
+        CGAL::Polygon_mesh_processing::corefine(firstPatch, secondPatch,
+            CGAL::Polygon_mesh_processing::parameters::edge_is_constrained_map(firstIntersectionEdges),
+            CGAL::Polygon_mesh_processing::parameters::edge_is_constrained_map(secondIntersectionEdges));
+    } catch (...) {
+        return nullptr;
+    }
+    
+    std::map<CgalKernel::Point_3, CgalMesh::Vertex_index> firstIntersectionVertices;
+    collectIntersectionVertices(firstPatch, firstIntersectionEdges, &firstIntersectionVertices);
+    std::map<CgalKernel::Point_3, CgalMesh::Vertex_index> secondIntersectionVertices;
+    collectIntersectionVertices(secondPatch, secondIntersectionEdges, &secondIntersectionVertices);
+    
+    std::vector<size_t> firstFaceComponents;
+    std::vector<int> firstComponentInside;
+    if (!classifyPatchComponents(firstPatch, firstIntersectionEdges, secondPatch, secondIntersectionVertices,
+            &firstFaceComponents, &firstComponentInside))
+        return nullptr;
+    std::vector<size_t> secondFaceComponents;
+    std::vector<int> secondComponentInside;
+    if (!classifyPatchComponents(secondPatch, secondIntersectionEdges, firstPatch, firstIntersectionVertices,
+            &secondFaceComponents, &secondComponentInside))
+        return nullptr;
+    
+    // Patch vertices are shared by position: patch borders meet the remainders and the intersection edges meet each other
+    CgalMesh *resultCgalMesh = new CgalMesh;
+    std::map<CgalKernel::Point_3, CgalMesh::Vertex_index> patchVertices;
+    auto resultVertexAt = [&](const CgalKernel::Point_3 &point) {
+        auto insertResult = patchVertices.insert({point, CgalMesh::Vertex_index()});
+        if (insertResult.second)
+            insertResult.first->second = resultCgalMesh->add_vertex(point);
+        return insertResult.first->second;
+    };
+    auto addPatchFaces = [&](const CgalMesh &patch, const std::vector<size_t> &faceComponents,
+            const std::vector<int> &componentInside, int keepInside, bool reverse) {
+        for (const auto &face: patch.faces()) {
+            if (componentInside[faceComponents[face]] != keepInside)
+                continue;
+            std::vector<CgalMesh::Vertex_index> faceVertices;
+            for (const auto &vertex: CGAL::vertices_around_face(patch.halfedge(face), patch))
+                faceVertices.push_back(resultVertexAt(patch.point(vertex)));
+            if (reverse)
+                std::reverse(faceVertices.begin(), faceVertices.end());
+            if (CgalMesh::null_face() == resultCgalMesh->add_face(faceVertices))
+                return false;
+        }
+        return true;
+    };
+    auto addRemainderFaces = [&](const CgalMesh &mesh, const std::vector<bool> &faceInPatch,
+            const std::vector<bool> &vertexInPatch) {
+        std::vector<CgalMesh::Vertex_index> resultVertices(vertexInPatch.size());
+        for (const auto &face: mesh.faces()) {
+            if (faceInPatch[face])
+                continue;
+            std::vector<CgalMesh::Vertex_index> faceVertices;
+            for (const auto &vertex: CGAL::vertices_around_face(mesh.halfedge(face), mesh)) {
+                auto &resultVertex = resultVertices[vertex];
+                if (CgalMesh::null_vertex() == resultVertex) {
+                    resultVertex = vertexInPatch[vertex] ?
+                        resultVertexAt(mesh.point(vertex)) : resultCgalMesh->add_vertex(mesh.point(vertex));
+                }
+                faceVertices.push_back(resultVertex);
+            }
+            if (CgalMesh::null_face() == resultCgalMesh->add_face(faceVertices))
+                return false;
+        }
+        return true;
+    };
+    
+    // The remainder of the first operand is outside of the second one and always stays;
+    // the remainder of the second operand is outside of the first one, so only the union keeps it
+    bool isSuccessful = addPatchFaces(firstPatch, firstFaceComponents, firstComponentInside, 0, false) &&
+        addRemainderFaces(firstCgalMesh, firstFaceInPatch, firstVertexInPatch);
+    if (isSuccessful) {
+        if (MeshCombiner::Method::Union == method) {
+            isSuccessful = addPatchFaces(secondPatch, secondFaceComponents, secondComponentInside, 0, false) &&
+                addRemainderFaces(secondCgalMesh, secondFaceInPatch, secondVertexInPatch);
+        } else {
+            isSuccessful = addPatchFaces(secondPatch, secondFaceComponents, secondComponentInside, 1, true);
+        }
+    }
+    if (!isSuccessful || !CGAL::is_closed(*resultCgalMesh)) {
+        delete resultCgalMesh;
+        return nullptr;
+    }
+    
+    Profiler::addCounter("localizedCombines", ++g_localizedCombines);
+    return resultCgalMesh;
+}
+
 MeshCombiner::Mesh *MeshCombiner::combine(const Mesh &firstMesh, const Mesh &secondMesh, Method method,
     std::vector<std::pair<Source, size_t>> *combinedVerticesComeFrom)
 {
@@ -116,7 +436,20 @@ MeshCombiner::Mesh *MeshCombiner::combine(const Mesh &firstMesh, const Mesh &sec
         addToSourceMap(secondCgalMesh, Source::Second);
     }
     
-    if (Method::Union == method) {
+    // Operands with separated bounding boxes can't touch, the union just places them side by side
+    // and the difference leaves the first one as it is
+    CGAL::Bbox_3 firstBox = CGAL::Polygon_mesh_processing::bbox(*firstCgalMesh);
+    CGAL::Bbox_3 secondBox = CGAL::Polygon_mesh_processing::bbox(*secondCgalMesh);
+    if (!CGAL::do_overlap(firstBox, secondBox)) {
+        resultCgalMesh = new CgalMesh(*firstCgalMesh);
+        if (Method::Union == method)
+            resultCgalMesh->join(*secondCgalMesh);
+        Profiler::addCounter("separatedCombines", ++g_separatedCombines);
+    } else {
+        resultCgalMesh = combineLocally(*firstCgalMesh, firstBox, *secondCgalMesh, secondBox, method);
+    }
+    
+    if (nullptr == resultCgalMesh && Method::Union == method) {
         resultCgalMesh = new CgalMesh;
         try {
             if (!CGAL::Polygon_mesh_processing::corefine_and_compute_union(*firstCgalMesh, *secondCgalMesh, *resultCgalMesh)) {
@@ -127,7 +460,7 @@ MeshCombiner::Mesh *MeshCombiner::combine(const Mesh &firstMesh, const Mesh &sec
             delete resultCgalMesh;
             resultCgalMesh = nullptr;
         }
-    } else if (Method::Diff == method) {
+    } else if (nullptr == resultCgalMesh && Method::Diff == method) {
         resultCgalMesh = new CgalMesh;
         try {
             if (!CGAL::Polygon_mesh_processing::corefine_and_compute_difference(*firstCgalMesh, *secondCgalMesh, *resultCgalMesh)) {
@@ -1,5 +1,6 @@
 #include <QDebug>
 #include <QElapsedTimer>
+#include <QMutexLocker>
 #include <QVector2D>
 #include <QGuiApplication>
 #include <QMatrix4x4>
@@ -22,6 +23,7 @@
 #include "snapshotxml.h"
 #include "fixholes.h"
 #include "modeloffscreenrender.h"
+#include "profiler.h"
 
 MeshGenerator::MeshGenerator(Snapshot *snapshot) :
     m_snapshot(snapshot)
@@ -34,7 +36,10 @@ MeshGenerator::~MeshGenerator()
         delete it.second;
     for (auto &it: m_partPreviewMeshes)
         delete it.second;
+    for (auto &it: m_preparedPartMeshes)
+        delete it.second;
     delete m_resultMesh;
+    delete m_draftMesh;
     delete m_snapshot;
     delete m_object;
     delete m_cutFaceTransforms;
@@ -63,6 +68,14 @@ Model *MeshGenerator::takeResultMesh()
     return resultMesh;
 }
 
+Model *MeshGenerator::takeDraftMesh()
+{
+    QMutexLocker locker(&m_draftMeshMutex);
+    Model *draftMesh = m_draftMesh;
+    m_draftMesh = nullptr;
+    return draftMesh;
+}
+
 Model *MeshGenerator::takePartPreviewMesh(const QUuid &partId)
 {
     Model *resultMesh = m_partPreviewMeshes[partId];
@@ -347,6 +360,8 @@ MeshCombiner::Mesh *MeshGenerator::combinePartMesh(const QString &partIdString,
         return nullptr;
     }
     
+    ProfileScope profileScope("partBuild");
+    
     QUuid partId = QUuid(partIdString);
     auto &part = findPart->second;
     
@@ -401,14 +416,11 @@ MeshCombiner::Mesh *MeshGenerator::combinePartMesh(const QString &partIdString,
     
     bool deformUnified = isTrueValueString(valueOfKeyInMapOrEmpty(part, "deformUnified"));
     
-    QImage deformImageStruct;
-    const QImage *deformImage = nullptr;
+    const DeformMap *deformMap = nullptr;
     QString deformMapImageIdString = valueOfKeyInMapOrEmpty(part, "deformMapImageId");
     if (!deformMapImageIdString.isEmpty()) {
-        ImageForever::copy(QUuid(deformMapImageIdString), deformImageStruct);
-        if (!deformImageStruct.isNull())
-            deformImage = &deformImageStruct;
-        if (nullptr == deformImage) {
+        deformMap = findDeformMap(deformMapImageIdString);
+        if (nullptr == deformMap) {
             qDebug() << "Deform image id not found:" << deformMapImageIdString;
         }
     }
@@ -590,7 +602,8 @@ MeshCombiner::Mesh *MeshGenerator::combinePartMesh(const QString &partIdString,
         //}
     };
     
-    strokeModifier = new StrokeModifier;
+    strokeModifier = &m_cacheContext->strokeModifier;
+    strokeModifier->clear();
     
     if (smooth)
         strokeModifier->enableSmooth();
@@ -643,15 +656,16 @@ MeshCombiner::Mesh *MeshGenerator::combinePartMesh(const QString &partIdString,
     
     std::vector<size_t> sourceNodeIndices;
     
-    StrokeMeshBuilder *strokeMeshBuilder = new StrokeMeshBuilder;
-        
+    StrokeMeshBuilder *strokeMeshBuilder = &m_cacheContext->strokeMeshBuilder;
+    strokeMeshBuilder->clear();
+    
     strokeMeshBuilder->setDeformThickness(deformThickness);
     strokeMeshBuilder->setDeformWidth(deformWidth);
     strokeMeshBuilder->setDeformMapScale(deformMapScale);
     strokeMeshBuilder->setDeformUnified(deformUnified);
     strokeMeshBuilder->setHollowThickness(hollowThickness);
-    if (nullptr != deformImage)
-        strokeMeshBuilder->setDeformMapImage(deformImage);
+    if (nullptr != deformMap)
+        strokeMeshBuilder->setDeformMap(deformMap);
     if (PartBase::YZ == base) {
         strokeMeshBuilder->enableBaseNormalOnX(false);
     } else if (PartBase::Average == base) {
@@ -682,6 +696,10 @@ MeshCombiner::Mesh *MeshGenerator::combinePartMesh(const QString &partIdString,
             addEdgeToPartCache(fromNodeIdString, toNodeIdString);
         }
 
+        if (nullptr != m_recordedStrokeMeshBuilders) {
+            m_recordedStrokeMeshBuilders->emplace_back();
+            m_recordedStrokeMeshBuilders->back().copyInputs(*strokeMeshBuilder);
+        }
         buildSucceed = strokeMeshBuilder->build();
         
         partCache.vertices = strokeMeshBuilder->generatedVertices();
@@ -713,7 +731,6 @@ MeshCombiner::Mesh *MeshGenerator::combinePartMesh(const QString &partIdString,
         }
     }
     
-    delete strokeMeshBuilder;
     strokeMeshBuilder = nullptr;
     
     bool hasMeshError = false;
@@ -790,7 +807,7 @@ MeshCombiner::Mesh *MeshGenerator::combinePartMesh(const QString &partIdString,
         */
     }
     
-    delete strokeModifier;
+    strokeModifier = nullptr;
     
     if (mesh && mesh->isNull()) {
         delete mesh;
@@ -886,6 +903,25 @@ bool MeshGenerator::fillPartWithMesh(GeneratedPart &partCache,
     return fillIsSucessful;
 }
 
+const DeformMap *MeshGenerator::findDeformMap(const QString &imageIdString)
+{
+    auto findDeformMap = m_cacheContext->deformMaps.find(imageIdString);
+    if (findDeformMap != m_cacheContext->deformMaps.end())
+        return findDeformMap->second;
+    
+    // Images in ImageForever never change once added, so the converted map can be kept as long as the cache context lives
+    const QImage *image = ImageForever::get(QUuid(imageIdString));
+    if (nullptr == image)
+        return nullptr;
+    DeformMap *deformMap = new DeformMap(*image);
+    if (deformMap->isNull()) {
+        delete deformMap;
+        return nullptr;
+    }
+    m_cacheContext->deformMaps.insert({imageIdString, deformMap});
+    return deformMap;
+}
+
 const std::map<QString, QString> *MeshGenerator::findComponent(const QString &componentIdString)
 {
     const std::map<QString, QString> *component = &m_snapshot->rootComponent;
@@ -974,20 +1010,12 @@ MeshCombiner::Mesh *MeshGenerator::combineComponentMesh(const QString &component
     QString linkDataType = valueOfKeyInMapOrEmpty(*component, "linkDataType");
     if ("partId" == linkDataType) {
         QString partIdString = valueOfKeyInMapOrEmpty(*component, "linkData");
-        bool hasError = false;
-        bool retryable = true;
-        mesh = combinePartMesh(partIdString, &hasError, &retryable, m_interpolationEnabled);
-        if (hasError) {
-            delete mesh;
-            mesh = nullptr;
-            if (retryable && m_interpolationEnabled) {
-                hasError = false;
-                qDebug() << "Try combine part again without adding intermediate nodes";
-                mesh = combinePartMesh(partIdString, &hasError, &retryable, false);
-            }
-            if (hasError) {
-                m_isSuccessful = false;
-            }
+        auto findPrepared = m_preparedPartMeshes.find(partIdString);
+        if (findPrepared != m_preparedPartMeshes.end()) {
+            mesh = findPrepared->second;
+            m_preparedPartMeshes.erase(findPrepared);
+        } else {
+            mesh = combinePartMeshWithRetry(partIdString);
         }
         
         const auto &partCache = m_cacheContext->parts[partIdString];
@@ -1113,6 +1141,126 @@ MeshCombiner::Mesh *MeshGenerator::combineComponentMesh(const QString &component
     return mesh;
 }
 
+MeshCombiner::Mesh *MeshGenerator::combinePartMeshWithRetry(const QString &partIdString)
+{
+    bool hasError = false;
+    bool retryable = true;
+    MeshCombiner::Mesh *mesh = combinePartMesh(partIdString, &hasError, &retryable, m_interpolationEnabled);
+    if (hasError) {
+        delete mesh;
+        mesh = nullptr;
+        if (retryable && m_interpolationEnabled) {
+            hasError = false;
+            qDebug() << "Try combine part again without adding intermediate nodes";
+            mesh = combinePartMesh(partIdString, &hasError, &retryable, false);
+        }
+        if (hasError) {
+            m_isSuccessful = false;
+        }
+    }
+    return mesh;
+}
+
+void MeshGenerator::prepareDirtyPartMeshes(const QString &componentIdString)
+{
+    const auto &component = findComponent(componentIdString);
+    if (nullptr == component)
+        return;
+    QString linkDataType = valueOfKeyInMapOrEmpty(*component, "linkDataType");
+    if ("partId" == linkDataType) {
+        if (m_cacheEnabled && m_dirtyComponentIds.find(componentIdString) == m_dirtyComponentIds.end()) {
+            const auto &componentCache = m_cacheContext->components[componentIdString];
+            if (nullptr != componentCache.mesh)
+                return;
+        }
+        QString partIdString = valueOfKeyInMapOrEmpty(*component, "linkData");
+        if (m_preparedPartMeshes.find(partIdString) != m_preparedPartMeshes.end())
+            return;
+        // Dirty parts whose geometry comes out the same, e.g. after a color change, need no draft
+        std::vector<QVector3D> previousVertices = m_cacheContext->parts[partIdString].vertices;
+        m_preparedPartMeshes[partIdString] = combinePartMeshWithRetry(partIdString);
+        if (m_cacheContext->parts[partIdString].vertices != previousVertices)
+            m_partGeometryChanged = true;
+        return;
+    }
+    for (const auto &childIdString: valueOfKeyInMapOrEmpty(*component, "children").split(",")) {
+        if (childIdString.isEmpty())
+            continue;
+        prepareDirtyPartMeshes(childIdString);
+    }
+}
+
+size_t MeshGenerator::collectDraftParts(const QString &componentIdString, Object *draftObject)
+{
+    const auto &component = findComponent(componentIdString);
+    if (nullptr == component)
+        return 0;
+    // Subtracted parts would only hide the result, leave them for the exact pass
+    if (CombineMode::Inversion == componentCombineMode(component))
+        return 0;
+    QString linkDataType = valueOfKeyInMapOrEmpty(*component, "linkDataType");
+    if ("partId" == linkDataType) {
+        QString partIdString = valueOfKeyInMapOrEmpty(*component, "linkData");
+        auto findPart = m_cacheContext->parts.find(partIdString);
+        if (findPart == m_cacheContext->parts.end())
+            return 0;
+        const auto &partCache = findPart->second;
+        if (!partCache.joined || partCache.previewTriangles.empty())
+            return 0;
+        
+        QColor partColor = partCache.objectNodes.empty() ? m_defaultPartColor : partCache.objectNodes[0].color;
+        
+        // The preview triangles are what the part list renders already, the quads are not needed for the draft
+        size_t vertexStartIndex = draftObject->vertices.size();
+        draftObject->vertices.insert(draftObject->vertices.end(), partCache.previewVertices.begin(), partCache.previewVertices.end());
+        for (const auto &triangle: partCache.previewTriangles) {
+            std::vector<size_t> newTriangle = triangle;
+            for (auto &index: newTriangle)
+                index += vertexStartIndex;
+            draftObject->triangles.push_back(newTriangle);
+        }
+        draftObject->triangleColors.resize(draftObject->triangles.size(), partColor);
+        return 1;
+    }
+    size_t partCount = 0;
+    for (const auto &childIdString: valueOfKeyInMapOrEmpty(*component, "children").split(",")) {
+        if (childIdString.isEmpty())
+            continue;
+        partCount += collectDraftParts(childIdString, draftObject);
+    }
+    return partCount;
+}
+
+bool MeshGenerator::generateDraftMesh()
+{
+    Object draftObject;
+    draftObject.meshId = m_id;
+    // A single part is already the exact result, there is no boolean operation to wait for
+    if (collectDraftParts(QUuid().toString(), &draftObject) < 2)
+        return false;
+    
+    for (const auto &face: draftObject.triangles) {
+        draftObject.triangleNormals.push_back(QVector3D::normal(
+            draftObject.vertices[face[0]],
+            draftObject.vertices[face[1]],
+            draftObject.vertices[face[2]]
+        ));
+    }
+    std::vector<std::vector<QVector3D>> triangleVertexNormals;
+    generateSmoothTriangleVertexNormals(draftObject.vertices,
+        draftObject.triangles,
+        draftObject.triangleNormals,
+        &triangleVertexNormals);
+    draftObject.setTriangleVertexNormals(triangleVertexNormals);
+    
+    Model *draftMesh = new Model(draftObject);
+    
+    QMutexLocker locker(&m_draftMeshMutex);
+    delete m_draftMesh;
+    m_draftMesh = draftMesh;
+    return true;
+}
+
 MeshCombiner::Mesh *MeshGenerator::combineMultipleMeshes(const std::vector<std::tuple<MeshCombiner::Mesh *, CombineMode, QString>> &multipleMeshes, bool recombine)
 {
     MeshCombiner::Mesh *mesh = nullptr;
@@ -1226,17 +1374,24 @@ MeshCombiner::Mesh *MeshGenerator::combineTwoMeshes(const MeshCombiner::Mesh &fi
     if (first.isNull() || second.isNull())
         return nullptr;
     std::vector<std::pair<MeshCombiner::Source, size_t>> combinedVerticesSources;
-    MeshCombiner::Mesh *newMesh = MeshCombiner::combine(first,
-        second,
-        method,
-        &combinedVerticesSources);
+    MeshCombiner::Mesh *newMesh = nullptr;
+    {
+        ProfileScope profileScope("booleanOperation");
+        newMesh = MeshCombiner::combine(first,
+            second,
+            method,
+            &combinedVerticesSources);
+    }
     if (nullptr == newMesh)
         return nullptr;
     if (!newMesh->isNull() && recombine) {
+        ProfileScope profileScope("recombine");
         MeshRecombiner recombiner;
         std::vector<QVector3D> combinedVertices;
         std::vector<std::vector<size_t>> combinedFaces;
         newMesh->fetch(combinedVertices, combinedFaces);
+        if (nullptr != m_recordedRecombineInputs)
+            m_recordedRecombineInputs->push_back({combinedVertices, combinedVerticesSources, combinedFaces});
         recombiner.setVertices(&combinedVertices, &combinedVerticesSources);
         recombiner.setFaces(&combinedFaces);
         if (recombiner.recombine()) {
@@ -1294,6 +1449,16 @@ void MeshGenerator::setGeneratedCacheContext(GeneratedCacheContext *cacheContext
     m_cacheContext = cacheContext;
 }
 
+void MeshGenerator::recordStrokeMeshBuilders(std::vector<StrokeMeshBuilder> *strokeMeshBuilders)
+{
+    m_recordedStrokeMeshBuilders = strokeMeshBuilders;
+}
+
+void MeshGenerator::recordRecombineInputs(std::vector<RecombineInput> *recombineInputs)
+{
+    m_recordedRecombineInputs = recombineInputs;
+}
+
 void MeshGenerator::setSmoothShadingThresholdAngleDegrees(float degrees)
 {
     m_smoothShadingThresholdAngleDegrees = degrees;
@@ -1316,6 +1481,11 @@ void MeshGenerator::setWeldEnabled(bool enabled)
     m_weldEnabled = enabled;
 }
 
+void MeshGenerator::setDraftEnabled(bool enabled)
+{
+    m_draftEnabled = enabled;
+}
+
 void MeshGenerator::collectErroredParts()
 {
     for (const auto &it: m_cacheContext->parts) {
@@ -1357,7 +1527,10 @@ void MeshGenerator::postprocessObject(Object *object)
     object->triangleNormals = combinedFacesNormals;
     
     std::vector<std::pair<QUuid, QUuid>> sourceNodes;
-    triangleSourceNodeResolve(*object, m_nodeVertices, sourceNodes, &object->vertexSourceNodes);
+    {
+        ProfileScope profileScope("triangleSourceNodeResolve");
+        triangleSourceNodeResolve(*object, m_nodeVertices, sourceNodes, &object->vertexSourceNodes);
+    }
     object->setTriangleSourceNodes(sourceNodes);
     
     std::map<std::pair<QUuid, QUuid>, QColor> sourceNodeToColorMap;
@@ -1374,10 +1547,13 @@ void MeshGenerator::postprocessObject(Object *object)
     }
     
     std::vector<std::vector<QVector3D>> triangleVertexNormals;
-    generateSmoothTriangleVertexNormals(object->vertices,
-        object->triangles,
-        object->triangleNormals,
-        &triangleVertexNormals);
+    {
+        ProfileScope profileScope("smoothNormals");
+        generateSmoothTriangleVertexNormals(object->vertices,
+            object->triangles,
+            object->triangleNormals,
+            &triangleVertexNormals);
+    }
     object->setTriangleVertexNormals(triangleVertexNormals);
 }
 
@@ -1579,6 +1755,8 @@ void MeshGenerator::generate()
 
     m_isSuccessful = true;
     
+    ProfileScope profileScope("meshGeneration");
+    
     QElapsedTimer countTimeConsumed;
     countTimeConsumed.start();
     
@@ -1654,6 +1832,15 @@ void MeshGenerator::generate()
     }
     
     m_dirtyComponentIds.insert(QUuid().toString());
+    Profiler::addCounter("dirtyComponents", m_dirtyComponentIds.size());
+    
+    // Build the dirty parts upfront, so the un-unioned parts can be shown as a draft
+    // while the boolean operations are still running
+    if (m_draftEnabled) {
+        prepareDirtyPartMeshes(QUuid().toString());
+        if (m_partGeometryChanged && generateDraftMesh())
+            emit draftReady();
+    }
     
     CombineMode combineMode;
     auto combinedMesh = combineComponentMesh(QUuid().toString(), &combineMode);
@@ -1669,6 +1856,7 @@ void MeshGenerator::generate()
     if (nullptr != combinedMesh) {
         combinedMesh->fetch(combinedVertices, combinedFaces);
         if (m_weldEnabled) {
+            ProfileScope profileScope("weldSeam");
             size_t totalAffectedNum = 0;
             size_t affectedNum = 0;
             do {
@@ -1682,7 +1870,10 @@ void MeshGenerator::generate()
                 totalAffectedNum += affectedNum;
             } while (affectedNum > 0);
         }
-        recoverQuads(combinedVertices, combinedFaces, componentCache.sharedQuadEdges, m_object->triangleAndQuads);
+        {
+            ProfileScope profileScope("recoverQuads");
+            recoverQuads(combinedVertices, combinedFaces, componentCache.sharedQuadEdges, m_object->triangleAndQuads);
+        }
         m_object->vertices = combinedVertices;
         m_object->triangles = combinedFaces;
     }
@@ -1695,8 +1886,13 @@ void MeshGenerator::generate()
     postprocessObject(m_object);
     
     m_resultMesh = new Model(*m_object);
+    Profiler::addCounter("resultTriangles", m_object->triangles.size());
     
     delete combinedMesh;
+    
+    for (auto &it: m_preparedPartMeshes)
+        delete it.second;
+    m_preparedPartMeshes.clear();
 
     if (needDeleteCacheContext) {
         delete m_cacheContext;
@@ -5,9 +5,12 @@
 #include <QColor>
 #include <tuple>
 #include <QImage>
+#include <QMutex>
 #include "meshcombiner.h"
 #include "positionkey.h"
 #include "strokemeshbuilder.h"
+#include "strokemodifier.h"
+#include "deformmap.h"
 #include "object.h"
 #include "snapshot.h"
 #include "combinemode.h"
@@ -68,6 +71,8 @@ public:
     {
         for (auto &it: cachedCombination)
             delete it.second;
+        for (auto &it: deformMaps)
+            delete it.second;
         for (auto &it: parts)
             it.second.releaseMeshes();
         for (auto &it: components)
@@ -77,6 +82,11 @@ public:
     std::map<QString, GeneratedPart> parts;
     std::map<QString, QString> partMirrorIdMap;
     std::map<QString, MeshCombiner::Mesh *> cachedCombination;
+    std::map<QString, DeformMap *> deformMaps;
+    
+    // Part builders are reused across parts and generations, so their buffers don't get reallocated for each part
+    StrokeModifier strokeModifier;
+    StrokeMeshBuilder strokeMeshBuilder;
 };
 
 class MeshGenerator : public QObject
@@ -87,6 +97,7 @@ public:
     ~MeshGenerator();
     bool isSuccessful();
     Model *takeResultMesh();
+    Model *takeDraftMesh();
     Model *takePartPreviewMesh(const QUuid &partId);
     QImage *takePartPreviewImage(const QUuid &partId);
     const std::set<QUuid> &generatedPreviewPartIds();
@@ -101,8 +112,21 @@ public:
     void setDefaultPartColor(const QColor &color);
     void setId(quint64 id);
     void setWeldEnabled(bool enabled);
+    // Emit draftReady with the un-unioned parts when a part changed and the boolean operations still have to run
+    void setDraftEnabled(bool enabled);
+    // Keeps a copy of each part builder right before it builds, the benchmark replays them
+    void recordStrokeMeshBuilders(std::vector<StrokeMeshBuilder> *strokeMeshBuilders);
+    struct RecombineInput
+    {
+        std::vector<QVector3D> vertices;
+        std::vector<std::pair<MeshCombiner::Source, size_t>> verticesSources;
+        std::vector<std::vector<size_t>> faces;
+    };
+    // Keeps a copy of each boolean result going into MeshRecombiner, the benchmark replays them
+    void recordRecombineInputs(std::vector<RecombineInput> *recombineInputs);
     quint64 id();
 signals:
+    void draftReady();
     void finished();
 public slots:
     void process();
@@ -123,6 +147,9 @@ private:
     std::set<QUuid> m_generatedPreviewPartIds;
     std::set<QUuid> m_generatedPreviewImagePartIds;
     Model *m_resultMesh = nullptr;
+    Model *m_draftMesh = nullptr;
+    QMutex m_draftMeshMutex;
+    std::map<QString, MeshCombiner::Mesh *> m_preparedPartMeshes;
     std::map<QUuid, Model *> m_partPreviewMeshes;
     std::map<QUuid, QImage *> m_partPreviewImages;
     bool m_isSuccessful = false;
@@ -134,7 +161,11 @@ private:
     std::vector<QVector3D> m_clothCollisionVertices;
     std::vector<std::vector<size_t>> m_clothCollisionTriangles;
     bool m_weldEnabled = true;
+    bool m_draftEnabled = false;
+    bool m_partGeometryChanged = false;
     bool m_interpolationEnabled = true;
+    std::vector<StrokeMeshBuilder> *m_recordedStrokeMeshBuilders = nullptr;
+    std::vector<RecombineInput> *m_recordedRecombineInputs = nullptr;
     
     void collectParts();
     void collectIncombinableComponentMeshes(const QString &componentIdString);
@@ -150,6 +181,10 @@ private:
         float cutRotation,
         const StrokeMeshBuilder *strokeMeshBuilder);
     MeshCombiner::Mesh *combinePartMesh(const QString &partIdString, bool *hasError, bool *retryable, bool addIntermediateNodes=true);
+    MeshCombiner::Mesh *combinePartMeshWithRetry(const QString &partIdString);
+    void prepareDirtyPartMeshes(const QString &componentIdString);
+    size_t collectDraftParts(const QString &componentIdString, Object *draftObject);
+    bool generateDraftMesh();
     MeshCombiner::Mesh *combineComponentMesh(const QString &componentIdString, CombineMode *combineMode);
     void makeXmirror(const std::vector<QVector3D> &sourceVertices, const std::vector<std::vector<size_t>> &sourceFaces,
         std::vector<QVector3D> *destVertices, std::vector<std::vector<size_t>> *destFaces);
@@ -172,6 +207,7 @@ private:
     void postprocessObject(Object *object);
     void collectErroredParts();
     void preprocessMirror();
+    const DeformMap *findDeformMap(const QString &imageIdString);
     QString reverseUuid(const QString &uuidString);
 };
 
@@ -1,13 +1,13 @@
-#include <set>
 #include <QDebug>
 #include <cmath>
-#include <queue>
+#include <algorithm>
 #include "meshrecombiner.h"
 #include "positionkey.h"
 #include "meshwrapper.h"
 #include "util.h"
 
 #define MAX_EDGE_LOOP_LENGTH            1000
+#define INVALID_INDEX                   ((size_t)-1)
 
 void MeshRecombiner::setVertices(const std::vector<QVector3D> *vertices,
     const std::vector<std::pair<MeshCombiner::Source, size_t>> *verticesSourceIndices)
@@ -21,28 +21,91 @@ void MeshRecombiner::setFaces(const std::vector<std::vector<size_t>> *faces)
     m_faces = faces;
 }
 
-bool MeshRecombiner::convertHalfEdgesToEdgeLoops(const std::vector<std::pair<size_t, size_t>> &halfEdges,
+bool MeshRecombiner::buildHalfEdges()
+{
+    size_t vertexCount = m_vertices->size();
+    m_faceHalfEdgeBegin.resize(m_faces->size() + 1);
+    size_t halfEdgeCount = 0;
+    for (size_t faceIndex = 0; faceIndex < m_faces->size(); ++faceIndex) {
+        m_faceHalfEdgeBegin[faceIndex] = halfEdgeCount;
+        halfEdgeCount += (*m_faces)[faceIndex].size();
+    }
+    m_faceHalfEdgeBegin[m_faces->size()] = halfEdgeCount;
+    
+    m_halfEdgeFrom.resize(halfEdgeCount);
+    m_halfEdgeTo.resize(halfEdgeCount);
+    m_halfEdgeFace.resize(halfEdgeCount);
+    m_vertexHalfEdgeBegin.assign(vertexCount + 1, 0);
+    for (size_t faceIndex = 0; faceIndex < m_faces->size(); ++faceIndex) {
+        const auto &face = (*m_faces)[faceIndex];
+        for (size_t i = 0; i < face.size(); ++i) {
+            size_t halfEdge = m_faceHalfEdgeBegin[faceIndex] + i;
+            m_halfEdgeFrom[halfEdge] = face[i];
+            m_halfEdgeTo[halfEdge] = face[(i + 1) % face.size()];
+            m_halfEdgeFace[halfEdge] = faceIndex;
+            ++m_vertexHalfEdgeBegin[face[i] + 1];
+        }
+    }
+    for (size_t vertex = 0; vertex < vertexCount; ++vertex)
+        m_vertexHalfEdgeBegin[vertex + 1] += m_vertexHalfEdgeBegin[vertex];
+    
+    // Outgoing half edges keep the face order, so findHalfEdge prefers the first face on non manifold edges
+    m_vertexHalfEdges.resize(halfEdgeCount);
+    std::vector<size_t> nextSlots(m_vertexHalfEdgeBegin.begin(), m_vertexHalfEdgeBegin.end() - 1);
+    for (size_t halfEdge = 0; halfEdge < halfEdgeCount; ++halfEdge)
+        m_vertexHalfEdges[nextSlots[m_halfEdgeFrom[halfEdge]]++] = halfEdge;
+    
+    bool isSuccessful = true;
+    m_halfEdgeTwin.resize(halfEdgeCount);
+    for (size_t halfEdge = 0; halfEdge < halfEdgeCount; ++halfEdge) {
+        if (findHalfEdge(m_halfEdgeFrom[halfEdge], m_halfEdgeTo[halfEdge]) != halfEdge) {
+            //qDebug() << "Non manifold edge found:" << m_halfEdgeFrom[halfEdge] << m_halfEdgeTo[halfEdge];
+            isSuccessful = false;
+        }
+        m_halfEdgeTwin[halfEdge] = findHalfEdge(m_halfEdgeTo[halfEdge], m_halfEdgeFrom[halfEdge]);
+    }
+    return isSuccessful;
+}
+
+size_t MeshRecombiner::findHalfEdge(size_t fromVertex, size_t toVertex) const
+{
+    for (size_t i = m_vertexHalfEdgeBegin[fromVertex]; i < m_vertexHalfEdgeBegin[fromVertex + 1]; ++i) {
+        size_t halfEdge = m_vertexHalfEdges[i];
+        if (m_halfEdgeTo[halfEdge] == toVertex)
+            return halfEdge;
+    }
+    return INVALID_INDEX;
+}
+
+bool MeshRecombiner::convertHalfEdgesToEdgeLoops(std::vector<std::pair<size_t, size_t>> &halfEdges,
     std::vector<std::vector<size_t>> *edgeLoops)
 {
-    std::map<size_t, size_t> vertexLinkMap;
-    for (const auto &halfEdge: halfEdges) {
-        auto inserResult = vertexLinkMap.insert(halfEdge);
-        if (!inserResult.second) {
-            //qDebug() << "Create edge loop from half edge failed, found repeated vertex link" << halfEdge.first << "->" << halfEdge.second << "exist:" << inserResult.first->first << "->" << inserResult.first->second;
+    std::sort(halfEdges.begin(), halfEdges.end());
+    for (size_t i = 1; i < halfEdges.size(); ++i) {
+        if (halfEdges[i - 1].first == halfEdges[i].first) {
+            //qDebug() << "Create edge loop from half edge failed, found repeated vertex link" << halfEdges[i].first;
             return false;
         }
     }
-    while (!vertexLinkMap.empty()) {
+    std::vector<bool> linked(halfEdges.size(), false);
+    for (size_t start = 0; start < halfEdges.size(); ++start) {
+        if (linked[start])
+            continue;
         std::vector<size_t> edgeLoop;
-        size_t vertex = vertexLinkMap.begin()->first;
+        std::vector<size_t> edgeLoopLinks;
+        size_t vertex = halfEdges[start].first;
         size_t head = vertex;
         bool loopBack = false;
         size_t limitLoop = MAX_EDGE_LOOP_LENGTH;
         while ((limitLoop--) > 0) {
             edgeLoop.push_back(vertex);
-            auto findNext = vertexLinkMap.find(vertex);
-            if (findNext == vertexLinkMap.end())
+            auto findNext = std::lower_bound(halfEdges.begin(), halfEdges.end(), std::make_pair(vertex, (size_t)0));
+            if (findNext == halfEdges.end() || findNext->first != vertex)
+                break;
+            size_t link = findNext - halfEdges.begin();
+            if (linked[link])
                 break;
+            edgeLoopLinks.push_back(link);
             vertex = findNext->second;
             if (vertex == head) {
                 loopBack = true;
@@ -57,84 +120,64 @@ bool MeshRecombiner::convertHalfEdgesToEdgeLoops(const std::vector<std::pair<siz
             //qDebug() << "Create edge loop from half edge failed, edge loop size invalid:" << edgeLoop.size();
             return false;
         }
-        for (const auto &vertex: edgeLoop) {
-            vertexLinkMap.erase(vertex);
-        }
+        for (const auto &link: edgeLoopLinks)
+            linked[link] = true;
         edgeLoops->push_back(edgeLoop);
     }
     return true;
 }
 
-size_t MeshRecombiner::splitSeamVerticesToIslands(const std::map<size_t, std::vector<size_t>> &seamEdges,
-        std::map<size_t, size_t> *vertexToIslandMap)
+size_t MeshRecombiner::splitSeamVerticesToIslands(std::vector<size_t> *vertexToIsland)
 {
-    std::set<size_t> visited;
+    // Seam edges run between vertices created by the boolean operation;
+    // islands are grown along them starting from the lowest unvisited vertex
+    vertexToIsland->assign(m_vertices->size(), INVALID_INDEX);
     size_t nextIslandId = 0;
-    for (const auto &it: seamEdges) {
-        std::queue<size_t> vertices;
-        vertices.push(it.first);
-        bool hasVertexJoin = false;
-        while (!vertices.empty()) {
-            auto v = vertices.front();
-            vertices.pop();
-            if (visited.find(v) != visited.end())
-                continue;
-            visited.insert(v);
-            vertexToIslandMap->insert({v, nextIslandId});
-            hasVertexJoin = true;
-            const auto findNeighbors = seamEdges.find(v);
-            if (findNeighbors != seamEdges.end()) {
-                for (const auto &neighbor: findNeighbors->second) {
-                    vertices.push(neighbor);
-                }
+    std::vector<size_t> pendingVertices;
+    for (size_t vertex = 0; vertex < m_vertices->size(); ++vertex) {
+        if (MeshCombiner::Source::None != (*m_verticesSourceIndices)[vertex].first ||
+                INVALID_INDEX != (*vertexToIsland)[vertex])
+            continue;
+        bool hasSeamEdge = false;
+        for (size_t i = m_vertexHalfEdgeBegin[vertex]; i < m_vertexHalfEdgeBegin[vertex + 1]; ++i) {
+            if (MeshCombiner::Source::None == (*m_verticesSourceIndices)[m_halfEdgeTo[m_vertexHalfEdges[i]]].first) {
+                hasSeamEdge = true;
+                break;
             }
         }
-        if (hasVertexJoin)
-            ++nextIslandId;
-    }
-    return nextIslandId;
-}
-
-bool MeshRecombiner::buildHalfEdgeToFaceMap(std::map<std::pair<size_t, size_t>, size_t> &halfEdgeToFaceMap)
-{
-    bool isSuccessful = true;
-    for (size_t faceIndex = 0; faceIndex < m_faces->size(); ++faceIndex) {
-        const auto &face = (*m_faces)[faceIndex];
-        for (size_t i = 0; i < face.size(); ++i) {
-            size_t j = (i + 1) % face.size();
-            const auto insertResult = halfEdgeToFaceMap.insert({{face[i], face[j]}, faceIndex});
-            if (!insertResult.second) {
-                //qDebug() << "Non manifold edge found:" << face[i] << face[j];
-                isSuccessful = false;
+        if (!hasSeamEdge)
+            continue;
+        (*vertexToIsland)[vertex] = nextIslandId;
+        pendingVertices.push_back(vertex);
+        while (!pendingVertices.empty()) {
+            auto v = pendingVertices.back();
+            pendingVertices.pop_back();
+            for (size_t i = m_vertexHalfEdgeBegin[v]; i < m_vertexHalfEdgeBegin[v + 1]; ++i) {
+                size_t neighbor = m_halfEdgeTo[m_vertexHalfEdges[i]];
+                if (MeshCombiner::Source::None != (*m_verticesSourceIndices)[neighbor].first ||
+                        INVALID_INDEX != (*vertexToIsland)[neighbor])
+                    continue;
+                (*vertexToIsland)[neighbor] = nextIslandId;
+                pendingVertices.push_back(neighbor);
             }
         }
+        ++nextIslandId;
     }
-    return isSuccessful;
+    return nextIslandId;
 }
 
 bool MeshRecombiner::recombine()
 {
-    buildHalfEdgeToFaceMap(m_halfEdgeToFaceMap);
+    buildHalfEdges();
     
-    std::map<size_t, std::vector<size_t>> seamLink;
-    for (const auto &face: *m_faces) {
-        for (size_t i = 0; i < face.size(); ++i) {
-            const auto &index = face[i];
-            auto source = (*m_verticesSourceIndices)[index];
-            if (MeshCombiner::Source::None == source.first) {
-                auto next = face[(i + 1) % face.size()];
-                auto nextSource = (*m_verticesSourceIndices)[next];
-                if (MeshCombiner::Source::None == nextSource.first) {
-                    seamLink[index].push_back(next);
-                }
-            }
-        }
-    }
-    std::map<size_t, size_t> seamVertexToIslandMap;
-    size_t islands = splitSeamVerticesToIslands(seamLink, &seamVertexToIslandMap);
+    std::vector<size_t> seamVertexToIsland;
+    size_t islands = splitSeamVerticesToIslands(&seamVertexToIsland);
     //qDebug() << "Seam islands:" << islands;
     
-    std::map<std::pair<size_t, size_t>, std::pair<size_t, bool>> edgesInSeamArea;
+    // The first face claiming a half edge decides the island and the side of it
+    m_faceSeamIsland.assign(m_faces->size(), INVALID_INDEX);
+    std::vector<size_t> halfEdgeIslands(m_halfEdgeFrom.size(), INVALID_INDEX);
+    std::vector<bool> halfEdgeInFirstGroup(m_halfEdgeFrom.size(), false);
     for (size_t faceIndex = 0; faceIndex < (*m_faces).size(); ++faceIndex) {
         const auto &face = (*m_faces)[faceIndex];
         bool containsSeamVertex = false;
@@ -144,22 +187,22 @@ bool MeshRecombiner::recombine()
             const auto &index = face[i];
             auto source = (*m_verticesSourceIndices)[index];
             if (MeshCombiner::Source::None == source.first) {
-                const auto &findIsland = seamVertexToIslandMap.find(index);
-                if (findIsland != seamVertexToIslandMap.end()) {
+                if (INVALID_INDEX != seamVertexToIsland[index]) {
                     containsSeamVertex = true;
-                    island = findIsland->second;
+                    island = seamVertexToIsland[index];
                 }
             } else if (MeshCombiner::Source::First == source.first) {
                 inFirstGroup = true;
             }
         }
         if (containsSeamVertex) {
-            m_facesInSeamArea.insert({faceIndex, island});
-            for (size_t i = 0; i < face.size(); ++i) {
-                const auto &index = face[i];
-                const auto &next = face[(i + 1) % face.size()];
-                std::pair<size_t, size_t> edge = {index, next};
-                edgesInSeamArea.insert({edge, {island, inFirstGroup}});
+            m_faceSeamIsland[faceIndex] = island;
+            for (size_t halfEdge = m_faceHalfEdgeBegin[faceIndex]; halfEdge < m_faceHalfEdgeBegin[faceIndex + 1]; ++halfEdge) {
+                size_t firstHalfEdge = findHalfEdge(m_halfEdgeFrom[halfEdge], m_halfEdgeTo[halfEdge]);
+                if (INVALID_INDEX != halfEdgeIslands[firstHalfEdge])
+                    continue;
+                halfEdgeIslands[firstHalfEdge] = island;
+                halfEdgeInFirstGroup[firstHalfEdge] = inFirstGroup;
             }
         }
     }
@@ -169,54 +212,59 @@ bool MeshRecombiner::recombine()
         std::vector<std::pair<size_t, size_t>> halfedges[2];
         std::vector<std::vector<size_t>> edgeLoops[2];
     };
-    std::map<size_t, IslandData> islandsMap;
+    std::vector<IslandData> islandDataList(islands);
     
-    for (const auto &edge: edgesInSeamArea) {
-        if (edgesInSeamArea.find({edge.first.second, edge.first.first}) == edgesInSeamArea.end()) {
-            islandsMap[edge.second.first].halfedges[edge.second.second ? 0 : 1].push_back(edge.first);
-        }
+    for (size_t halfEdge = 0; halfEdge < halfEdgeIslands.size(); ++halfEdge) {
+        size_t island = halfEdgeIslands[halfEdge];
+        if (INVALID_INDEX == island)
+            continue;
+        size_t twin = m_halfEdgeTwin[halfEdge];
+        if (INVALID_INDEX != twin && INVALID_INDEX != halfEdgeIslands[twin])
+            continue;
+        islandDataList[island].halfedges[halfEdgeInFirstGroup[halfEdge] ? 0 : 1].push_back({m_halfEdgeFrom[halfEdge], m_halfEdgeTo[halfEdge]});
     }
-    for (auto &it: islandsMap) {
+    for (size_t island = 0; island < islandDataList.size(); ++island) {
+        auto &islandData = islandDataList[island];
         for (size_t side = 0; side < 2; ++side) {
-            if (!convertHalfEdgesToEdgeLoops(it.second.halfedges[side], &it.second.edgeLoops[side])) {
-                //qDebug() << "Convert half edges to edge loops for island" << it.first << "side" << side << "failed";
-                it.second.edgeLoops[side].clear();
+            if (!convertHalfEdgesToEdgeLoops(islandData.halfedges[side], &islandData.edgeLoops[side])) {
+                //qDebug() << "Convert half edges to edge loops for island" << island << "side" << side << "failed";
+                islandData.edgeLoops[side].clear();
             }
         }
     }
     
-    for (auto &it: islandsMap) {
+    for (size_t island = 0; island < islandDataList.size(); ++island) {
+        auto &islandData = islandDataList[island];
         for (size_t side = 0; side < 2; ++side) {
-            for (size_t i = 0; i < it.second.edgeLoops[side].size(); ++i) {
-                auto &edgeLoop = it.second.edgeLoops[side][i];
+            for (size_t i = 0; i < islandData.edgeLoops[side].size(); ++i) {
+                auto &edgeLoop = islandData.edgeLoops[side][i];
                 size_t totalAdjustedTriangles = 0;
                 size_t adjustedTriangles = 0;
-                while ((adjustedTriangles=adjustTrianglesFromSeam(edgeLoop, it.first)) > 0) {
+                while ((adjustedTriangles=adjustTrianglesFromSeam(edgeLoop, island)) > 0) {
                     totalAdjustedTriangles += adjustedTriangles;
                 }
-                //qDebug() << "Island" << it.first << "side" << side << "edge loop" << i << "adjusted" << totalAdjustedTriangles << "triangles";
+                //qDebug() << "Island" << island << "side" << side << "edge loop" << i << "adjusted" << totalAdjustedTriangles << "triangles";
             }
         }
     }
     
-    for (auto &it: islandsMap) {
-        if (1 == it.second.edgeLoops[0].size() &&
-                it.second.edgeLoops[0].size() == it.second.edgeLoops[1].size()) {
-            //updateEdgeLoopNeighborVertices(it.second.edgeLoops[0][0]);
-            //updateEdgeLoopNeighborVertices(it.second.edgeLoops[1][0]);
-            if (bridge(it.second.edgeLoops[0][0], it.second.edgeLoops[1][0])) {
-                m_goodSeams.insert(it.first);
+    m_goodSeams.assign(islands, false);
+    for (size_t island = 0; island < islandDataList.size(); ++island) {
+        auto &islandData = islandDataList[island];
+        if (1 == islandData.edgeLoops[0].size() &&
+                islandData.edgeLoops[0].size() == islandData.edgeLoops[1].size()) {
+            //updateEdgeLoopNeighborVertices(islandData.edgeLoops[0][0]);
+            //updateEdgeLoopNeighborVertices(islandData.edgeLoops[1][0]);
+            if (bridge(islandData.edgeLoops[0][0], islandData.edgeLoops[1][0])) {
+                m_goodSeams[island] = true;
             }
         }
     }
-    //for (auto &it: islandsMap) {
-    //    m_goodSeams.insert(it.first);
-    //}
     
     copyNonSeamFacesAsRegenerated();
     removeReluctantVertices();
     
-    //qDebug() << "Optimized" << m_goodSeams.size() << "seams";
+    //qDebug() << "Optimized" << std::count(m_goodSeams.begin(), m_goodSeams.end(), true) << "seams";
     
     return true;
 }
@@ -230,11 +278,11 @@ void MeshRecombiner::updateEdgeLoopNeighborVertices(const std::vector<size_t> &e
     for (size_t i = 0; i < edgeLoop.size(); ++i) {
         size_t j = (i + 1) % edgeLoop.size();
         auto edge = std::make_pair(edgeLoop[i], edgeLoop[j]);
-        auto findFace = m_halfEdgeToFaceMap.find(edge);
-        if (findFace == m_halfEdgeToFaceMap.end()) {
+        size_t halfEdge = findHalfEdge(edge.first, edge.second);
+        if (INVALID_INDEX == halfEdge) {
             continue;
         }
-        const auto &face = (*m_faces)[findFace->second];
+        const auto &face = (*m_faces)[m_halfEdgeFace[halfEdge]];
         for (const auto &vertexIndex: face) {
             if (edge.first == vertexIndex || edge.second == vertexIndex)
                 continue;
@@ -283,44 +331,49 @@ size_t MeshRecombiner::adjustTrianglesFromSeam(std::vector<size_t> &edgeLoop, si
     if (edgeLoop.size() <= 3)
         return 0;
 
-    std::vector<size_t> halfEdgeToFaces;
+    std::vector<size_t> halfEdgeToFaces(edgeLoop.size());
     for (size_t i = 0; i < edgeLoop.size(); ++i) {
         size_t j = (i + 1) % edgeLoop.size();
-        auto findFace = m_halfEdgeToFaceMap.find({edgeLoop[j], edgeLoop[i]});
-        if (findFace == m_halfEdgeToFaceMap.end()) {
+        size_t halfEdge = findHalfEdge(edgeLoop[j], edgeLoop[i]);
+        if (INVALID_INDEX == halfEdge) {
             qDebug() << "Find face for half edge failed:" << edgeLoop[j] << edgeLoop[i];
             return 0;
         }
-        halfEdgeToFaces.push_back(findFace->second);
+        halfEdgeToFaces[i] = m_halfEdgeFace[halfEdge];
     }
     
     std::vector<size_t> removedFaceIndices;
-    std::set<size_t> ignored;
+    std::vector<bool> ignored(edgeLoop.size(), false);
+    size_t ignoredCount = 0;
     for (size_t i = 0; i < edgeLoop.size(); ++i) {
         size_t j = (i + 1) % edgeLoop.size();
         if (halfEdgeToFaces[i] == halfEdgeToFaces[j]) {
             removedFaceIndices.push_back(halfEdgeToFaces[i]);
-            ignored.insert(edgeLoop[j]);
+            ignored[j] = true;
+            ++ignoredCount;
             ++i;
             continue;
         }
     }
     
-    if (!ignored.empty()) {
+    if (ignoredCount > 0) {
         std::vector<size_t> newEdgeLoop;
-        for (const auto &v: edgeLoop) {
-            if (ignored.find(v) != ignored.end())
+        newEdgeLoop.reserve(edgeLoop.size() - ignoredCount);
+        for (size_t i = 0; i < edgeLoop.size(); ++i) {
+            if (ignored[i])
                 continue;
-            newEdgeLoop.push_back(v);
+            newEdgeLoop.push_back(edgeLoop[i]);
         }
         if (newEdgeLoop.size() < 3)
             return 0;
         edgeLoop = newEdgeLoop;
-        for (const auto &faceIndex: removedFaceIndices)
-            m_facesInSeamArea.insert({faceIndex, seamIndex});
+        for (const auto &faceIndex: removedFaceIndices) {
+            if (INVALID_INDEX == m_faceSeamIsland[faceIndex])
+                m_faceSeamIsland[faceIndex] = seamIndex;
+        }
     }
     
-    return ignored.size();
+    return ignoredCount;
 }
 
 size_t MeshRecombiner::otherVertexOfTriangle(const std::vector<size_t> &face, const std::vector<size_t> &indices)
@@ -337,9 +390,8 @@ size_t MeshRecombiner::otherVertexOfTriangle(const std::vector<size_t> &face, co
 void MeshRecombiner::copyNonSeamFacesAsRegenerated()
 {
     for (size_t faceIndex = 0; faceIndex < m_faces->size(); ++faceIndex) {
-        const auto &findFaceInSeam = m_facesInSeamArea.find(faceIndex);
-        if (findFaceInSeam != m_facesInSeamArea.end() &&
-                m_goodSeams.find(findFaceInSeam->second) != m_goodSeams.end())
+        size_t island = m_faceSeamIsland[faceIndex];
+        if (INVALID_INDEX != island && m_goodSeams[island])
             continue;
         m_regeneratedFaces.push_back((*m_faces)[faceIndex]);
     }
@@ -381,18 +433,15 @@ bool MeshRecombiner::bridge(const std::vector<size_t> &first, const std::vector<
     if (large->size() < small->size())
         std::swap(large, small);
     std::vector<std::pair<size_t, size_t>> matchedPairs;
-    std::map<size_t, size_t> nearestIndicesFromLargeToSmall;
+    std::vector<size_t> nearestIndicesFromLargeToSmall(large->size(), INVALID_INDEX);
     for (size_t i = 0; i < small->size(); ++i) {
         const auto &positionOnSmall = (*m_vertices)[(*small)[i]];
         size_t nearestIndexOnLarge = nearestIndex(positionOnSmall, *large);
-        auto matchResult = nearestIndicesFromLargeToSmall.find(nearestIndexOnLarge);
-        size_t nearestIndexOnSmall;
-        if (matchResult == nearestIndicesFromLargeToSmall.end()) {
+        size_t nearestIndexOnSmall = nearestIndicesFromLargeToSmall[nearestIndexOnLarge];
+        if (INVALID_INDEX == nearestIndexOnSmall) {
             const auto &positionOnLarge = (*m_vertices)[(*large)[nearestIndexOnLarge]];
             nearestIndexOnSmall = nearestIndex(positionOnLarge, *small);
-            nearestIndicesFromLargeToSmall.insert({nearestIndexOnLarge, nearestIndexOnSmall});
-        } else {
-            nearestIndexOnSmall = matchResult->second;
+            nearestIndicesFromLargeToSmall[nearestIndexOnLarge] = nearestIndexOnSmall;
         }
         if (nearestIndexOnSmall == i) {
             matchedPairs.push_back({nearestIndexOnSmall, nearestIndexOnLarge});
@@ -481,23 +530,16 @@ void MeshRecombiner::fillPairs(const std::vector<size_t> &small, const std::vect
 
 void MeshRecombiner::removeReluctantVertices()
 {
-    std::vector<std::vector<size_t>> rearrangedFaces;
-    std::map<size_t, size_t> oldToNewIndexMap;
-    for (const auto &face: m_regeneratedFaces) {
-        std::vector<size_t> newFace;
-        for (const auto &index: face) {
-            const auto &findIndex = oldToNewIndexMap.find(index);
-            if (findIndex != oldToNewIndexMap.end()) {
-                newFace.push_back(findIndex->second);
-            } else {
-                size_t newIndex = m_regeneratedVertices.size();
+    std::vector<size_t> oldToNewIndexMap(m_vertices->size(), INVALID_INDEX);
+    for (auto &face: m_regeneratedFaces) {
+        for (auto &index: face) {
+            size_t &newIndex = oldToNewIndexMap[index];
+            if (INVALID_INDEX == newIndex) {
+                newIndex = m_regeneratedVertices.size();
                 m_regeneratedVertices.push_back((*m_vertices)[index]);
                 m_regeneratedVerticesSourceIndices.push_back((*m_verticesSourceIndices)[index]);
-                oldToNewIndexMap.insert({index, newIndex});
-                newFace.push_back(newIndex);
             }
+            index = newIndex;
         }
-        rearrangedFaces.push_back(newFace);
     }
-    m_regeneratedFaces = rearrangedFaces;
 }
@@ -2,8 +2,6 @@
 #define DUST3D_RECOMBINER_H
 #include <QVector3D>
 #include <vector>
-#include <set>
-#include <map>
 #include "meshcombiner.h"
 
 class MeshRecombiner
@@ -24,17 +22,24 @@ private:
     std::vector<QVector3D> m_regeneratedVertices;
     std::vector<std::pair<MeshCombiner::Source, size_t>> m_regeneratedVerticesSourceIndices;
     std::vector<std::vector<size_t>> m_regeneratedFaces;
-    std::map<std::pair<size_t, size_t>, size_t> m_halfEdgeToFaceMap;
-    std::map<size_t, size_t> m_facesInSeamArea;
-    std::set<size_t> m_goodSeams;
     
-    bool addFaceToHalfEdgeToFaceMap(size_t faceIndex,
-        std::map<std::pair<size_t, size_t>, size_t> &halfEdgeToFaceMap);
-    bool buildHalfEdgeToFaceMap(std::map<std::pair<size_t, size_t>, size_t> &halfEdgeToFaceMap);
-    bool convertHalfEdgesToEdgeLoops(const std::vector<std::pair<size_t, size_t>> &halfEdges,
+    // Half edges are numbered face by face, m_faceHalfEdgeBegin[f] is the first one of face f;
+    // the outgoing half edges of vertex v are m_vertexHalfEdges[m_vertexHalfEdgeBegin[v]...m_vertexHalfEdgeBegin[v + 1]]
+    std::vector<size_t> m_faceHalfEdgeBegin;
+    std::vector<size_t> m_halfEdgeFrom;
+    std::vector<size_t> m_halfEdgeTo;
+    std::vector<size_t> m_halfEdgeFace;
+    std::vector<size_t> m_halfEdgeTwin;
+    std::vector<size_t> m_vertexHalfEdgeBegin;
+    std::vector<size_t> m_vertexHalfEdges;
+    std::vector<size_t> m_faceSeamIsland;
+    std::vector<bool> m_goodSeams;
+    
+    bool buildHalfEdges();
+    size_t findHalfEdge(size_t fromVertex, size_t toVertex) const;
+    bool convertHalfEdgesToEdgeLoops(std::vector<std::pair<size_t, size_t>> &halfEdges,
         std::vector<std::vector<size_t>> *edgeLoops);
-    size_t splitSeamVerticesToIslands(const std::map<size_t, std::vector<size_t>> &seamEdges,
-        std::map<size_t, size_t> *vertexToIslandMap);
+    size_t splitSeamVerticesToIslands(std::vector<size_t> *vertexToIsland);
     void copyNonSeamFacesAsRegenerated();
     size_t adjustTrianglesFromSeam(std::vector<size_t> &edgeLoop, size_t seamIndex);
     size_t otherVertexOfTriangle(const std::vector<size_t> &face, const std::vector<size_t> &indices);
@@ -0,0 +1,95 @@
+#include <QElapsedTimer>
+#include <QDebug>
+#include "meshrecombinerbenchmark.h"
+#include "meshrecombiner.h"
+#include "legacymeshrecombiner.h"
+#include "meshgenerator.h"
+
+template <class Recombiner>
+static bool recombine(Recombiner &recombiner, const MeshGenerator::RecombineInput &input)
+{
+    recombiner.setVertices(&input.vertices, &input.verticesSources);
+    recombiner.setFaces(&input.faces);
+    return recombiner.recombine();
+}
+
+static bool isSameResult(bool legacySucceed, LegacyMeshRecombiner &legacyRecombiner,
+    bool succeed, MeshRecombiner &recombiner)
+{
+    if (legacySucceed != succeed)
+        return false;
+    if (!succeed)
+        return true;
+    return legacyRecombiner.regeneratedVertices() == recombiner.regeneratedVertices() &&
+        legacyRecombiner.regeneratedVerticesSourceIndices() == recombiner.regeneratedVerticesSourceIndices() &&
+        legacyRecombiner.regeneratedFaces() == recombiner.regeneratedFaces();
+}
+
+void runMeshRecombinerBenchmark(Benchmark *benchmark)
+{
+    for (const auto &filename: benchmark->modelFilenames()) {
+        QString name = Benchmark::modelName(filename);
+
+        Snapshot snapshot;
+        if (!Benchmark::loadModel(filename, &snapshot)) {
+            qDebug() << "Load model failed:" << filename;
+            continue;
+        }
+
+        // A new cache context, so no combination is taken from the cache and every boolean result gets recorded
+        GeneratedCacheContext cacheContext;
+        std::vector<MeshGenerator::RecombineInput> recordedInputs;
+        MeshGenerator *meshGenerator = new MeshGenerator(new Snapshot(snapshot));
+        meshGenerator->setGeneratedCacheContext(&cacheContext);
+        meshGenerator->recordRecombineInputs(&recordedInputs);
+        meshGenerator->generate();
+        delete meshGenerator;
+        if (recordedInputs.empty())
+            continue;
+
+        // Both implementations must regenerate exactly the same mesh from each boolean result
+        size_t mismatchCount = 0;
+        size_t recombinedCount = 0;
+        for (size_t i = 0; i < recordedInputs.size(); ++i) {
+            LegacyMeshRecombiner legacyRecombiner;
+            bool legacySucceed = recombine(legacyRecombiner, recordedInputs[i]);
+            MeshRecombiner recombiner;
+            bool succeed = recombine(recombiner, recordedInputs[i]);
+            if (succeed)
+                ++recombinedCount;
+            if (!isSameResult(legacySucceed, legacyRecombiner, succeed, recombiner)) {
+                qDebug() << "Recombined mesh differs from the legacy implementation:" << name << "input:" << i;
+                ++mismatchCount;
+            }
+        }
+
+        size_t recombineCount = recordedInputs.size() * benchmark->iterations();
+        QElapsedTimer timer;
+
+        timer.start();
+        for (int i = 0; i < benchmark->iterations(); ++i) {
+            for (const auto &input: recordedInputs) {
+                LegacyMeshRecombiner legacyRecombiner;
+                recombine(legacyRecombiner, input);
+            }
+        }
+        qint64 legacyNanoseconds = timer.nsecsElapsed();
+
+        timer.restart();
+        for (int i = 0; i < benchmark->iterations(); ++i) {
+            for (const auto &input: recordedInputs) {
+                MeshRecombiner recombiner;
+                recombine(recombiner, input);
+            }
+        }
+        qint64 nanoseconds = timer.nsecsElapsed();
+
+        benchmark->addResult("meshRecombiner", name, "legacy.recombinesPerSecond", Benchmark::Kind::Rate,
+            legacyNanoseconds > 0 ? recombineCount * 1000000000.0 / legacyNanoseconds : 0.0);
+        benchmark->addResult("meshRecombiner", name, "halfEdge.recombinesPerSecond", Benchmark::Kind::Rate,
+            nanoseconds > 0 ? recombineCount * 1000000000.0 / nanoseconds : 0.0);
+        benchmark->addResult("meshRecombiner", name, "inputs", Benchmark::Kind::Count, recordedInputs.size());
+        benchmark->addResult("meshRecombiner", name, "recombined", Benchmark::Kind::Count, recombinedCount);
+        benchmark->addResult("meshRecombiner", name, "mismatches", Benchmark::Kind::Count, mismatchCount);
+    }
+}
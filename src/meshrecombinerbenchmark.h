@@ -0,0 +1,7 @@
+#ifndef DUST3D_MESH_RECOMBINER_BENCHMARK_H
+#define DUST3D_MESH_RECOMBINER_BENCHMARK_H
+#include "benchmark.h"
+
+void runMeshRecombinerBenchmark(Benchmark *benchmark);
+
+#endif
@@ -2,6 +2,7 @@
 #include "meshresultpostprocessor.h"
 #include "uvunwrap.h"
 #include "triangletangentresolve.h"
+#include "profiler.h"
 
 MeshResultPostProcessor::MeshResultPostProcessor(const Object &object)
 {
@@ -31,6 +32,7 @@ void MeshResultPostProcessor::poseProcess()
             std::vector<std::vector<QVector2D>> triangleVertexUvs;
             std::set<int> seamVertices;
             std::map<QUuid, std::vector<QRectF>> partUvRects;
+            ProfileScope profileScope("uvUnwrap");
             uvUnwrap(*m_object, triangleVertexUvs, seamVertices, partUvRects);
             m_object->setTriangleVertexUvs(triangleVertexUvs);
             m_object->setPartUvRects(partUvRects);
@@ -38,6 +40,7 @@ void MeshResultPostProcessor::poseProcess()
         
         {
             std::vector<QVector3D> triangleTangents;
+            ProfileScope profileScope("triangleTangentResolve");
             triangleTangentResolve(*m_object, triangleTangents);
             m_object->setTriangleTangents(triangleTangents);
         }
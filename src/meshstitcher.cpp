@@ -63,6 +63,11 @@ bool MeshStitcher::stitchByQuads(const std::vector<std::pair<std::vector<size_t>
 
 bool MeshStitcher::stitch(const std::vector<std::pair<std::vector<size_t>, QVector3D>> &edgeLoops)
 {
+    // Stitcher may be reused for multiple edge loop groups, drop the previous result
+    m_newlyGeneratedFaces.clear();
+    delete m_wrapper;
+    m_wrapper = nullptr;
+    
     if (edgeLoops.size() == 2 &&
             edgeLoops[0].first.size() == edgeLoops[1].first.size())
         return stitchByQuads(edgeLoops);
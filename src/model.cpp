@@ -1,77 +1,67 @@
 #include <assert.h>
 #include <QTextStream>
 #include <QFile>
+#include <QByteArray>
 #include <cmath>
+#include <algorithm>
 #include "model.h"
 #include "version.h"
 
 float Model::m_defaultMetalness = 0.0;
 float Model::m_defaultRoughness = 1.0;
 
+static std::shared_ptr<ShaderVertex> shareShaderVertices(ShaderVertex *vertices)
+{
+    return std::shared_ptr<ShaderVertex>(vertices, std::default_delete<ShaderVertex[]>());
+}
+
+template <class T>
+static const T &sharedOrEmpty(const std::shared_ptr<const T> &shared)
+{
+    static const T empty;
+    return nullptr == shared ? empty : *shared;
+}
+
 Model::Model(const Model &mesh) :
-    m_triangleVertices(nullptr),
-    m_triangleVertexCount(0),
-    m_edgeVertices(nullptr),
-    m_edgeVertexCount(0),
-    m_textureImage(nullptr)
-{
-    if (nullptr != mesh.m_triangleVertices &&
-            mesh.m_triangleVertexCount > 0) {
-        this->m_triangleVertices = new ShaderVertex[mesh.m_triangleVertexCount];
-        this->m_triangleVertexCount = mesh.m_triangleVertexCount;
-        for (int i = 0; i < mesh.m_triangleVertexCount; i++)
-            this->m_triangleVertices[i] = mesh.m_triangleVertices[i];
-    }
-    if (nullptr != mesh.m_edgeVertices &&
-            mesh.m_edgeVertexCount > 0) {
-        this->m_edgeVertices = new ShaderVertex[mesh.m_edgeVertexCount];
-        this->m_edgeVertexCount = mesh.m_edgeVertexCount;
-        for (int i = 0; i < mesh.m_edgeVertexCount; i++)
-            this->m_edgeVertices[i] = mesh.m_edgeVertices[i];
-    }
-    if (nullptr != mesh.m_toolVertices &&
-            mesh.m_toolVertexCount > 0) {
-        this->m_toolVertices = new ShaderVertex[mesh.m_toolVertexCount];
-        this->m_toolVertexCount = mesh.m_toolVertexCount;
-        for (int i = 0; i < mesh.m_toolVertexCount; i++)
-            this->m_toolVertices[i] = mesh.m_toolVertices[i];
-    }
-    if (nullptr != mesh.m_textureImage) {
-        this->m_textureImage = new QImage(*mesh.m_textureImage);
-    }
-    if (nullptr != mesh.m_normalMapImage) {
-        this->m_normalMapImage = new QImage(*mesh.m_normalMapImage);
-    }
-    if (nullptr != mesh.m_metalnessRoughnessAmbientOcclusionImage) {
-        this->m_metalnessRoughnessAmbientOcclusionImage = new QImage(*mesh.m_metalnessRoughnessAmbientOcclusionImage);
-        this->m_hasMetalnessInImage = mesh.m_hasMetalnessInImage;
-        this->m_hasRoughnessInImage = mesh.m_hasRoughnessInImage;
-        this->m_hasAmbientOcclusionInImage = mesh.m_hasAmbientOcclusionInImage;
-    }
-    this->m_vertices = mesh.m_vertices;
-    this->m_faces = mesh.m_faces;
-    this->m_triangulatedVertices = mesh.m_triangulatedVertices;
-    this->m_triangulatedFaces = mesh.m_triangulatedFaces;
-    this->m_meshId = mesh.meshId();
+    m_triangleVertices(mesh.m_triangleVertices),
+    m_triangleVertexCount(mesh.m_triangleVertexCount),
+    m_edgeVertices(mesh.m_edgeVertices),
+    m_edgeVertexCount(mesh.m_edgeVertexCount),
+    m_toolVertices(mesh.m_toolVertices),
+    m_toolVertexCount(mesh.m_toolVertexCount),
+    m_vertices(mesh.m_vertices),
+    m_faces(mesh.m_faces),
+    m_triangulatedVertices(mesh.m_triangulatedVertices),
+    m_triangulatedFaces(mesh.m_triangulatedFaces),
+    m_textureImage(mesh.m_textureImage),
+    m_normalMapImage(mesh.m_normalMapImage),
+    m_metalnessRoughnessAmbientOcclusionImage(mesh.m_metalnessRoughnessAmbientOcclusionImage),
+    m_hasMetalnessInImage(mesh.m_hasMetalnessInImage),
+    m_hasRoughnessInImage(mesh.m_hasRoughnessInImage),
+    m_hasAmbientOcclusionInImage(mesh.m_hasAmbientOcclusionInImage),
+    m_meshId(mesh.m_meshId)
+{
 }
 
 void Model::removeColor()
 {
-    delete this->m_textureImage;
-    this->m_textureImage = nullptr;
-    
-    delete this->m_normalMapImage;
-    this->m_normalMapImage = nullptr;
-    
-    delete this->m_metalnessRoughnessAmbientOcclusionImage;
-    this->m_metalnessRoughnessAmbientOcclusionImage = nullptr;
+    this->m_textureImage.reset();
+    this->m_normalMapImage.reset();
+    this->m_metalnessRoughnessAmbientOcclusionImage.reset();
     
     this->m_hasMetalnessInImage = false;
     this->m_hasRoughnessInImage = false;
     this->m_hasAmbientOcclusionInImage = false;
     
+    if (nullptr == this->m_triangleVertices)
+        return;
+    
+    // The vertices may still be shared with other copies, recolor a private one
+    ShaderVertex *triangleVertices = new ShaderVertex[this->m_triangleVertexCount];
+    std::copy(this->m_triangleVertices.get(), this->m_triangleVertices.get() + this->m_triangleVertexCount, triangleVertices);
+    this->m_triangleVertices = shareShaderVertices(triangleVertices);
     for (int i = 0; i < this->m_triangleVertexCount; ++i) {
-        auto &vertex = this->m_triangleVertices[i];
+        auto &vertex = triangleVertices[i];
         vertex.colorR = 1.0;
         vertex.colorG = 1.0;
         vertex.colorB = 1.0;
@@ -79,11 +69,10 @@ void Model::removeColor()
 }
 
 Model::Model(ShaderVertex *triangleVertices, int vertexNum, ShaderVertex *edgeVertices, int edgeVertexCount) :
-    m_triangleVertices(triangleVertices),
+    m_triangleVertices(shareShaderVertices(triangleVertices)),
     m_triangleVertexCount(vertexNum),
-    m_edgeVertices(edgeVertices),
-    m_edgeVertexCount(edgeVertexCount),
-    m_textureImage(nullptr)
+    m_edgeVertices(shareShaderVertices(edgeVertices)),
+    m_edgeVertexCount(edgeVertexCount)
 {
 }
 
@@ -94,14 +83,15 @@ Model::Model(const std::vector<QVector3D> &vertices, const std::vector<std::vect
     float roughness)
 {
     m_triangleVertexCount = triangles.size() * 3;
-    m_triangleVertices = new ShaderVertex[m_triangleVertexCount];
+    ShaderVertex *triangleVertices = new ShaderVertex[m_triangleVertexCount];
+    m_triangleVertices = shareShaderVertices(triangleVertices);
     int destIndex = 0;
     for (size_t i = 0; i < triangles.size(); ++i) {
         for (auto j = 0; j < 3; j++) {
             int vertexIndex = triangles[i][j];
             const QVector3D *srcVert = &vertices[vertexIndex];
             const QVector3D *srcNormal = &(triangleVertexNormals)[i][j];
-            ShaderVertex *dest = &m_triangleVertices[destIndex];
+            ShaderVertex *dest = &triangleVertices[destIndex];
             dest->colorR = color.redF();
             dest->colorG = color.greenF();
             dest->colorB = color.blueF();
@@ -124,19 +114,15 @@ Model::Model(const std::vector<QVector3D> &vertices, const std::vector<std::vect
     }
 }
 
-Model::Model(Object &object) :
-    m_triangleVertices(nullptr),
-    m_triangleVertexCount(0),
-    m_edgeVertices(nullptr),
-    m_edgeVertexCount(0),
-    m_textureImage(nullptr)
+Model::Model(Object &object)
 {
     m_meshId = object.meshId;
-    m_vertices = object.vertices;
-    m_faces = object.triangleAndQuads;
+    m_vertices = std::make_shared<const std::vector<QVector3D>>(object.vertices);
+    m_faces = std::make_shared<const std::vector<std::vector<size_t>>>(object.triangleAndQuads);
     
     m_triangleVertexCount = object.triangles.size() * 3;
-    m_triangleVertices = new ShaderVertex[m_triangleVertexCount];
+    ShaderVertex *triangleVertices = new ShaderVertex[m_triangleVertexCount];
+    m_triangleVertices = shareShaderVertices(triangleVertices);
     int destIndex = 0;
     const auto triangleVertexNormals = object.triangleVertexNormals();
     const auto triangleVertexUvs = object.triangleVertexUvs();
@@ -158,7 +144,7 @@ Model::Model(Object &object) :
             const QVector3D *srcTangent = &defaultTangent;
             if (triangleTangents)
                 srcTangent = &(*triangleTangents)[i];
-            ShaderVertex *dest = &m_triangleVertices[destIndex];
+            ShaderVertex *dest = &triangleVertices[destIndex];
             dest->colorR = triangleColor->redF();
             dest->colorG = triangleColor->greenF();
             dest->colorB = triangleColor->blueF();
@@ -185,7 +171,8 @@ Model::Model(Object &object) :
         edgeCount += face.size();
     }
     m_edgeVertexCount = edgeCount * 2;
-    m_edgeVertices = new ShaderVertex[m_edgeVertexCount];
+    ShaderVertex *edgeVertices = new ShaderVertex[m_edgeVertexCount];
+    m_edgeVertices = shareShaderVertices(edgeVertices);
     size_t edgeVertexIndex = 0;
     for (size_t faceIndex = 0; faceIndex < object.triangleAndQuads.size(); ++faceIndex) {
         const auto &face = object.triangleAndQuads[faceIndex];
@@ -193,7 +180,7 @@ Model::Model(Object &object) :
             for (size_t x = 0; x < 2; ++x) {
                 size_t sourceIndex = face[(i + x) % face.size()];
                 const QVector3D *srcVert = &object.vertices[sourceIndex];
-                ShaderVertex *dest = &m_edgeVertices[edgeVertexIndex];
+                ShaderVertex *dest = &edgeVertices[edgeVertexIndex];
                 memset(dest, 0, sizeof(ShaderVertex));
                 dest->colorR = 0.0;
                 dest->colorG = 0.0;
@@ -210,51 +197,37 @@ Model::Model(Object &object) :
     }
 }
 
-Model::Model() :
-    m_triangleVertices(nullptr),
-    m_triangleVertexCount(0),
-    m_edgeVertices(nullptr),
-    m_edgeVertexCount(0),
-    m_textureImage(nullptr)
+Model::Model()
 {
 }
 
 Model::~Model()
 {
-    delete[] m_triangleVertices;
-    m_triangleVertexCount = 0;
-    delete[] m_edgeVertices;
-    m_edgeVertexCount = 0;
-    delete[] m_toolVertices;
-    m_toolVertexCount = 0;
-    delete m_textureImage;
-    delete m_normalMapImage;
-    delete m_metalnessRoughnessAmbientOcclusionImage;
 }
 
 const std::vector<QVector3D> &Model::vertices()
 {
-    return m_vertices;
+    return sharedOrEmpty(m_vertices);
 }
 
 const std::vector<std::vector<size_t>> &Model::faces()
 {
-    return m_faces;
+    return sharedOrEmpty(m_faces);
 }
 
 const std::vector<QVector3D> &Model::triangulatedVertices()
 {
-    return m_triangulatedVertices;
+    return sharedOrEmpty(m_triangulatedVertices);
 }
 
 const std::vector<TriangulatedFace> &Model::triangulatedFaces()
 {
-    return m_triangulatedFaces;
+    return sharedOrEmpty(m_triangulatedFaces);
 }
 
 ShaderVertex *Model::triangleVertices()
 {
-    return m_triangleVertices;
+    return m_triangleVertices.get();
 }
 
 int Model::triangleVertexCount()
@@ -264,7 +237,7 @@ int Model::triangleVertexCount()
 
 ShaderVertex *Model::edgeVertices()
 {
-    return m_edgeVertices;
+    return m_edgeVertices.get();
 }
 
 int Model::edgeVertexCount()
@@ -274,7 +247,7 @@ int Model::edgeVertexCount()
 
 ShaderVertex *Model::toolVertices()
 {
-    return m_toolVertices;
+    return m_toolVertices.get();
 }
 
 int Model::toolVertexCount()
@@ -284,32 +257,32 @@ int Model::toolVertexCount()
 
 void Model::setTextureImage(QImage *textureImage)
 {
-    m_textureImage = textureImage;
+    m_textureImage.reset(textureImage);
 }
 
 const QImage *Model::textureImage()
 {
-    return m_textureImage;
+    return m_textureImage.get();
 }
 
 void Model::setNormalMapImage(QImage *normalMapImage)
 {
-    m_normalMapImage = normalMapImage;
+    m_normalMapImage.reset(normalMapImage);
 }
 
 const QImage *Model::normalMapImage()
 {
-    return m_normalMapImage;
+    return m_normalMapImage.get();
 }
 
 const QImage *Model::metalnessRoughnessAmbientOcclusionImage()
 {
-    return m_metalnessRoughnessAmbientOcclusionImage;
+    return m_metalnessRoughnessAmbientOcclusionImage.get();
 }
 
 void Model::setMetalnessRoughnessAmbientOcclusionImage(QImage *image)
 {
-    m_metalnessRoughnessAmbientOcclusionImage = image;
+    m_metalnessRoughnessAmbientOcclusionImage.reset(image);
 }
 
 bool Model::hasMetalnessInImage()
@@ -342,59 +315,108 @@ void Model::setHasAmbientOcclusionInImage(bool hasInImage)
     m_hasAmbientOcclusionInImage = hasInImage;
 }
 
-void Model::exportAsObj(QTextStream *textStream)
+// Formatting through QTextStream dominates the OBJ export of big meshes,
+// so numbers are written into a plain buffer instead
+static void appendObjInteger(QByteArray &buffer, qint64 value)
+{
+    char digits[24];
+    int length = 0;
+    bool negative = value < 0;
+    quint64 magnitude = negative ? (quint64)(-(value + 1)) + 1 : (quint64)value;
+    do {
+        digits[length++] = '0' + (char)(magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (negative)
+        buffer.append('-');
+    while (length > 0)
+        buffer.append(digits[--length]);
+}
+
+static void appendObjFloat(QByteArray &buffer, float value)
 {
-    auto &stream = *textStream;
-    stream << "# " << APP_NAME << " " << APP_HUMAN_VER << endl;
-    stream << "# " << APP_HOMEPAGE_URL << endl;
-    for (std::vector<QVector3D>::const_iterator it = vertices().begin() ; it != vertices().end(); ++it) {
-        stream << "v " << (*it).x() << " " << (*it).y() << " " << (*it).z() << endl;
+    if (!std::isfinite(value)) {
+        buffer.append('0');
+        return;
+    }
+    // Six decimals, trailing zeros trimmed
+    qint64 scaled = (qint64)std::llround((double)value * 1000000.0);
+    if (scaled < 0) {
+        buffer.append('-');
+        scaled = -scaled;
+    }
+    appendObjInteger(buffer, scaled / 1000000);
+    int fraction = (int)(scaled % 1000000);
+    if (0 == fraction)
+        return;
+    char digits[7] = {'.'};
+    int length = 7;
+    for (int i = 6; i >= 1; --i) {
+        digits[i] = '0' + (char)(fraction % 10);
+        fraction /= 10;
+    }
+    while ('0' == digits[length - 1])
+        --length;
+    buffer.append(digits, length);
+}
+
+void Model::exportAsObj(QByteArray *buffer)
+{
+    auto &output = *buffer;
+    output.reserve(output.size() + (int)vertices().size() * 32 + (int)faces().size() * 28);
+    output.append(QString("# %1 %2\n").arg(APP_NAME).arg(APP_HUMAN_VER).toUtf8());
+    output.append(QString("# %1\n").arg(APP_HOMEPAGE_URL).toUtf8());
+    for (const auto &it: vertices()) {
+        output.append("v ", 2);
+        appendObjFloat(output, it.x());
+        output.append(' ');
+        appendObjFloat(output, it.y());
+        output.append(' ');
+        appendObjFloat(output, it.z());
+        output.append('\n');
     }
-    for (std::vector<std::vector<size_t>>::const_iterator it = faces().begin() ; it != faces().end(); ++it) {
-        stream << "f";
-        for (std::vector<size_t>::const_iterator subIt = (*it).begin() ; subIt != (*it).end(); ++subIt) {
-            stream << " " << (1 + *subIt);
+    for (const auto &it: faces()) {
+        output.append('f');
+        for (const auto &subIt: it) {
+            output.append(' ');
+            appendObjInteger(output, (qint64)(1 + subIt));
         }
-        stream << endl;
+        output.append('\n');
     }
 }
 
+void Model::exportAsObj(QTextStream *textStream)
+{
+    QByteArray buffer;
+    exportAsObj(&buffer);
+    *textStream << QString::fromUtf8(buffer.constData(), buffer.size());
+}
+
 void Model::exportAsObj(const QString &filename)
 {
     QFile file(filename);
     if (file.open(QIODevice::WriteOnly)) {
-        QTextStream stream(&file);
-        exportAsObj(&stream);
+        QByteArray buffer;
+        exportAsObj(&buffer);
+        file.write(buffer);
     }
 }
 
 void Model::updateTool(ShaderVertex *toolVertices, int vertexNum)
 {
-    delete[] m_toolVertices;
-    m_toolVertices = nullptr;
-    m_toolVertexCount = 0;
-    
-    m_toolVertices = toolVertices;
+    m_toolVertices = shareShaderVertices(toolVertices);
     m_toolVertexCount = vertexNum;
 }
 
 void Model::updateEdges(ShaderVertex *edgeVertices, int edgeVertexCount)
 {
-    delete[] m_edgeVertices;
-    m_edgeVertices = nullptr;
-    m_edgeVertexCount = 0;
-    
-    m_edgeVertices = edgeVertices;
+    m_edgeVertices = shareShaderVertices(edgeVertices);
     m_edgeVertexCount = edgeVertexCount;
 }
 
 void Model::updateTriangleVertices(ShaderVertex *triangleVertices, int triangleVertexCount)
 {
-    delete[] m_triangleVertices;
-    m_triangleVertices = 0;
-    m_triangleVertexCount = 0;
-    
-    m_triangleVertices = triangleVertices;
+    m_triangleVertices = shareShaderVertices(triangleVertices);
     m_triangleVertexCount = triangleVertexCount;
 }
 
@@ -6,6 +6,7 @@
 #include <QColor>
 #include <QImage>
 #include <QTextStream>
+#include <memory>
 #include "object.h"
 #include "shadervertex.h"
 
@@ -54,6 +55,7 @@ public:
     static float m_defaultRoughness;
     void exportAsObj(const QString &filename);
     void exportAsObj(QTextStream *textStream);
+    void exportAsObj(QByteArray *buffer);
     void updateTool(ShaderVertex *toolVertices, int vertexNum);
     void updateEdges(ShaderVertex *edgeVertices, int edgeVertexCount);
     void updateTriangleVertices(ShaderVertex *triangleVertices, int triangleVertexCount);
@@ -61,19 +63,21 @@ public:
     void setMeshId(quint64 id);
     void removeColor();
 private:
-    ShaderVertex *m_triangleVertices = nullptr;
+    // Geometry and images are shared between copies and never modified in place,
+    // so handing a model to a widget or an exporter doesn't duplicate the buffers
+    std::shared_ptr<ShaderVertex> m_triangleVertices;
     int m_triangleVertexCount = 0;
-    ShaderVertex *m_edgeVertices = nullptr;
+    std::shared_ptr<ShaderVertex> m_edgeVertices;
     int m_edgeVertexCount = 0;
-    ShaderVertex *m_toolVertices = nullptr;
+    std::shared_ptr<ShaderVertex> m_toolVertices;
     int m_toolVertexCount = 0;
-    std::vector<QVector3D> m_vertices;
-    std::vector<std::vector<size_t>> m_faces;
-    std::vector<QVector3D> m_triangulatedVertices;
-    std::vector<TriangulatedFace> m_triangulatedFaces;
-    QImage *m_textureImage = nullptr;
-    QImage *m_normalMapImage = nullptr;
-    QImage *m_metalnessRoughnessAmbientOcclusionImage = nullptr;
+    std::shared_ptr<const std::vector<QVector3D>> m_vertices;
+    std::shared_ptr<const std::vector<std::vector<size_t>>> m_faces;
+    std::shared_ptr<const std::vector<QVector3D>> m_triangulatedVertices;
+    std::shared_ptr<const std::vector<TriangulatedFace>> m_triangulatedFaces;
+    std::shared_ptr<const QImage> m_textureImage;
+    std::shared_ptr<const QImage> m_normalMapImage;
+    std::shared_ptr<const QImage> m_metalnessRoughnessAmbientOcclusionImage;
     bool m_hasMetalnessInImage = false;
     bool m_hasRoughnessInImage = false;
     bool m_hasAmbientOcclusionInImage = false;
@@ -11,6 +11,7 @@
 #include "simpleshaderwidget.h"
 #include "simplerendermeshgenerator.h"
 #include "motionsgenerator.h"
+#include "motionpreview.h"
 #include "util.h"
 #include "version.h"
 #include "vertebratamovemotionparameterswidget.h"
@@ -18,8 +19,7 @@
 
 MotionEditWidget::~MotionEditWidget()
 {
-    for (auto &it: m_frames)
-        delete it;
+    delete m_preview;
     while (!m_renderQueue.empty()) {
         delete m_renderQueue.front();
         m_renderQueue.pop();
@@ -76,13 +76,13 @@ MotionEditWidget::MotionEditWidget()
             checkRenderQueue();
             return;
         }
-        if (this->m_frames.empty())
+        if (nullptr == this->m_preview || 0 == this->m_preview->frameCount())
             return;
-        if (this->m_frameIndex < this->m_frames.size()) {
-            m_renderQueue.push(new SimpleShaderMesh(*this->m_frames[this->m_frameIndex]));
+        if (this->m_frameIndex < this->m_preview->frameCount()) {
+            m_renderQueue.push(this->m_preview->createFrameMesh(this->m_frameIndex));
             checkRenderQueue();
         }
-        this->m_frameIndex = (this->m_frameIndex + 1) % this->m_frames.size();
+        this->m_frameIndex = (this->m_frameIndex + 1) % this->m_preview->frameCount();
     });
     timer->start();
     
@@ -189,7 +189,7 @@ void MotionEditWidget::save()
 
 void MotionEditWidget::updateBones(RigType rigType,
     const std::vector<RigBone> *rigBones,
-    const std::map<int, RigVertexWeights> *rigWeights,
+    const RigWeights *rigWeights,
     const Object *object)
 {
     m_rigType = rigType;
@@ -207,7 +207,7 @@ void MotionEditWidget::updateBones(RigType rigType,
             nullptr != rigWeights &&
             nullptr != object) {
         m_bones = new std::vector<RigBone>(*rigBones);
-        m_rigWeights = new std::map<int, RigVertexWeights>(*rigWeights);
+        m_rigWeights = new RigWeights(*rigWeights);
         m_object = new Object(*object);
         
         generatePreview();
@@ -241,14 +241,8 @@ void MotionEditWidget::generatePreview()
 
 void MotionEditWidget::previewReady()
 {
-    for (auto &it: m_frames)
-        delete it;
-    m_frames.clear();
-    
-    std::vector<std::pair<float, SimpleShaderMesh *>> frames = m_previewGenerator->takeResultPreviewMeshes(QUuid());
-    for (const auto &frame: frames) {
-        m_frames.push_back(frame.second);
-    }
+    delete m_preview;
+    m_preview = m_previewGenerator->takeResultPreview(QUuid());
     
     delete m_previewGenerator;
     m_previewGenerator = nullptr;
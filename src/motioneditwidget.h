@@ -13,6 +13,7 @@
 class SimpleShaderWidget;
 class MotionsGenerator;
 class SimpleShaderMesh;
+class MotionPreview;
 class QScrollArea;
 
 class MotionEditWidget : public QMainWindow
@@ -33,7 +34,7 @@ public slots:
     void previewReady();
     void updateBones(RigType rigType,
         const std::vector<RigBone> *rigBones,
-        const std::map<int, RigVertexWeights> *rigWeights,
+        const RigWeights *rigWeights,
         const Object *object);
     void setEditMotionName(const QString &name);
     void setEditMotionId(const QUuid &motionId);
@@ -53,11 +54,11 @@ private:
     std::queue<SimpleShaderMesh *> m_renderQueue;
     MotionsGenerator *m_previewGenerator = nullptr;
     bool m_isPreviewObsolete = false;
-    std::vector<SimpleShaderMesh *> m_frames;
+    MotionPreview *m_preview = nullptr;
     size_t m_frameIndex = 0;
     RigType m_rigType = RigType::None;
     std::vector<RigBone> *m_bones = nullptr;
-    std::map<int, RigVertexWeights> *m_rigWeights = nullptr;
+    RigWeights *m_rigWeights = nullptr;
     Object *m_object = nullptr;
     QLineEdit *m_nameEdit = nullptr;
     bool m_unsaved = false;
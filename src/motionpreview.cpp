@@ -0,0 +1,108 @@
+#include "motionpreview.h"
+#include "blockmesh.h"
+
+MotionPreview::MotionPreview(const Object &object, const RigWeights &rigWeights, float groundPlaneY) :
+    m_triangles(object.triangles),
+    m_groundPlaneY(groundPlaneY)
+{
+    m_skinningVertices.prepare(object.vertices, rigWeights);
+    const std::vector<std::vector<QVector3D>> *triangleVertexNormals = object.triangleVertexNormals();
+    if (nullptr != triangleVertexNormals) {
+        m_triangleVertexNormals = *triangleVertexNormals;
+        m_hasTriangleVertexNormals = true;
+    }
+}
+
+void MotionPreview::addFrame(float duration,
+    const std::vector<SkinningMatrix> &skinningMatrices,
+    const std::vector<BoneBlock> &boneBlocks)
+{
+    m_frames.push_back(Frame());
+    Frame &frame = m_frames.back();
+    frame.duration = duration;
+    frame.skinningMatrices = skinningMatrices;
+    
+    BlockMesh blockMesh;
+    blockMesh.addBlock(
+        QVector3D(0.0, m_groundPlaneY, 0.0), 100.0,
+        QVector3D(0.0, m_groundPlaneY - 0.02, 0.0), 100.0);
+    for (const auto &boneBlock: boneBlocks) {
+        blockMesh.addBlock(boneBlock.headPosition, boneBlock.headRadius,
+            boneBlock.tailPosition, boneBlock.tailRadius);
+    }
+    blockMesh.build();
+    std::vector<QVector3D> *resultVertices = blockMesh.takeResultVertices();
+    std::vector<std::vector<size_t>> *resultFaces = blockMesh.takeResultFaces();
+    frame.overlayVertices.reserve(resultVertices->size());
+    for (const auto &v: *resultVertices)
+        frame.overlayVertices.push_back(QVector3D(v.x() - 0.5, v.y(), v.z()));
+    frame.overlayFaces = *resultFaces;
+    frame.overlayFaceNormals.reserve(resultFaces->size());
+    for (const auto &f: *resultFaces) {
+        frame.overlayFaceNormals.push_back(QVector3D::normal(
+            (*resultVertices)[f[0]],
+            (*resultVertices)[f[1]],
+            (*resultVertices)[f[2]]
+        ));
+    }
+    delete resultFaces;
+    delete resultVertices;
+}
+
+size_t MotionPreview::frameCount() const
+{
+    return m_frames.size();
+}
+
+float MotionPreview::frameDuration(size_t frameIndex) const
+{
+    if (frameIndex >= m_frames.size())
+        return 0.0;
+    return m_frames[frameIndex].duration;
+}
+
+SimpleShaderMesh *MotionPreview::createFrameMesh(size_t frameIndex) const
+{
+    if (frameIndex >= m_frames.size())
+        return nullptr;
+    
+    const auto &frame = m_frames[frameIndex];
+    
+    std::vector<QVector3D> *frameVertices = new std::vector<QVector3D>;
+    skinVertices(m_skinningVertices, frame.skinningMatrices, *frameVertices);
+    
+    std::vector<std::vector<size_t>> *frameFaces = new std::vector<std::vector<size_t>>(m_triangles);
+    std::vector<std::vector<QVector3D>> *frameCornerNormals = nullptr;
+    if (m_hasTriangleVertexNormals) {
+        frameCornerNormals = new std::vector<std::vector<QVector3D>>(m_triangleVertexNormals);
+    } else {
+        frameCornerNormals = new std::vector<std::vector<QVector3D>>(m_triangles.size());
+        for (size_t i = 0; i < m_triangles.size(); ++i) {
+            const auto &triangle = m_triangles[i];
+            QVector3D triangleNormal = QVector3D::normal(
+                (*frameVertices)[triangle[0]],
+                (*frameVertices)[triangle[1]],
+                (*frameVertices)[triangle[2]]
+            );
+            (*frameCornerNormals)[i] = {
+                triangleNormal, triangleNormal, triangleNormal
+            };
+        }
+    }
+    
+    size_t oldVertexCount = frameVertices->size();
+    frameVertices->insert(frameVertices->end(), frame.overlayVertices.begin(), frame.overlayVertices.end());
+    for (size_t i = 0; i < frame.overlayFaces.size(); ++i) {
+        std::vector<size_t> newF = frame.overlayFaces[i];
+        for (auto &v: newF)
+            v += oldVertexCount;
+        frameFaces->push_back(newF);
+        
+        const QVector3D &triangleNormal = frame.overlayFaceNormals[i];
+        frameCornerNormals->push_back({
+            triangleNormal, triangleNormal, triangleNormal
+        });
+    }
+    
+    return new SimpleShaderMesh(frameVertices, frameFaces, frameCornerNormals);
+}
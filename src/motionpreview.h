@@ -0,0 +1,50 @@
+#ifndef DUST3D_MOTION_PREVIEW_H
+#define DUST3D_MOTION_PREVIEW_H
+#include <QVector3D>
+#include <vector>
+#include "object.h"
+#include "rig.h"
+#include "skinning.h"
+#include "simpleshadermesh.h"
+
+// Animation preview kept as one bind mesh plus per frame bone matrices and bone overlay,
+// frame meshes are skinned on demand when played back
+class MotionPreview
+{
+public:
+    struct BoneBlock
+    {
+        QVector3D headPosition;
+        float headRadius;
+        QVector3D tailPosition;
+        float tailRadius;
+    };
+    
+    MotionPreview(const Object &object, const RigWeights &rigWeights, float groundPlaneY);
+    void addFrame(float duration,
+        const std::vector<SkinningMatrix> &skinningMatrices,
+        const std::vector<BoneBlock> &boneBlocks);
+    size_t frameCount() const;
+    float frameDuration(size_t frameIndex) const;
+    SimpleShaderMesh *createFrameMesh(size_t frameIndex) const;
+    
+private:
+    struct Frame
+    {
+        float duration;
+        std::vector<SkinningMatrix> skinningMatrices;
+        // Ground plane and bone blocks, built once when the frame is added
+        std::vector<QVector3D> overlayVertices;
+        std::vector<std::vector<size_t>> overlayFaces;
+        std::vector<QVector3D> overlayFaceNormals;
+    };
+    
+    SkinningVertices m_skinningVertices;
+    std::vector<std::vector<size_t>> m_triangles;
+    std::vector<std::vector<QVector3D>> m_triangleVertexNormals;
+    bool m_hasTriangleVertexNormals = false;
+    float m_groundPlaneY = 0.0;
+    std::vector<Frame> m_frames;
+};
+
+#endif
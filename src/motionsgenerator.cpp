@@ -1,3 +1,5 @@
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 #include <QGuiApplication>
 #include <QElapsedTimer>
 #include <cmath>
@@ -5,19 +7,72 @@
 #include <QMatrix4x4>
 #include "motionsgenerator.h"
 #include "vertebratamovemotionbuilder.h"
-#include "blockmesh.h"
 #include "vertebratamovemotionparameterswidget.h"
 #include "util.h"
+#include "profiler.h"
+#include "skinning.h"
+
+class MotionsGenerator::MotionWorker
+{
+public:
+    MotionWorker(const MotionsGenerator *generator,
+            const std::vector<const std::pair<const QUuid, std::map<QString, QString>> *> *motions,
+            std::vector<MotionResult> *motionResults) :
+        m_generator(generator),
+        m_motions(motions),
+        m_motionResults(motionResults)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t i = range.begin(); i != range.end(); ++i)
+            m_generator->generateMotion((*m_motions)[i]->second, &(*m_motionResults)[i]);
+    }
+private:
+    const MotionsGenerator *m_generator = nullptr;
+    const std::vector<const std::pair<const QUuid, std::map<QString, QString>> *> *m_motions = nullptr;
+    std::vector<MotionResult> *m_motionResults = nullptr;
+};
+
+class MotionsGenerator::FrameWorker
+{
+public:
+    FrameWorker(const MotionsGenerator *generator,
+            const std::vector<std::vector<MotionBuilder::Node>> *frames,
+            const std::vector<QMatrix4x4> *bindTransforms,
+            std::vector<FrameResult> *frameResults) :
+        m_generator(generator),
+        m_frames(frames),
+        m_bindTransforms(bindTransforms),
+        m_frameResults(frameResults)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t i = range.begin(); i != range.end(); ++i) {
+            bool generateSnapshot = m_generator->m_snapshotMeshesEnabled &&
+                i == m_frames->size() / 2;
+            m_generator->generateFrame((*m_frames)[i], *m_bindTransforms,
+                generateSnapshot, &(*m_frameResults)[i]);
+        }
+    }
+private:
+    const MotionsGenerator *m_generator = nullptr;
+    const std::vector<std::vector<MotionBuilder::Node>> *m_frames = nullptr;
+    const std::vector<QMatrix4x4> *m_bindTransforms = nullptr;
+    std::vector<FrameResult> *m_frameResults = nullptr;
+};
 
 MotionsGenerator::MotionsGenerator(RigType rigType,
         const std::vector<RigBone> &bones,
-        const std::map<int, RigVertexWeights> &rigWeights,
+        const RigWeights &rigWeights,
         const Object &object) :
     m_rigType(rigType),
     m_bones(bones),
     m_rigWeights(rigWeights),
     m_object(object)
 {
+    m_skinningVertices.prepare(m_object.vertices, m_rigWeights);
 }
 
 MotionsGenerator::~MotionsGenerator()
@@ -25,11 +80,8 @@ MotionsGenerator::~MotionsGenerator()
     for (auto &it: m_resultSnapshotMeshes)
         delete it.second;
     
-    for (auto &item: m_resultPreviewMeshes) {
-        for (auto &subItem: item.second) {
-            delete subItem.second;
-        }
-    }
+    for (auto &it: m_resultPreviews)
+        delete it.second;
 }
 
 void MotionsGenerator::enablePreviewMeshes()
@@ -62,13 +114,13 @@ Model *MotionsGenerator::takeResultSnapshotMesh(const QUuid &motionId)
     return result;
 }
 
-std::vector<std::pair<float, SimpleShaderMesh *>> MotionsGenerator::takeResultPreviewMeshes(const QUuid &motionId)
+MotionPreview *MotionsGenerator::takeResultPreview(const QUuid &motionId)
 {
-    auto findResult = m_resultPreviewMeshes.find(motionId);
-    if (findResult == m_resultPreviewMeshes.end())
-        return {};
+    auto findResult = m_resultPreviews.find(motionId);
+    if (findResult == m_resultPreviews.end())
+        return nullptr;
     auto result = findResult->second;
-    m_resultPreviewMeshes.erase(findResult);
+    m_resultPreviews.erase(findResult);
     return result;
 }
 
@@ -80,7 +132,7 @@ std::vector<std::pair<float, JointNodeTree>> MotionsGenerator::takeResultJointNo
     return findResult->second;
 }
         
-void MotionsGenerator::generateMotion(const QUuid &motionId)
+void MotionsGenerator::generateMotion(const std::map<QString, QString> &motionParameters, MotionResult *result) const
 {
     if (m_bones.empty())
         return;
@@ -178,7 +230,7 @@ void MotionsGenerator::generateMotion(const QUuid &motionId)
     VertebrataMoveMotionBuilder *vertebrataMoveMotionBuilder = new VertebrataMoveMotionBuilder;
     
     VertebrataMoveMotionBuilder::Parameters parameters = 
-        VertebrataMoveMotionParametersWidget::toVertebrataMoveMotionParameters(m_motions[motionId]);
+        VertebrataMoveMotionParametersWidget::toVertebrataMoveMotionParameters(motionParameters);
     if ("Vertical" == valueOfKeyInMapOrEmpty(m_bones[0].attributes, "spineDirection"))
         parameters.biped = true;
     vertebrataMoveMotionBuilder->setParameters(parameters);
@@ -230,10 +282,6 @@ void MotionsGenerator::generateMotion(const QUuid &motionId)
     vertebrataMoveMotionBuilder->setGroundY(groundY);
     vertebrataMoveMotionBuilder->generate();
     
-    std::vector<std::pair<float, JointNodeTree>> jointNodeTrees;
-    std::vector<std::pair<float, SimpleShaderMesh *>> previewMeshes;
-    Model *snapshotMesh = nullptr;
-    
     std::vector<QMatrix4x4> bindTransforms(m_bones.size());
     for (size_t i = 0; i < m_bones.size(); ++i) {
         const auto &bone = m_bones[i];
@@ -250,171 +298,158 @@ void MotionsGenerator::generateMotion(const QUuid &motionId)
     }
     
     const auto &vertebrataMoveMotionBuilderFrames = vertebrataMoveMotionBuilder->frames();
-    for (size_t frameIndex = 0; frameIndex < vertebrataMoveMotionBuilderFrames.size(); ++frameIndex) {
-        const auto &frame = vertebrataMoveMotionBuilderFrames[frameIndex];
-        std::vector<RigBone> transformedBones = m_bones;
-        for (const auto &node: frame) {
-            if (-1 == node.boneIndex)
-                continue;
-            if (node.isTail) {
-                transformedBones[node.boneIndex].tailPosition = node.position;
-                for (const auto &childIndex: m_bones[node.boneIndex].children)
+    std::vector<FrameResult> frameResults(vertebrataMoveMotionBuilderFrames.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, vertebrataMoveMotionBuilderFrames.size()),
+        FrameWorker(this, &vertebrataMoveMotionBuilderFrames, &bindTransforms, &frameResults));
+    delete vertebrataMoveMotionBuilder;
+    
+    if (m_previewMeshesEnabled)
+        result->preview = new MotionPreview(m_object, m_rigWeights, groundY + parameters.groundOffset);
+    for (auto &frameResult: frameResults) {
+        result->jointNodeTrees.push_back({0.017f, frameResult.jointNodeTree});
+        if (nullptr != result->preview)
+            result->preview->addFrame(0.017f, frameResult.skinningMatrices, frameResult.boneBlocks);
+        if (nullptr != frameResult.snapshotMesh)
+            result->snapshotMesh = frameResult.snapshotMesh;
+    }
+}
+
+void MotionsGenerator::generateFrame(const std::vector<MotionBuilder::Node> &frame,
+        const std::vector<QMatrix4x4> &bindTransforms,
+        bool generateSnapshot,
+        FrameResult *result) const
+{
+    std::vector<RigBone> transformedBones = m_bones;
+    for (const auto &node: frame) {
+        if (-1 == node.boneIndex)
+            continue;
+        if (node.isTail) {
+            transformedBones[node.boneIndex].tailPosition = node.position;
+            for (const auto &childIndex: m_bones[node.boneIndex].children)
+                transformedBones[childIndex].headPosition = node.position;
+        } else {
+            transformedBones[node.boneIndex].headPosition = node.position;
+            auto parentIndex = m_bones[node.boneIndex].parent;
+            if (-1 != parentIndex) {
+                transformedBones[parentIndex].tailPosition = node.position;
+                for (const auto &childIndex: m_bones[parentIndex].children)
                     transformedBones[childIndex].headPosition = node.position;
-            } else {
-                transformedBones[node.boneIndex].headPosition = node.position;
-                auto parentIndex = m_bones[node.boneIndex].parent;
-                if (-1 != parentIndex) {
-                    transformedBones[parentIndex].tailPosition = node.position;
-                    for (const auto &childIndex: m_bones[parentIndex].children)
-                        transformedBones[childIndex].headPosition = node.position;
-                }
-            }
-        }
-        
-        std::vector<QMatrix4x4> poseTransforms(transformedBones.size());
-        std::vector<QMatrix4x4> poseRotations(transformedBones.size());
-        for (size_t i = 0; i < transformedBones.size(); ++i) {
-            const auto &oldBone = m_bones[i];
-            const auto &bone = transformedBones[i];
-            QMatrix4x4 parentMatrix;
-            QMatrix4x4 translationMatrix;
-            QMatrix4x4 rotationMatrix;
-            QMatrix4x4 parentRotation;
-            if (-1 != bone.parent) {
-                const auto &oldParentBone = m_bones[oldBone.parent];
-                parentMatrix = poseTransforms[bone.parent];
-                parentRotation = poseRotations[bone.parent];
-                translationMatrix.translate(oldBone.headPosition - oldParentBone.headPosition);
-                QQuaternion rotation = QQuaternion::rotationTo((oldBone.tailPosition - oldBone.headPosition).normalized(),
-                    (bone.tailPosition - bone.headPosition).normalized());
-                rotationMatrix.rotate(rotation);
-            } else {
-                translationMatrix.translate(bone.headPosition + (bone.tailPosition - oldBone.tailPosition));
             }
-            poseTransforms[i] = parentMatrix * translationMatrix * parentRotation.inverted() * rotationMatrix;
-            poseRotations[i] = rotationMatrix;
         }
-        
-        JointNodeTree jointNodeTree(&m_bones);
-        for (size_t i = 0; i < m_bones.size(); ++i) {
-            const auto &bone = transformedBones[i];
-            if (-1 != bone.parent) {
-                jointNodeTree.updateMatrix(i, poseTransforms[bone.parent].inverted() * poseTransforms[i]);
-            } else {
-                jointNodeTree.updateMatrix(i, poseTransforms[i]);
-            }
-        }
-        
-        jointNodeTrees.push_back({0.017f, jointNodeTree});
-        
-        const std::vector<JointNode> &jointNodes = jointNodeTree.nodes();
-        std::vector<QMatrix4x4> jointNodeMatrices(m_bones.size());
-        for (size_t i = 0; i < m_bones.size(); ++i) {
-            const auto &bone = transformedBones[i];
-            QMatrix4x4 translationMatrix;
-            translationMatrix.translate(jointNodes[i].translation);
-            QMatrix4x4 rotationMatrix;
-            rotationMatrix.rotate(jointNodes[i].rotation);
-            if (-1 != bone.parent) {
-                jointNodeMatrices[i] *= jointNodeMatrices[bone.parent];
-            }
-            jointNodeMatrices[i] *= translationMatrix * rotationMatrix;
-        }
-        for (size_t i = 0; i < m_bones.size(); ++i)
-            jointNodeMatrices[i] = jointNodeMatrices[i] * bindTransforms[i].inverted();
-        
-        std::vector<QVector3D> transformedVertices(m_object.vertices.size());
-        for (size_t i = 0; i < m_object.vertices.size(); ++i) {
-            const auto &weight = m_rigWeights[i];
-            for (int x = 0; x < MAX_WEIGHT_NUM; x++) {
-                float factor = weight.boneWeights[x];
-                if (factor > 0) {
-                    transformedVertices[i] += jointNodeMatrices[weight.boneIndices[x]] * m_object.vertices[i] * factor;
-                }
-            }
+    }
+    
+    std::vector<QMatrix4x4> poseTransforms(transformedBones.size());
+    std::vector<QMatrix4x4> poseRotations(transformedBones.size());
+    for (size_t i = 0; i < transformedBones.size(); ++i) {
+        const auto &oldBone = m_bones[i];
+        const auto &bone = transformedBones[i];
+        QMatrix4x4 parentMatrix;
+        QMatrix4x4 translationMatrix;
+        QMatrix4x4 rotationMatrix;
+        QMatrix4x4 parentRotation;
+        if (-1 != bone.parent) {
+            const auto &oldParentBone = m_bones[oldBone.parent];
+            parentMatrix = poseTransforms[bone.parent];
+            parentRotation = poseRotations[bone.parent];
+            translationMatrix.translate(oldBone.headPosition - oldParentBone.headPosition);
+            QQuaternion rotation = QQuaternion::rotationTo((oldBone.tailPosition - oldBone.headPosition).normalized(),
+                (bone.tailPosition - bone.headPosition).normalized());
+            rotationMatrix.rotate(rotation);
+        } else {
+            translationMatrix.translate(bone.headPosition + (bone.tailPosition - oldBone.tailPosition));
         }
-        
-        std::vector<QVector3D> frameVertices = transformedVertices;
-        std::vector<std::vector<size_t>> frameFaces = m_object.triangles;
-        std::vector<std::vector<QVector3D>> frameCornerNormals;
-        const std::vector<std::vector<QVector3D>> *triangleVertexNormals = m_object.triangleVertexNormals();
-        if (nullptr == triangleVertexNormals) {
-            frameCornerNormals.resize(frameFaces.size());
-            for (size_t i = 0; i < m_object.triangles.size(); ++i) {
-                const auto &triangle = m_object.triangles[i];
-                QVector3D triangleNormal = QVector3D::normal(
-                    transformedVertices[triangle[0]],
-                    transformedVertices[triangle[1]],
-                    transformedVertices[triangle[2]]
-                );
-                frameCornerNormals[i] = {
-                    triangleNormal, triangleNormal, triangleNormal
-                };
-            }
+        poseTransforms[i] = parentMatrix * translationMatrix * parentRotation.inverted() * rotationMatrix;
+        poseRotations[i] = rotationMatrix;
+    }
+    
+    JointNodeTree &jointNodeTree = result->jointNodeTree;
+    jointNodeTree = JointNodeTree(&m_bones);
+    for (size_t i = 0; i < m_bones.size(); ++i) {
+        const auto &bone = transformedBones[i];
+        if (-1 != bone.parent) {
+            jointNodeTree.updateMatrix(i, poseTransforms[bone.parent].inverted() * poseTransforms[i]);
         } else {
-            frameCornerNormals = *triangleVertexNormals;
+            jointNodeTree.updateMatrix(i, poseTransforms[i]);
         }
-        
-        if (m_snapshotMeshesEnabled) {
-            if (frameIndex == vertebrataMoveMotionBuilderFrames.size() / 2) {
-                delete snapshotMesh;
-                snapshotMesh = new Model(frameVertices, frameFaces, frameCornerNormals);
-            }
+    }
+    
+    const std::vector<JointNode> &jointNodes = jointNodeTree.nodes();
+    std::vector<QMatrix4x4> jointNodeMatrices(m_bones.size());
+    for (size_t i = 0; i < m_bones.size(); ++i) {
+        const auto &bone = transformedBones[i];
+        QMatrix4x4 translationMatrix;
+        translationMatrix.translate(jointNodes[i].translation);
+        QMatrix4x4 rotationMatrix;
+        rotationMatrix.rotate(jointNodes[i].rotation);
+        if (-1 != bone.parent) {
+            jointNodeMatrices[i] *= jointNodeMatrices[bone.parent];
         }
-        
-        if (m_previewMeshesEnabled) {
-            BlockMesh blockMesh;
-            blockMesh.addBlock(
-                QVector3D(0.0, groundY + parameters.groundOffset, 0.0), 100.0,
-                QVector3D(0.0, groundY + parameters.groundOffset - 0.02, 0.0), 100.0);
-            for (const auto &bone: transformedBones) {
-                if (0 == bone.index)
-                    continue;
-                blockMesh.addBlock(bone.headPosition, bone.headRadius * 0.5,
-                    bone.tailPosition, bone.tailRadius * 0.5);
-            }
-            blockMesh.build();
-            std::vector<QVector3D> *resultVertices = blockMesh.takeResultVertices();
-            std::vector<std::vector<size_t>> *resultFaces = blockMesh.takeResultFaces();
-            size_t oldVertexCount = frameVertices.size();
-            for (const auto &v: *resultVertices)
-                frameVertices.push_back(QVector3D(v.x() - 0.5, v.y(), v.z()));
-            for (const auto &f: *resultFaces) {
-                std::vector<size_t> newF = f;
-                for (auto &v: newF)
-                    v += oldVertexCount;
-                frameFaces.push_back(newF);
-
-                QVector3D triangleNormal = QVector3D::normal(
-                    (*resultVertices)[f[0]],
-                    (*resultVertices)[f[1]],
-                    (*resultVertices)[f[2]]
-                );
-                frameCornerNormals.push_back({
-                    triangleNormal, triangleNormal, triangleNormal
-                });
-            }
-            delete resultFaces;
-            delete resultVertices;
-            
-            previewMeshes.push_back({0.017f, new SimpleShaderMesh(
-                new std::vector<QVector3D>(frameVertices), 
-                new std::vector<std::vector<size_t>>(frameFaces),
-                new std::vector<std::vector<QVector3D>>(frameCornerNormals))});
+        jointNodeMatrices[i] *= translationMatrix * rotationMatrix;
+    }
+    for (size_t i = 0; i < m_bones.size(); ++i)
+        jointNodeMatrices[i] = jointNodeMatrices[i] * bindTransforms[i].inverted();
+    
+    skinningMatricesFromTransforms(jointNodeMatrices, result->skinningMatrices);
+    
+    if (m_previewMeshesEnabled) {
+        for (const auto &bone: transformedBones) {
+            if (0 == bone.index)
+                continue;
+            result->boneBlocks.push_back({bone.headPosition, bone.headRadius * 0.5f,
+                bone.tailPosition, bone.tailRadius * 0.5f});
         }
     }
     
-    if (m_previewMeshesEnabled)
-        m_resultPreviewMeshes[motionId] = previewMeshes;
-    m_resultJointNodeTrees[motionId] = jointNodeTrees;
-    m_resultSnapshotMeshes[motionId] = snapshotMesh;
+    if (!generateSnapshot)
+        return;
+    
+    std::vector<QVector3D> transformedVertices;
+    skinVertices(m_skinningVertices, result->skinningMatrices, transformedVertices);
+    
+    std::vector<std::vector<QVector3D>> frameCornerNormals;
+    const std::vector<std::vector<QVector3D>> *triangleVertexNormals = m_object.triangleVertexNormals();
+    if (nullptr == triangleVertexNormals) {
+        frameCornerNormals.resize(m_object.triangles.size());
+        for (size_t i = 0; i < m_object.triangles.size(); ++i) {
+            const auto &triangle = m_object.triangles[i];
+            QVector3D triangleNormal = QVector3D::normal(
+                transformedVertices[triangle[0]],
+                transformedVertices[triangle[1]],
+                transformedVertices[triangle[2]]
+            );
+            frameCornerNormals[i] = {
+                triangleNormal, triangleNormal, triangleNormal
+            };
+        }
+    } else {
+        frameCornerNormals = *triangleVertexNormals;
+    }
+    
+    result->snapshotMesh = new Model(transformedVertices, m_object.triangles, frameCornerNormals);
 }
 
 void MotionsGenerator::generate()
 {
-    for (const auto &it: m_motions) {
-        generateMotion(it.first);
-        m_generatedMotionIds.insert(it.first);
+    ProfileScope profileScope("motionsGeneration");
+    
+    std::vector<const std::pair<const QUuid, std::map<QString, QString>> *> motions;
+    motions.reserve(m_motions.size());
+    for (const auto &it: m_motions)
+        motions.push_back(&it);
+    
+    // Motions are independent, generate them concurrently and merge the results in motion id order
+    std::vector<MotionResult> motionResults(motions.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, motions.size()),
+        MotionWorker(this, &motions, &motionResults));
+    
+    for (size_t i = 0; i < motions.size(); ++i) {
+        const QUuid &motionId = motions[i]->first;
+        auto &motionResult = motionResults[i];
+        if (m_previewMeshesEnabled)
+            m_resultPreviews[motionId] = motionResult.preview;
+        m_resultJointNodeTrees[motionId] = motionResult.jointNodeTrees;
+        m_resultSnapshotMeshes[motionId] = motionResult.snapshotMesh;
+        m_generatedMotionIds.insert(motionId);
     }
 }
 
@@ -5,9 +5,11 @@
 #include <map>
 #include <set>
 #include "model.h"
-#include "simpleshadermesh.h"
+#include "motionpreview.h"
 #include "rig.h"
 #include "jointnodetree.h"
+#include "motionbuilder.h"
+#include "skinning.h"
 
 class MotionsGenerator : public QObject
 {
@@ -15,12 +17,12 @@ class MotionsGenerator : public QObject
 public:
     MotionsGenerator(RigType rigType,
         const std::vector<RigBone> &bones,
-        const std::map<int, RigVertexWeights> &rigWeights,
+        const RigWeights &rigWeights,
         const Object &object);
     ~MotionsGenerator();
     void addMotion(const QUuid &motionId, const std::map<QString, QString> &parameters);
     Model *takeResultSnapshotMesh(const QUuid &motionId);
-    std::vector<std::pair<float, SimpleShaderMesh *>> takeResultPreviewMeshes(const QUuid &motionId);
+    MotionPreview *takeResultPreview(const QUuid &motionId);
     std::vector<std::pair<float, JointNodeTree>> takeResultJointNodeTrees(const QUuid &motionId);
     const std::set<QUuid> &generatedMotionIds();
     void enablePreviewMeshes();
@@ -33,19 +35,42 @@ public slots:
     void process();
     
 private:
+    class MotionWorker;
+    class FrameWorker;
+    
+    struct MotionResult
+    {
+        std::vector<std::pair<float, JointNodeTree>> jointNodeTrees;
+        MotionPreview *preview = nullptr;
+        Model *snapshotMesh = nullptr;
+    };
+    
+    struct FrameResult
+    {
+        JointNodeTree jointNodeTree = JointNodeTree(nullptr);
+        std::vector<SkinningMatrix> skinningMatrices;
+        std::vector<MotionPreview::BoneBlock> boneBlocks;
+        Model *snapshotMesh = nullptr;
+    };
+    
     RigType m_rigType = RigType::None;
     std::vector<RigBone> m_bones;
-    std::map<int, RigVertexWeights> m_rigWeights;
+    RigWeights m_rigWeights;
     Object m_object;
+    SkinningVertices m_skinningVertices;
     std::map<QUuid, std::map<QString, QString>> m_motions;
     std::set<QUuid> m_generatedMotionIds;
     std::map<QUuid, Model *> m_resultSnapshotMeshes;
-    std::map<QUuid, std::vector<std::pair<float, SimpleShaderMesh *>>> m_resultPreviewMeshes;
+    std::map<QUuid, MotionPreview *> m_resultPreviews;
     std::map<QUuid, std::vector<std::pair<float, JointNodeTree>>> m_resultJointNodeTrees;
     bool m_previewMeshesEnabled = false;
     bool m_snapshotMeshesEnabled = false;
     
-    void generateMotion(const QUuid &motionId);
+    void generateMotion(const std::map<QString, QString> &motionParameters, MotionResult *result) const;
+    void generateFrame(const std::vector<MotionBuilder::Node> &frame,
+        const std::vector<QMatrix4x4> &bindTransforms,
+        bool generateSnapshot,
+        FrameResult *result) const;
 };
 
 #endif
@@ -0,0 +1,159 @@
+#include <vector>
+#include <map>
+#include <atomic>
+#include <algorithm>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QFile>
+#include "json.hpp"
+#include "profiler.h"
+
+struct ProfilerEvent
+{
+    const char *name;
+    char phase;
+    qint64 timestamp;
+    qint64 value;
+    quint64 threadId;
+};
+static std::vector<ProfilerEvent> g_events;
+static QMutex g_eventsMutex;
+static std::atomic<bool> g_enabled(false);
+
+static QElapsedTimer &profilerClock()
+{
+    static QElapsedTimer clock = []() {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+    return clock;
+}
+
+static quint64 currentThreadIdValue()
+{
+    return (quint64)(quintptr)QThread::currentThreadId();
+}
+
+void Profiler::setEnabled(bool enabled)
+{
+    if (enabled)
+        profilerClock();
+    g_enabled = enabled;
+}
+
+bool Profiler::isEnabled()
+{
+    return g_enabled;
+}
+
+qint64 Profiler::now()
+{
+    return profilerClock().nsecsElapsed() / 1000;
+}
+
+void Profiler::addDuration(const char *name, qint64 startMicroseconds, qint64 durationMicroseconds)
+{
+    if (!g_enabled)
+        return;
+    QMutexLocker locker(&g_eventsMutex);
+    g_events.push_back({name, 'X', startMicroseconds, durationMicroseconds, currentThreadIdValue()});
+}
+
+void Profiler::addCounter(const char *name, qint64 value)
+{
+    if (!g_enabled)
+        return;
+    qint64 timestamp = now();
+    QMutexLocker locker(&g_eventsMutex);
+    g_events.push_back({name, 'C', timestamp, value, currentThreadIdValue()});
+}
+
+void Profiler::reset()
+{
+    QMutexLocker locker(&g_eventsMutex);
+    g_events.clear();
+}
+
+bool Profiler::saveTrace(const QString &filename)
+{
+    nlohmann::json traceEvents = nlohmann::json::array();
+    {
+        QMutexLocker locker(&g_eventsMutex);
+        for (const auto &event: g_events) {
+            nlohmann::json item;
+            item["name"] = event.name;
+            item["ph"] = std::string(1, event.phase);
+            item["ts"] = event.timestamp;
+            item["pid"] = 1;
+            item["tid"] = event.threadId;
+            if ('X' == event.phase)
+                item["dur"] = event.value;
+            else
+                item["args"]["value"] = event.value;
+            traceEvents.push_back(item);
+        }
+    }
+    nlohmann::json trace;
+    trace["traceEvents"] = traceEvents;
+    trace["displayTimeUnit"] = "ms";
+    
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    std::string content = trace.dump();
+    file.write(content.data(), content.size());
+    return true;
+}
+
+QString Profiler::summary()
+{
+    struct Stat
+    {
+        qint64 count = 0;
+        qint64 total = 0;
+        qint64 max = 0;
+    };
+    std::map<std::string, Stat> durationStats;
+    std::map<std::string, Stat> counterStats;
+    {
+        QMutexLocker locker(&g_eventsMutex);
+        for (const auto &event: g_events) {
+            auto &stat = 'X' == event.phase ? durationStats[event.name] : counterStats[event.name];
+            stat.count++;
+            stat.total += event.value;
+            stat.max = std::max(stat.max, event.value);
+        }
+    }
+    std::vector<std::pair<std::string, Stat>> sortedDurationStats(durationStats.begin(), durationStats.end());
+    std::sort(sortedDurationStats.begin(), sortedDurationStats.end(), [](const std::pair<std::string, Stat> &first,
+            const std::pair<std::string, Stat> &second) {
+        return first.second.total > second.second.total;
+    });
+    
+    auto formatRow = [](const QString &name, const QString &count, const QString &total, const QString &average, const QString &max) {
+        return name.leftJustified(32) + count.rightJustified(10) + total.rightJustified(12) + 
+            average.rightJustified(12) + max.rightJustified(12) + "\n";
+    };
+    QString result = formatRow("Stage", "Count", "Total(ms)", "Avg(ms)", "Max(ms)");
+    for (const auto &it: sortedDurationStats) {
+        const auto &stat = it.second;
+        result += formatRow(QString::fromStdString(it.first), QString::number(stat.count),
+            QString::number(stat.total / 1000.0, 'f', 2),
+            QString::number(stat.total / 1000.0 / stat.count, 'f', 2),
+            QString::number(stat.max / 1000.0, 'f', 2));
+    }
+    if (!counterStats.empty())
+        result += formatRow("Counter", "Count", "Total", "Avg", "Max");
+    for (const auto &it: counterStats) {
+        const auto &stat = it.second;
+        result += formatRow(QString::fromStdString(it.first), QString::number(stat.count),
+            QString::number(stat.total),
+            QString::number((double)stat.total / stat.count, 'f', 2),
+            QString::number(stat.max));
+    }
+    return result;
+}
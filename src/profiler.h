@@ -0,0 +1,40 @@
+#ifndef DUST3D_PROFILER_H
+#define DUST3D_PROFILER_H
+#include <QString>
+#include <QtGlobal>
+
+class Profiler
+{
+public:
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+    static qint64 now();
+    static void addDuration(const char *name, qint64 startMicroseconds, qint64 durationMicroseconds);
+    static void addCounter(const char *name, qint64 value);
+    static void reset();
+    static bool saveTrace(const QString &filename);
+    static QString summary();
+};
+
+// Records the lifetime of the scope as one trace event, the name must outlive the profiler (string literal)
+class ProfileScope
+{
+public:
+    ProfileScope(const char *name) :
+        m_name(name)
+    {
+        if (Profiler::isEnabled())
+            m_start = Profiler::now();
+    }
+    ~ProfileScope()
+    {
+        if (m_start >= 0)
+            Profiler::addDuration(m_name, m_start, Profiler::now() - m_start);
+    }
+private:
+    Q_DISABLE_COPY(ProfileScope)
+    const char *m_name = nullptr;
+    qint64 m_start = -1;
+};
+
+#endif
@@ -70,4 +70,41 @@ private:
     std::vector<std::pair<int, float>> m_boneRawWeights;
 };
 
+// Finalized weights of all vertices, MAX_WEIGHT_NUM bones per vertex stored in flat arrays
+class RigWeights
+{
+public:
+    void resize(size_t vertexCount)
+    {
+        m_boneIndices.assign(vertexCount * MAX_WEIGHT_NUM, 0);
+        m_boneWeights.assign(vertexCount * MAX_WEIGHT_NUM, 0.0f);
+    }
+    size_t vertexCount() const
+    {
+        return m_boneIndices.size() / MAX_WEIGHT_NUM;
+    }
+    bool empty() const
+    {
+        return m_boneIndices.empty();
+    }
+    void setVertexWeights(size_t vertexIndex, const RigVertexWeights &vertexWeights)
+    {
+        for (size_t i = 0; i < MAX_WEIGHT_NUM; ++i) {
+            m_boneIndices[vertexIndex * MAX_WEIGHT_NUM + i] = (quint16)vertexWeights.boneIndices[i];
+            m_boneWeights[vertexIndex * MAX_WEIGHT_NUM + i] = vertexWeights.boneWeights[i];
+        }
+    }
+    const quint16 *boneIndices(size_t vertexIndex) const
+    {
+        return &m_boneIndices[vertexIndex * MAX_WEIGHT_NUM];
+    }
+    const float *boneWeights(size_t vertexIndex) const
+    {
+        return &m_boneWeights[vertexIndex * MAX_WEIGHT_NUM];
+    }
+private:
+    std::vector<quint16> m_boneIndices;
+    std::vector<float> m_boneWeights;
+};
+
 #endif
@@ -11,6 +11,7 @@
 #include "util.h"
 #include "boundingboxmesh.h"
 #include "theme.h"
+#include "profiler.h"
 
 class GroupEndpointsStitcher
 {
@@ -59,6 +60,90 @@ private:
     std::vector<std::pair<size_t, float>> *m_stitchResult = nullptr;
 };
 
+class NodeOriginGrid
+{
+public:
+    NodeOriginGrid(const std::vector<ObjectNode> *nodes) :
+        m_nodes(nodes)
+    {
+        if (m_nodes->empty())
+            return;
+        QVector3D low = (*m_nodes)[0].origin;
+        QVector3D high = low;
+        for (const auto &node: *m_nodes) {
+            const auto &origin = node.origin;
+            low = QVector3D(std::min(low.x(), origin.x()), std::min(low.y(), origin.y()), std::min(low.z(), origin.z()));
+            high = QVector3D(std::max(high.x(), origin.x()), std::max(high.y(), origin.y()), std::max(high.z(), origin.z()));
+        }
+        auto size = high - low;
+        float maxLength = std::max(size.x(), std::max(size.y(), size.z()));
+        m_cellSize = std::max(maxLength / std::max(std::cbrt((float)m_nodes->size()), 1.0f), 0.000001f);
+        m_low = low;
+        m_maxRing = (int)std::ceil(maxLength / m_cellSize) + 1;
+        for (size_t nodeIndex = 0; nodeIndex < m_nodes->size(); ++nodeIndex) {
+            int x, y, z;
+            cellOf((*m_nodes)[nodeIndex].origin, &x, &y, &z);
+            m_cells[cellKey(x, y, z)].push_back(nodeIndex);
+        }
+    }
+    
+    // Same result as a linear scan which keeps the first node on distance ties
+    size_t findNearest(const QVector3D &position) const
+    {
+        size_t nearestIndex = m_nodes->size();
+        float nearestDistance2 = std::numeric_limits<float>::max();
+        int centerX, centerY, centerZ;
+        cellOf(position, &centerX, &centerY, &centerZ);
+        int outside = std::max(std::max(std::max(-centerX, centerX - m_maxRing),
+            std::max(-centerY, centerY - m_maxRing)),
+            std::max(std::max(-centerZ, centerZ - m_maxRing), 0));
+        for (int ring = 0; ring <= m_maxRing + outside; ++ring) {
+            for (int x = centerX - ring; x <= centerX + ring; ++x) {
+                for (int y = centerY - ring; y <= centerY + ring; ++y) {
+                    for (int z = centerZ - ring; z <= centerZ + ring; ++z) {
+                        if (std::abs(x - centerX) != ring &&
+                                std::abs(y - centerY) != ring &&
+                                std::abs(z - centerZ) != ring)
+                            continue;
+                        auto findCell = m_cells.find(cellKey(x, y, z));
+                        if (findCell == m_cells.end())
+                            continue;
+                        for (const auto &nodeIndex: findCell->second) {
+                            float distance2 = (position - (*m_nodes)[nodeIndex].origin).lengthSquared();
+                            if (distance2 < nearestDistance2 ||
+                                    (distance2 == nearestDistance2 && nodeIndex < nearestIndex)) {
+                                nearestDistance2 = distance2;
+                                nearestIndex = nodeIndex;
+                            }
+                        }
+                    }
+                }
+            }
+            float searchedDistance = ring * m_cellSize;
+            if (nearestIndex != m_nodes->size() && nearestDistance2 < searchedDistance * searchedDistance)
+                break;
+        }
+        return nearestIndex;
+    }
+private:
+    const std::vector<ObjectNode> *m_nodes = nullptr;
+    std::unordered_map<quint64, std::vector<size_t>> m_cells;
+    QVector3D m_low;
+    float m_cellSize = 1.0;
+    int m_maxRing = 0;
+    
+    void cellOf(const QVector3D &position, int *x, int *y, int *z) const
+    {
+        *x = (int)std::floor((position.x() - m_low.x()) / m_cellSize);
+        *y = (int)std::floor((position.y() - m_low.y()) / m_cellSize);
+        *z = (int)std::floor((position.z() - m_low.z()) / m_cellSize);
+    }
+    static quint64 cellKey(int x, int y, int z)
+    {
+        return ((quint64)(x & 0x1fffff) << 42) | ((quint64)(y & 0x1fffff) << 21) | (quint64)(z & 0x1fffff);
+    }
+};
+
 RigGenerator::RigGenerator(RigType rigType, const Object &object) :
     m_rigType(rigType),
     m_object(new Object(object))
@@ -87,9 +172,9 @@ std::vector<RigBone> *RigGenerator::takeResultBones()
     return resultBones;
 }
 
-std::map<int, RigVertexWeights> *RigGenerator::takeResultWeights()
+RigWeights *RigGenerator::takeResultWeights()
 {
-    std::map<int, RigVertexWeights> *resultWeights = m_resultWeights;
+    RigWeights *resultWeights = m_resultWeights;
     m_resultWeights = nullptr;
     return resultWeights;
 }
@@ -141,6 +226,23 @@ void RigGenerator::groupNodeIndices(const std::map<size_t, std::unordered_set<si
     }
 }
 
+void RigGenerator::resolveVertexSourceNodes()
+{
+    // Vertices refer to nodes by id, resolve them once to node indices for the later steps
+    std::map<std::pair<QUuid, QUuid>, size_t> nodeIdToIndexMap;
+    for (size_t i = 0; i < m_object->nodes.size(); ++i) {
+        const auto &node = m_object->nodes[i];
+        nodeIdToIndexMap[{node.partId, node.nodeId}] = i;
+    }
+    m_vertexSourceNodeIndices.clear();
+    m_vertexSourceNodeIndices.resize(m_object->vertices.size(), m_object->nodes.size());
+    for (size_t vertexIndex = 0; vertexIndex < m_object->vertexSourceNodes.size() && vertexIndex < m_object->vertices.size(); ++vertexIndex) {
+        auto findNodeIndex = nodeIdToIndexMap.find(m_object->vertexSourceNodes[vertexIndex]);
+        if (findNodeIndex != nodeIdToIndexMap.end())
+            m_vertexSourceNodeIndices[vertexIndex] = findNodeIndex->second;
+    }
+}
+
 void RigGenerator::buildNeighborMap()
 {
     if (nullptr == m_object->triangleSourceNodes())
@@ -405,7 +507,9 @@ void RigGenerator::buildSkeleton()
     m_lastSpineJointIndex = m_spineJoints.size() - 1;
     
     m_resultBones = new std::vector<RigBone>;
-    m_resultWeights = new std::map<int, RigVertexWeights>;
+    m_resultWeights = new RigWeights;
+    m_vertexRawWeights.clear();
+    m_vertexRawWeights.resize(m_object->vertices.size());
     
     {
         const auto &firstSpineNode = m_object->nodes[m_spineJoints[m_rootSpineJointIndex]];
@@ -648,35 +752,18 @@ void RigGenerator::computeSkinWeights()
         m_rightLimbChains.size() +
         1);
     
-    std::map<std::pair<QUuid, QUuid>, size_t> nodeIdToIndexMap;
-    for (size_t nodeIndex = 0; nodeIndex < m_object->nodes.size(); ++nodeIndex) {
-        const auto &node = m_object->nodes[nodeIndex];
-        nodeIdToIndexMap[{node.partId, node.nodeId}] = nodeIndex;
-    }
-    if (!nodeIdToIndexMap.empty()) {
-        for (size_t nonBodyNodeIndex = 0; nonBodyNodeIndex < m_object->nodes.size(); ++nonBodyNodeIndex) {
-            const auto &nonBodyNode = m_object->nodes[nonBodyNodeIndex];
-            std::vector<std::pair<size_t, float>> distance2s;
-            distance2s.reserve(m_object->nodes.size());
-            for (size_t nodeIndex = 0; nodeIndex < m_object->nodes.size(); ++nodeIndex) {
-                const auto &node = m_object->nodes[nodeIndex];
-                distance2s.push_back(std::make_pair(nodeIndex,
-                    (nonBodyNode.origin - node.origin).lengthSquared()));
-            }
-            nodeIdToIndexMap[{nonBodyNode.partId, nonBodyNode.nodeId}] = std::min_element(distance2s.begin(), distance2s.end(), [](const std::pair<size_t, float> &first,
-                    const std::pair<size_t, float> &second) {
-                return first.second < second.second;
-            })->first;
-        }
-    }
+    NodeOriginGrid nodeOriginGrid(&m_object->nodes);
+    std::vector<size_t> nearestNodeIndices(m_object->nodes.size());
+    for (size_t nodeIndex = 0; nodeIndex < m_object->nodes.size(); ++nodeIndex)
+        nearestNodeIndices[nodeIndex] = nodeOriginGrid.findNearest(m_object->nodes[nodeIndex].origin);
+    
     for (size_t vertexIndex = 0; vertexIndex < m_object->vertices.size(); ++vertexIndex) {
-        const auto &vertexSourceId = m_object->vertexSourceNodes[vertexIndex];
-        auto findNodeIndex = nodeIdToIndexMap.find(vertexSourceId);
-        if (findNodeIndex == nodeIdToIndexMap.end()) {
+        const auto &sourceNodeIndex = m_vertexSourceNodeIndices[vertexIndex];
+        if (sourceNodeIndex >= m_object->nodes.size()) {
             vertexBranches[spineIndex].push_back(vertexIndex);
             continue;
         }
-        const auto &nodeIndex = findNodeIndex->second;
+        const auto &nodeIndex = nearestNodeIndices[sourceNodeIndex];
         auto findBranch = nodeIndicesToBranchMap.find(nodeIndex);
         if (findBranch == nodeIndicesToBranchMap.end()) {
             vertexBranches[spineIndex].push_back(vertexIndex);
@@ -736,8 +823,20 @@ void RigGenerator::computeSkinWeights()
     
     fixVirtualBoneSkinWeights();
     
-    for (auto &it: *m_resultWeights)
-        it.second.finalizeWeights();
+    bool hasWeights = false;
+    for (auto &it: m_vertexRawWeights) {
+        if (it.boneRawWeights().empty())
+            continue;
+        it.finalizeWeights();
+        hasWeights = true;
+    }
+    if (hasWeights) {
+        m_resultWeights->resize(m_vertexRawWeights.size());
+        for (size_t vertexIndex = 0; vertexIndex < m_vertexRawWeights.size(); ++vertexIndex)
+            m_resultWeights->setVertexWeights(vertexIndex, m_vertexRawWeights[vertexIndex]);
+    }
+    m_vertexRawWeights.clear();
+    m_vertexRawWeights.shrink_to_fit();
     
     //for (size_t i = 0; i < m_object->vertices.size(); ++i) {
     //    auto findWeights = m_resultWeights->find(i);
@@ -809,12 +908,12 @@ void RigGenerator::fixVirtualBoneSkinWeights()
     }
     
     std::unordered_map<int, std::vector<size_t>> boneVerticesMap;
-    for (auto &it: *m_resultWeights) {
-        for (const auto &weight: it.second.boneRawWeights()) {
+    for (size_t vertexIndex = 0; vertexIndex < m_vertexRawWeights.size(); ++vertexIndex) {
+        for (const auto &weight: m_vertexRawWeights[vertexIndex].boneRawWeights()) {
             const auto &boneIndex = weight.first;
             if (0 == boneIndex)
                 continue;
-            boneVerticesMap[boneIndex].push_back(it.first);
+            boneVerticesMap[boneIndex].push_back(vertexIndex);
         }
     }
     
@@ -883,7 +982,7 @@ void RigGenerator::fixVirtualBoneSkinWeights()
                 if (angle > 180)
                     continue;
             }
-            (*m_resultWeights)[vertexIndex].addBone(it.index, 1.0);
+            m_vertexRawWeights[vertexIndex].addBone(it.index, 1.0);
         }
         for (const auto &vertexIndex: boneVerticesMap[it.parentNextIndex]) {
             if (it.side != calculateSide(m_object->vertices[vertexIndex].x()))
@@ -904,7 +1003,7 @@ void RigGenerator::fixVirtualBoneSkinWeights()
                 if (angle > 180)
                     continue;
             }
-            (*m_resultWeights)[vertexIndex].addBone(it.index, 1.0);
+            m_vertexRawWeights[vertexIndex].addBone(it.index, 1.0);
         }
     }
 }
@@ -941,7 +1040,7 @@ void RigGenerator::computeBranchSkinWeights(size_t fromBoneIndex,
 					projectedLength = 0;
                 if (projectedLength <= endGradientLength) {
                     auto factor = 0.1 + 0.4 * (1.0 - projectedLength / endGradientLength);
-                    (*m_resultWeights)[vertexIndex].addBone(previousBoneIndex, factor);
+                    m_vertexRawWeights[vertexIndex].addBone(previousBoneIndex, factor);
                 }
                 newRemainVertexIndices.push_back(vertexIndex);
                 continue;
@@ -950,7 +1049,7 @@ void RigGenerator::computeBranchSkinWeights(size_t fromBoneIndex,
                 if (nullptr != discardedVertexIndices)
                     discardedVertexIndices->push_back(vertexIndex);
                 else
-                    (*m_resultWeights)[vertexIndex].addBone(currentBoneIndex, 1.0);
+                    m_vertexRawWeights[vertexIndex].addBone(currentBoneIndex, 1.0);
                 continue;
             }
             float angle = radianBetweenVectors(direction, -parentDirection);
@@ -958,27 +1057,27 @@ void RigGenerator::computeBranchSkinWeights(size_t fromBoneIndex,
             if (projectedLength < 0)
 				projectedLength = 0;
             if (projectedLength <= endGradientLength) {
-                (*m_resultWeights)[vertexIndex].addBone(previousBoneIndex, 0.5 + 0.5 * projectedLength / endGradientLength);
-                (*m_resultWeights)[vertexIndex].addBone(currentBoneIndex, 0.5 * (1.0 - projectedLength / endGradientLength));
+                m_vertexRawWeights[vertexIndex].addBone(previousBoneIndex, 0.5 + 0.5 * projectedLength / endGradientLength);
+                m_vertexRawWeights[vertexIndex].addBone(currentBoneIndex, 0.5 * (1.0 - projectedLength / endGradientLength));
                 continue;
             }
             if (projectedLength <= parentLength - beginGradientLength) {
-                (*m_resultWeights)[vertexIndex].addBone(previousBoneIndex, 1.0);
+                m_vertexRawWeights[vertexIndex].addBone(previousBoneIndex, 1.0);
                 continue;
             }
             if (projectedLength <= parentLength) {
                 auto factor = 0.5 + 0.5 * (parentLength - projectedLength) / beginGradientLength;
-                (*m_resultWeights)[vertexIndex].addBone(previousBoneIndex, factor);
+                m_vertexRawWeights[vertexIndex].addBone(previousBoneIndex, factor);
                 continue;
             }
             auto factor = 0.1 + 0.4 * (1.0 - (projectedLength - parentLength) / beginGradientLength);
-            (*m_resultWeights)[vertexIndex].addBone(previousBoneIndex, factor);
+            m_vertexRawWeights[vertexIndex].addBone(previousBoneIndex, factor);
             continue;
         }
         remainVertexIndices = newRemainVertexIndices;
         if (currentBone.children.empty() || !currentBone.name.startsWith(boneNamePrefix)) {
             for (const auto &vertexIndex: remainVertexIndices) {
-                (*m_resultWeights)[vertexIndex].addBone(currentBoneIndex, 0.5);
+                m_vertexRawWeights[vertexIndex].addBone(currentBoneIndex, 0.5);
             }
             break;
         }
@@ -1180,22 +1279,16 @@ void RigGenerator::buildDemoMesh()
         const auto &resultWeights = *m_resultWeights;
         const auto &resultBones = *m_resultBones;
         
-        m_resultWeights = new std::map<int, RigVertexWeights>;
-        *m_resultWeights = resultWeights;
-        
-        m_resultBones = new std::vector<RigBone>;
-        *m_resultBones = resultBones;
-        
-        for (const auto &weightItem: resultWeights) {
-            size_t vertexIndex = weightItem.first;
-            const auto &weight = weightItem.second;
+        for (size_t vertexIndex = 0; vertexIndex < resultWeights.vertexCount(); ++vertexIndex) {
+            const quint16 *boneIndices = resultWeights.boneIndices(vertexIndex);
+            const float *boneWeights = resultWeights.boneWeights(vertexIndex);
             int blendR = 0, blendG = 0, blendB = 0;
             for (int i = 0; i < MAX_WEIGHT_NUM; i++) {
-                int boneIndex = weight.boneIndices[i];
+                int boneIndex = boneIndices[i];
 				const auto &bone = resultBones[boneIndex];
-				blendR += bone.color.red() * weight.boneWeights[i];
-				blendG += bone.color.green() * weight.boneWeights[i];
-				blendB += bone.color.blue() * weight.boneWeights[i];
+				blendR += bone.color.red() * boneWeights[i];
+				blendG += bone.color.green() * boneWeights[i];
+				blendB += bone.color.blue() * boneWeights[i];
             }
             QColor blendColor = QColor(blendR, blendG, blendB, 255);
             inputVerticesColors[vertexIndex] = blendColor;
@@ -1278,6 +1371,8 @@ void RigGenerator::buildDemoMesh()
 
 void RigGenerator::generate()
 {
+    ProfileScope profileScope("rigGeneration");
+    resolveVertexSourceNodes();
     buildNeighborMap();
     buildBoneNodeChain();
     buildSkeleton();
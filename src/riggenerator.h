@@ -17,7 +17,7 @@ public:
     ~RigGenerator();
     Model *takeResultMesh();
     std::vector<RigBone> *takeResultBones();
-    std::map<int, RigVertexWeights> *takeResultWeights();
+    RigWeights *takeResultWeights();
     const std::vector<std::pair<QtMsgType, QString>> &messages();
     Object *takeObject();
     bool isSuccessful();
@@ -39,9 +39,11 @@ private:
     Object *m_object = nullptr;
     Model *m_resultMesh = nullptr;
     std::vector<RigBone> *m_resultBones = nullptr;
-    std::map<int, RigVertexWeights> *m_resultWeights = nullptr;
+    RigWeights *m_resultWeights = nullptr;
+    std::vector<RigVertexWeights> m_vertexRawWeights;
     std::vector<std::pair<QtMsgType, QString>> m_messages;
     std::map<size_t, std::unordered_set<size_t>> m_neighborMap;
+    std::vector<size_t> m_vertexSourceNodeIndices;
     std::vector<BoneNodeChain> m_boneNodeChain;
     std::vector<size_t> m_neckChains;
     std::vector<size_t> m_leftLimbChains;
@@ -65,6 +67,7 @@ private:
     size_t m_rootSpineJointIndex = 0;
     size_t m_lastSpineJointIndex = 0;
     
+    void resolveVertexSourceNodes();
     void buildNeighborMap();
     void buildBoneNodeChain();
     void buildSkeleton();
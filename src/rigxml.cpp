@@ -9,7 +9,7 @@
 
 void saveRigToXmlStream(const Object *object,
     const std::vector<RigBone> *rigBones, 
-    const std::map<int, RigVertexWeights> *rigWeights,
+    const RigWeights *rigWeights,
     QXmlStreamWriter *writer)
 {
     JointNodeTree jointNodeTree(rigBones);
@@ -50,8 +50,7 @@ void saveRigToXmlStream(const Object *object,
         writer->writeStartElement("weights");
         QStringList weightsList;
         for (size_t vertexIndex = 0; vertexIndex < object->vertices.size(); ++vertexIndex) {
-            auto findWeights = rigWeights->find(vertexIndex);
-            if (findWeights == rigWeights->end()) {
+            if (vertexIndex >= rigWeights->vertexCount()) {
                 QStringList vertexWeightsList;
                 for (size_t i = 0; i < MAX_WEIGHT_NUM; ++i) {
                     vertexWeightsList += "0,0";
@@ -60,7 +59,7 @@ void saveRigToXmlStream(const Object *object,
             } else {
                 QStringList vertexWeightsList;
                 for (size_t i = 0; i < MAX_WEIGHT_NUM; ++i) {
-                    vertexWeightsList += QString::number(findWeights->second.boneIndices[i]) + "," + QString::number(findWeights->second.boneWeights[i]);
+                    vertexWeightsList += QString::number(rigWeights->boneIndices(vertexIndex)[i]) + "," + QString::number(rigWeights->boneWeights(vertexIndex)[i]);
                 }
                 weightsList += vertexWeightsList.join(",");
             }
@@ -6,7 +6,7 @@
 
 void saveRigToXmlStream(const Object *object,
     const std::vector<RigBone> *rigBones, 
-    const std::map<int, RigVertexWeights> *rigWeights, 
+    const RigWeights *rigWeights, 
     QXmlStreamWriter *writer);
 
 #endif
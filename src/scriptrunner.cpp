@@ -2,6 +2,10 @@
 #include <QElapsedTimer>
 #include <QUuid>
 #include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QCryptographicHash>
+#include <deque>
 #include "scriptrunner.h"
 #include "util.h"
 
@@ -154,12 +158,25 @@ static JSValue js_connect(JSContext *context, JSValueConst thisValue,
     return JS_UNDEFINED;
 }
 
+static QString GetKeyFromArg(JSContext *context, int argc, JSValueConst *argv, int index)
+{
+    if (argc <= index || !JS_IsString(argv[index]))
+        return QString();
+    QString key;
+    const char *keyString = JS_ToCString(context, argv[index]);
+    if (keyString) {
+        key = QString::fromUtf8(keyString);
+        JS_FreeCString(context, keyString);
+    }
+    return key;
+}
+
 static JSValue js_createComponent(JSContext *context, JSValueConst thisValue,
     int argc, JSValueConst *argv)
 {
     ScriptRunner *runner = (ScriptRunner *)JS_GetContextOpaque(context);
     ScriptRunner::DocumentComponent *parentComponent = nullptr;
-    if (argc >= 1) {
+    if (argc >= 1 && !JS_IsNull(argv[0]) && !JS_IsUndefined(argv[0])) {
         ScriptRunner::DocumentElement *element = (ScriptRunner::DocumentElement *)JS_GetOpaque(argv[0],
             ScriptRunner::js_componentClassId);
         if (nullptr == element ||
@@ -170,7 +187,7 @@ static JSValue js_createComponent(JSContext *context, JSValueConst thisValue,
         parentComponent = (ScriptRunner::DocumentComponent *)element;
     }
     JSValue component = JS_NewObjectClass(context, ScriptRunner::js_componentClassId);
-    JS_SetOpaque(component, runner->createComponent(parentComponent));
+    JS_SetOpaque(component, runner->createComponent(parentComponent, GetKeyFromArg(context, argc, argv, 1)));
     return component;
 }
 
@@ -191,7 +208,7 @@ static JSValue js_createPart(JSContext *context, JSValueConst thisValue,
     }
     ScriptRunner::DocumentComponent *component = (ScriptRunner::DocumentComponent *)element;
     JSValue part = JS_NewObjectClass(context, ScriptRunner::js_partClassId);
-    JS_SetOpaque(part, runner->createPart(component));
+    JS_SetOpaque(part, runner->createPart(component, GetKeyFromArg(context, argc, argv, 1)));
     return part;
 }
 
@@ -212,7 +229,7 @@ static JSValue js_createNode(JSContext *context, JSValueConst thisValue,
     }
     ScriptRunner::DocumentPart *part = (ScriptRunner::DocumentPart *)element;
     JSValue node = JS_NewObjectClass(context, ScriptRunner::js_nodeClassId);
-    JS_SetOpaque(node, runner->createNode(part));
+    JS_SetOpaque(node, runner->createNode(part, GetKeyFromArg(context, argc, argv, 1)));
     return node;
 }
 
@@ -434,25 +451,53 @@ const QString &ScriptRunner::scriptError()
     return m_scriptError;
 }
 
-ScriptRunner::DocumentPart *ScriptRunner::createPart(DocumentComponent *component)
+// Ids are derived from the element kind and either the key given by the script or the creation order,
+// so running the same script again gives the same ids and the generated caches stay usable
+QString ScriptRunner::generateElementId(const QString &kind, const QString &key)
+{
+    static const QUuid s_namespaceId("{b4ba1b5a-6b0e-4bd0-9a0b-4b0a8ffc7c8d}");
+    QString id;
+    if (!key.isEmpty()) {
+        id = QUuid::createUuidV5(s_namespaceId, kind + "/key/" + key).toString();
+        if (m_elementIds.find(id) != m_elementIds.end()) {
+            m_scriptError += QString("Repeated %1 key found: \"%2\"\r\n").arg(kind).arg(key);
+            id.clear();
+        }
+    }
+    // Only unkeyed elements take an order, so adding a keyed one doesn't shift the ids of the others
+    if (id.isEmpty()) {
+        int order = m_elementCounters[kind]++;
+        id = QUuid::createUuidV5(s_namespaceId, kind + "/" + QString::number(order)).toString();
+    }
+    m_elementIds.insert(id);
+    return id;
+}
+
+ScriptRunner::DocumentPart *ScriptRunner::createPart(DocumentComponent *component, const QString &key)
 {
     ScriptRunner::DocumentPart *part = new ScriptRunner::DocumentPart;
+    part->id = generateElementId("part", key);
+    part->attributes["id"] = part->id;
     part->component = component;
     m_parts.push_back(part);
     return part;
 }
 
-ScriptRunner::DocumentComponent *ScriptRunner::createComponent(DocumentComponent *parentComponent)
+ScriptRunner::DocumentComponent *ScriptRunner::createComponent(DocumentComponent *parentComponent, const QString &key)
 {
     ScriptRunner::DocumentComponent *component = new ScriptRunner::DocumentComponent;
+    component->id = generateElementId("component", key);
+    component->attributes["id"] = component->id;
     component->parentComponent = parentComponent;
     m_components.push_back(component);
     return component;
 }
 
-ScriptRunner::DocumentNode *ScriptRunner::createNode(DocumentPart *part)
+ScriptRunner::DocumentNode *ScriptRunner::createNode(DocumentPart *part, const QString &key)
 {
     ScriptRunner::DocumentNode *node = new ScriptRunner::DocumentNode;
+    node->id = generateElementId("node", key);
+    node->attributes["id"] = node->id;
     node->part = part;
     m_nodes.push_back(node);
     return node;
@@ -522,26 +567,89 @@ static JSClassDef js_partClass = {
     js_partFinalizer,
 };
 
+// The runtime with the registered classes and the compiled scripts live for the whole application,
+// only the context is created for each run, so nothing of the previous run can leak into the next one
+class ScriptEngine
+{
+public:
+    ~ScriptEngine()
+    {
+        if (nullptr != runtime)
+            JS_FreeRuntime(runtime);
+    }
+    JSRuntime *acquireRuntime()
+    {
+        if (nullptr == runtime) {
+            ScriptRunner::js_canvasClassId = JS_NewClassID(&ScriptRunner::js_canvasClassId);
+            ScriptRunner::js_partClassId = JS_NewClassID(&ScriptRunner::js_partClassId);
+            ScriptRunner::js_componentClassId = JS_NewClassID(&ScriptRunner::js_componentClassId);
+            ScriptRunner::js_nodeClassId = JS_NewClassID(&ScriptRunner::js_nodeClassId);
+            runtime = JS_NewRuntime();
+            JS_NewClass(runtime, ScriptRunner::js_partClassId, &js_partClass);
+            JS_NewClass(runtime, ScriptRunner::js_componentClassId, &js_componentClass);
+            JS_NewClass(runtime, ScriptRunner::js_nodeClassId, &js_nodeClass);
+        }
+        return runtime;
+    }
+    QMutex mutex;
+    JSRuntime *runtime = nullptr;
+    std::map<QByteArray, QByteArray> bytecodes;
+    std::deque<QByteArray> bytecodeKeys;
+    static const size_t maxCachedScripts = 16;
+};
+
+static ScriptEngine g_scriptEngine;
+
+// Compile the source to bytecode on first use, later runs only load the bytecode and evaluate it
+static JSValue evalCachedScript(JSContext *context, const QByteArray &key,
+    const QByteArray &source, const char *filename, bool pinned=false)
+{
+    JSValue function = JS_UNDEFINED;
+    auto findBytecode = g_scriptEngine.bytecodes.find(key);
+    if (findBytecode != g_scriptEngine.bytecodes.end()) {
+        function = JS_ReadObject(context, (const uint8_t *)findBytecode->second.constData(),
+            findBytecode->second.size(), JS_READ_OBJ_BYTECODE);
+    } else {
+        function = JS_Eval(context, source.constData(), source.size(), filename,
+            JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_COMPILE_ONLY);
+        if (JS_IsException(function))
+            return function;
+        size_t bytecodeSize = 0;
+        uint8_t *bytecode = JS_WriteObject(context, &bytecodeSize, function, JS_WRITE_OBJ_BYTECODE);
+        if (nullptr != bytecode) {
+            // Edited user scripts are dropped oldest first, the pinned ones are kept
+            if (!pinned) {
+                if (g_scriptEngine.bytecodeKeys.size() >= ScriptEngine::maxCachedScripts) {
+                    g_scriptEngine.bytecodes.erase(g_scriptEngine.bytecodeKeys.front());
+                    g_scriptEngine.bytecodeKeys.pop_front();
+                }
+                g_scriptEngine.bytecodeKeys.push_back(key);
+            }
+            g_scriptEngine.bytecodes[key] = QByteArray((const char *)bytecode, (int)bytecodeSize);
+            js_free(context, bytecode);
+        }
+    }
+    if (JS_IsException(function))
+        return function;
+    JSValue globalObject = JS_GetGlobalObject(context);
+    JSValue result = JS_EvalFunction(context, function, globalObject);
+    JS_FreeValue(context, globalObject);
+    return result;
+}
+
 void ScriptRunner::run()
 {
     QElapsedTimer countTimeConsumed;
     countTimeConsumed.start();
     
-    // Warning: Not thread safe, but we have only one script instance running, so it doesn't matter
-    js_canvasClassId = JS_NewClassID(&js_canvasClassId);
-    js_partClassId = JS_NewClassID(&js_partClassId);
-    js_componentClassId = JS_NewClassID(&js_componentClassId);
-    js_nodeClassId = JS_NewClassID(&js_nodeClassId);
-    
     m_defaultVariables = new std::map<QString, std::map<QString, QString>>;
+    
+    // Scripts from all the documents share the same runtime, so they run one at a time
+    QMutexLocker locker(&g_scriptEngine.mutex);
 
-    JSRuntime *runtime = JS_NewRuntime();
+    JSRuntime *runtime = g_scriptEngine.acquireRuntime();
     JSContext *context = JS_NewContext(runtime);
     
-    JS_NewClass(runtime, js_partClassId, &js_partClass);
-    JS_NewClass(runtime, js_componentClassId, &js_componentClass);
-    JS_NewClass(runtime, js_nodeClassId, &js_nodeClass);
-    
     JS_SetContextOpaque(context, this);
     
     if (nullptr != m_script &&
@@ -606,21 +714,28 @@ void ScriptRunner::run()
             JS_NewCFunction(context, js_print, "error", 1));
         JS_SetPropertyStr(context, globalObject, "console", console);
         
-        QFile file(":/thirdparty/three.js/dust3d.three.js");
-        if (file.open(QIODevice::ReadOnly)) {
-            QByteArray fileContent = file.readAll();
-            JSValue three = JS_NewObject(context);
-            JS_SetPropertyStr(context, globalObject, "THREE", three);
-            JSValue object = JS_Eval(context, (char *)fileContent.constData(), fileContent.size(), "<thirdparty/three.js/dust3d.three.js>",
-                  JS_EVAL_TYPE_GLOBAL);
-            JS_FreeValue(context, object);
-            file.close();
+        {
+            // The bundled script never changes, so it is only read when it is not compiled yet
+            const char *threeFilename = "<thirdparty/three.js/dust3d.three.js>";
+            QByteArray threeSource;
+            if (g_scriptEngine.bytecodes.find(threeFilename) == g_scriptEngine.bytecodes.end()) {
+                QFile file(":/thirdparty/three.js/dust3d.three.js");
+                if (file.open(QIODevice::ReadOnly))
+                    threeSource = file.readAll();
+            }
+            if (!threeSource.isEmpty() ||
+                    g_scriptEngine.bytecodes.find(threeFilename) != g_scriptEngine.bytecodes.end()) {
+                JSValue three = JS_NewObject(context);
+                JS_SetPropertyStr(context, globalObject, "THREE", three);
+                JSValue object = evalCachedScript(context, threeFilename, threeSource, threeFilename, true);
+                JS_FreeValue(context, object);
+            }
         }
         
         JS_FreeValue(context, globalObject);
         
-        JSValue object = JS_Eval(context, buffer.constData(), buffer.size(), "<input>",
-            JS_EVAL_TYPE_GLOBAL);
+        QByteArray scriptKey = QCryptographicHash::hash(buffer, QCryptographicHash::Sha1);
+        JSValue object = evalCachedScript(context, scriptKey, buffer, "<input>");
         if (JS_IsException(object)) {
             JSValue exceptionValue = JS_GetException(context);
             bool isError = JS_IsError(context, exceptionValue);
@@ -652,7 +767,9 @@ void ScriptRunner::run()
     }
     
     JS_FreeContext(context);
-    JS_FreeRuntime(runtime);
+    // Objects left in cycles are only freed by the collector, their finalizers write to
+    // the elements of this runner, so they have to run before the runner goes away
+    JS_RunGC(runtime);
     
     qDebug() << "The script run" << countTimeConsumed.elapsed() << "milliseconds";
 }
@@ -739,7 +856,7 @@ void ScriptRunner::generateSnapshot()
             m_scriptError += "Find part pointer failed, part maybe deleted\r\n";
             continue;
         }
-        QString idString = QUuid::createUuid().toString();
+        QString idString = QUuid::createUuidV5(QUuid(findFirstNode->second), findSecondNode->second).toString();
         auto &edge = m_resultSnapshot->edges[idString];
         edge["id"] = idString;
         edge["from"] = findFirstNode->second;
@@ -4,6 +4,7 @@
 #include <QUuid>
 #include <QColor>
 #include <QStringList>
+#include <set>
 #include "snapshot.h"
 extern "C" {
 #include "quickjs.h"
@@ -24,10 +25,10 @@ public:
 
     struct DocumentElement
     {
-        QString id = QUuid::createUuid().toString();
+        QString id;
         DocumentElementType type = DocumentElementType::Unknown;
         bool deleted = false;
-        std::map<QString, QString> attributes = {std::make_pair("id", id)};
+        std::map<QString, QString> attributes;
     };
     
     struct DocumentComponent : DocumentElement
@@ -74,9 +75,9 @@ public:
     std::map<QString, std::map<QString, QString>> *takeDefaultVariables();
     const QString &scriptError();
     static void mergeVaraibles(std::map<QString, std::map<QString, QString>> *target, const std::map<QString, std::map<QString, QString>> &source);
-    DocumentPart *createPart(DocumentComponent *component);
-    DocumentComponent *createComponent(DocumentComponent *parentComponent);
-    DocumentNode *createNode(DocumentPart *part);
+    DocumentPart *createPart(DocumentComponent *component, const QString &key=QString());
+    DocumentComponent *createComponent(DocumentComponent *parentComponent, const QString &key=QString());
+    DocumentNode *createNode(DocumentPart *part, const QString &key=QString());
     bool setAttribute(DocumentElement *element, const QString &name, const QString &value);
     QString attribute(DocumentElement *element, const QString &name);
     void connect(DocumentNode *firstNode, DocumentNode *secondNode);
@@ -103,7 +104,10 @@ private:
     QString m_scriptError;
     QString m_consoleLog;
     DocumentCanvas m_canvas;
+    std::map<QString, int> m_elementCounters;
+    std::set<QString> m_elementIds;
     void generateSnapshot();
+    QString generateElementId(const QString &kind, const QString &key);
 public:
     static JSClassID js_canvasClassId;
     static JSClassID js_partClassId;
@@ -2,19 +2,14 @@
 #include "theme.h"
 
 SkinnedMeshCreator::SkinnedMeshCreator(const Object &object,
-        const std::map<int, RigVertexWeights> &resultWeights) :
-    m_object(object),
-    m_resultWeights(resultWeights)
+        const RigWeights &resultWeights) :
+    m_object(object)
 {
-    m_verticesOldIndices.resize(m_object.triangles.size());
+    m_skinningVertices.prepare(m_object.vertices, resultWeights);
     m_verticesBindNormals.resize(m_object.triangles.size());
-    m_verticesBindPositions.resize(m_object.triangles.size());
     const std::vector<std::vector<QVector3D>> *triangleVertexNormals = m_object.triangleVertexNormals();
     for (size_t triangleIndex = 0; triangleIndex < m_object.triangles.size(); triangleIndex++) {
         for (int j = 0; j < 3; j++) {
-            int oldIndex = m_object.triangles[triangleIndex][j];
-            m_verticesOldIndices[triangleIndex].push_back(oldIndex);
-            m_verticesBindPositions[triangleIndex].push_back(m_object.vertices[oldIndex]);
             if (nullptr != triangleVertexNormals)
                 m_verticesBindNormals[triangleIndex].push_back((*triangleVertexNormals)[triangleIndex][j]);
             else
@@ -38,25 +33,18 @@ SkinnedMeshCreator::SkinnedMeshCreator(const Object &object,
 
 Model *SkinnedMeshCreator::createMeshFromTransform(const std::vector<QMatrix4x4> &matricies)
 {
-    std::vector<std::vector<QVector3D>> transformedPositions = m_verticesBindPositions;
-    std::vector<std::vector<QVector3D>> transformedPoseNormals = m_verticesBindNormals;
-    
+    // Skin the shared vertices once, only the normals are per triangle corner
+    std::vector<QVector3D> transformedVertices;
+    std::vector<std::vector<QVector3D>> transformedPoseNormals;
     if (!matricies.empty()) {
-        for (size_t i = 0; i < transformedPositions.size(); ++i) {
-            for (size_t j = 0; j < 3; ++j) {
-                const auto &weight = m_resultWeights[m_verticesOldIndices[i][j]];
-                QMatrix4x4 mixedMatrix;
-                transformedPositions[i][j] = QVector3D();
-                transformedPoseNormals[i][j] = QVector3D();
-                for (int x = 0; x < MAX_WEIGHT_NUM; x++) {
-                    float factor = weight.boneWeights[x];
-                    if (factor > 0) {
-                        transformedPositions[i][j] += matricies[weight.boneIndices[x]] * m_verticesBindPositions[i][j] * factor;
-                        transformedPoseNormals[i][j] += matricies[weight.boneIndices[x]] * m_verticesBindNormals[i][j] * factor;
-                    }
-                }
-            }
-        }
+        std::vector<SkinningMatrix> skinningMatrices;
+        skinningMatricesFromTransforms(matricies, skinningMatrices);
+        skinVertices(m_skinningVertices, skinningMatrices, transformedVertices);
+        skinTriangleVertexNormals(m_object.triangles, m_verticesBindNormals, m_skinningVertices, skinningMatrices,
+            transformedPoseNormals);
+    } else {
+        transformedVertices = m_object.vertices;
+        transformedPoseNormals = m_verticesBindNormals;
     }
     
     ShaderVertex *triangleVertices = new ShaderVertex[m_object.triangles.size() * 3];
@@ -64,7 +52,7 @@ Model *SkinnedMeshCreator::createMeshFromTransform(const std::vector<QMatrix4x4>
     for (size_t triangleIndex = 0; triangleIndex < m_object.triangles.size(); triangleIndex++) {
         for (int i = 0; i < 3; i++) {
             ShaderVertex &currentVertex = triangleVertices[triangleVerticesNum++];
-            const auto &sourcePosition = transformedPositions[triangleIndex][i];
+            const auto &sourcePosition = transformedVertices[m_object.triangles[triangleIndex][i]];
             const auto &sourceColor = m_triangleColors[triangleIndex];
             const auto &sourceNormal = transformedPoseNormals[triangleIndex][i];
             currentVertex.posX = sourcePosition.x();
@@ -7,18 +7,17 @@
 #include "model.h"
 #include "object.h"
 #include "jointnodetree.h"
+#include "skinning.h"
 
 class SkinnedMeshCreator
 {
 public:
     SkinnedMeshCreator(const Object &object,
-        const std::map<int, RigVertexWeights> &resultWeights);
+        const RigWeights &resultWeights);
     Model *createMeshFromTransform(const std::vector<QMatrix4x4> &matricies);
 private:
     Object m_object;
-    std::map<int, RigVertexWeights> m_resultWeights;
-    std::vector<std::vector<int>> m_verticesOldIndices;
-    std::vector<std::vector<QVector3D>> m_verticesBindPositions;
+    SkinningVertices m_skinningVertices;
     std::vector<std::vector<QVector3D>> m_verticesBindNormals;
     std::vector<QColor> m_triangleColors;
 };
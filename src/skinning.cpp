@@ -0,0 +1,259 @@
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#include <algorithm>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#define SKINNING_AVX2
+#define SKINNING_AVX2_TARGET
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SKINNING_AVX2
+#define SKINNING_AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+#include "skinning.h"
+
+void SkinningVertices::prepare(const std::vector<QVector3D> &vertices, const RigWeights &rigWeights)
+{
+    x.resize(vertices.size());
+    y.resize(vertices.size());
+    z.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        x[i] = vertices[i].x();
+        y[i] = vertices[i].y();
+        z[i] = vertices[i].z();
+    }
+    for (int k = 0; k < MAX_WEIGHT_NUM; ++k) {
+        matrixOffsets[k].assign(vertices.size(), 0);
+        weights[k].assign(vertices.size(), 0.0f);
+    }
+    size_t weightedVertexCount = std::min(vertices.size(), rigWeights.vertexCount());
+    for (size_t i = 0; i < weightedVertexCount; ++i) {
+        const quint16 *boneIndices = rigWeights.boneIndices(i);
+        const float *boneWeights = rigWeights.boneWeights(i);
+        for (int k = 0; k < MAX_WEIGHT_NUM; ++k) {
+            if (boneWeights[k] <= 0)
+                continue;
+            matrixOffsets[k][i] = (qint32)boneIndices[k] * 12;
+            weights[k][i] = boneWeights[k];
+        }
+    }
+}
+
+void skinningMatricesFromTransforms(const std::vector<QMatrix4x4> &transforms,
+    std::vector<SkinningMatrix> &skinningMatrices)
+{
+    skinningMatrices.resize(transforms.size());
+    for (size_t i = 0; i < transforms.size(); ++i) {
+        // QMatrix4x4 stores in column-major order
+        const float *data = transforms[i].constData();
+        float *m = skinningMatrices[i].m;
+        for (int row = 0; row < 3; ++row) {
+            for (int column = 0; column < 4; ++column)
+                m[row * 4 + column] = data[column * 4 + row];
+        }
+    }
+}
+
+static void skinVertexRange(const SkinningVertices &vertices, const float *matrices,
+    size_t begin, size_t end, QVector3D *skinnedVertices)
+{
+    for (size_t i = begin; i < end; ++i) {
+        float px = vertices.x[i];
+        float py = vertices.y[i];
+        float pz = vertices.z[i];
+        float x = 0, y = 0, z = 0;
+        for (int k = 0; k < MAX_WEIGHT_NUM; ++k) {
+            float weight = vertices.weights[k][i];
+            const float *m = matrices + vertices.matrixOffsets[k][i];
+            x += weight * (m[0] * px + m[1] * py + m[2] * pz + m[3]);
+            y += weight * (m[4] * px + m[5] * py + m[6] * pz + m[7]);
+            z += weight * (m[8] * px + m[9] * py + m[10] * pz + m[11]);
+        }
+        skinnedVertices[i] = QVector3D(x, y, z);
+    }
+}
+
+#ifdef SKINNING_AVX2
+static bool detectAvx2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool hasFma = 0 != (info[2] & (1 << 12));
+    bool hasOsxsave = 0 != (info[2] & (1 << 27));
+    if (!hasFma || !hasOsxsave)
+        return false;
+    // The OS has to save the YMM registers
+    if ((_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return 0 != (info[1] & (1 << 5));
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+// Eight vertices at a time, the matrix elements of each influence are gathered by the matrix offsets
+SKINNING_AVX2_TARGET
+static void skinVertexRangeAvx2(const SkinningVertices &vertices, const float *matrices,
+    size_t begin, size_t end, QVector3D *skinnedVertices)
+{
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 px = _mm256_loadu_ps(&vertices.x[i]);
+        __m256 py = _mm256_loadu_ps(&vertices.y[i]);
+        __m256 pz = _mm256_loadu_ps(&vertices.z[i]);
+        __m256 x = _mm256_setzero_ps();
+        __m256 y = _mm256_setzero_ps();
+        __m256 z = _mm256_setzero_ps();
+        for (int k = 0; k < MAX_WEIGHT_NUM; ++k) {
+            __m256 weight = _mm256_loadu_ps(&vertices.weights[k][i]);
+            __m256i offsets = _mm256_loadu_si256((const __m256i *)&vertices.matrixOffsets[k][i]);
+            __m256 tx = _mm256_fmadd_ps(_mm256_i32gather_ps(matrices + 0, offsets, 4), px,
+                _mm256_fmadd_ps(_mm256_i32gather_ps(matrices + 1, offsets, 4), py,
+                _mm256_fmadd_ps(_mm256_i32gather_ps(matrices + 2, offsets, 4), pz,
+                _mm256_i32gather_ps(matrices + 3, offsets, 4))));
+            __m256 ty = _mm256_fmadd_ps(_mm256_i32gather_ps(matrices + 4, offsets, 4), px,
+                _mm256_fmadd_ps(_mm256_i32gather_ps(matrices + 5, offsets, 4), py,
+                _mm256_fmadd_ps(_mm256_i32gather_ps(matrices + 6, offsets, 4), pz,
+                _mm256_i32gather_ps(matrices + 7, offsets, 4))));
+            __m256 tz = _mm256_fmadd_ps(_mm256_i32gather_ps(matrices + 8, offsets, 4), px,
+                _mm256_fmadd_ps(_mm256_i32gather_ps(matrices + 9, offsets, 4), py,
+                _mm256_fmadd_ps(_mm256_i32gather_ps(matrices + 10, offsets, 4), pz,
+                _mm256_i32gather_ps(matrices + 11, offsets, 4))));
+            x = _mm256_fmadd_ps(weight, tx, x);
+            y = _mm256_fmadd_ps(weight, ty, y);
+            z = _mm256_fmadd_ps(weight, tz, z);
+        }
+        float xs[8], ys[8], zs[8];
+        _mm256_storeu_ps(xs, x);
+        _mm256_storeu_ps(ys, y);
+        _mm256_storeu_ps(zs, z);
+        for (int j = 0; j < 8; ++j)
+            skinnedVertices[i + j] = QVector3D(xs[j], ys[j], zs[j]);
+    }
+    skinVertexRange(vertices, matrices, i, end, skinnedVertices);
+}
+#endif
+
+bool isSkinningSimdAvailable()
+{
+#ifdef SKINNING_AVX2
+    static bool available = detectAvx2();
+    return available;
+#else
+    return false;
+#endif
+}
+
+class VertexSkinner
+{
+public:
+    VertexSkinner(const SkinningVertices *vertices,
+            const std::vector<SkinningMatrix> *skinningMatrices,
+            std::vector<QVector3D> *skinnedVertices,
+            bool simdEnabled) :
+        m_vertices(vertices),
+        m_skinningMatrices(skinningMatrices),
+        m_skinnedVertices(skinnedVertices),
+        m_simdEnabled(simdEnabled)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        const float *matrices = m_skinningMatrices->data()->m;
+#ifdef SKINNING_AVX2
+        if (m_simdEnabled) {
+            skinVertexRangeAvx2(*m_vertices, matrices, range.begin(), range.end(), m_skinnedVertices->data());
+            return;
+        }
+#endif
+        skinVertexRange(*m_vertices, matrices, range.begin(), range.end(), m_skinnedVertices->data());
+    }
+private:
+    const SkinningVertices *m_vertices = nullptr;
+    const std::vector<SkinningMatrix> *m_skinningMatrices = nullptr;
+    std::vector<QVector3D> *m_skinnedVertices = nullptr;
+    bool m_simdEnabled = false;
+};
+
+class TriangleVertexNormalSkinner
+{
+public:
+    TriangleVertexNormalSkinner(const std::vector<std::vector<size_t>> *triangles,
+            const std::vector<std::vector<QVector3D>> *triangleVertexNormals,
+            const SkinningVertices *vertices,
+            const std::vector<SkinningMatrix> *skinningMatrices,
+            std::vector<std::vector<QVector3D>> *skinnedTriangleVertexNormals) :
+        m_triangles(triangles),
+        m_triangleVertexNormals(triangleVertexNormals),
+        m_vertices(vertices),
+        m_skinningMatrices(skinningMatrices),
+        m_skinnedTriangleVertexNormals(skinnedTriangleVertexNormals)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        const float *matrices = m_skinningMatrices->data()->m;
+        for (size_t i = range.begin(); i != range.end(); ++i) {
+            const auto &triangle = (*m_triangles)[i];
+            auto &skinnedNormals = (*m_skinnedTriangleVertexNormals)[i];
+            skinnedNormals.resize(3);
+            for (size_t j = 0; j < 3; ++j) {
+                size_t vertexIndex = triangle[j];
+                const QVector3D &normal = (*m_triangleVertexNormals)[i][j];
+                // Normals only take the linear part of the matrices
+                float x = 0, y = 0, z = 0;
+                for (int k = 0; k < MAX_WEIGHT_NUM; ++k) {
+                    float weight = m_vertices->weights[k][vertexIndex];
+                    const float *m = matrices + m_vertices->matrixOffsets[k][vertexIndex];
+                    x += weight * (m[0] * normal.x() + m[1] * normal.y() + m[2] * normal.z());
+                    y += weight * (m[4] * normal.x() + m[5] * normal.y() + m[6] * normal.z());
+                    z += weight * (m[8] * normal.x() + m[9] * normal.y() + m[10] * normal.z());
+                }
+                skinnedNormals[j] = QVector3D(x, y, z);
+            }
+        }
+    }
+private:
+    const std::vector<std::vector<size_t>> *m_triangles = nullptr;
+    const std::vector<std::vector<QVector3D>> *m_triangleVertexNormals = nullptr;
+    const SkinningVertices *m_vertices = nullptr;
+    const std::vector<SkinningMatrix> *m_skinningMatrices = nullptr;
+    std::vector<std::vector<QVector3D>> *m_skinnedTriangleVertexNormals = nullptr;
+};
+
+void skinVertices(const SkinningVertices &vertices,
+    const std::vector<SkinningMatrix> &skinningMatrices,
+    std::vector<QVector3D> &skinnedVertices,
+    bool simdEnabled)
+{
+    if (skinningMatrices.empty()) {
+        skinnedVertices.assign(vertices.size(), QVector3D());
+        return;
+    }
+    skinnedVertices.resize(vertices.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, vertices.size()),
+        VertexSkinner(&vertices, &skinningMatrices, &skinnedVertices, simdEnabled && isSkinningSimdAvailable()));
+}
+
+void skinTriangleVertexNormals(const std::vector<std::vector<size_t>> &triangles,
+    const std::vector<std::vector<QVector3D>> &triangleVertexNormals,
+    const SkinningVertices &vertices,
+    const std::vector<SkinningMatrix> &skinningMatrices,
+    std::vector<std::vector<QVector3D>> &skinnedTriangleVertexNormals)
+{
+    if (skinningMatrices.empty()) {
+        skinnedTriangleVertexNormals.assign(triangles.size(), std::vector<QVector3D>(3));
+        return;
+    }
+    skinnedTriangleVertexNormals.resize(triangles.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, triangles.size()),
+        TriangleVertexNormalSkinner(&triangles, &triangleVertexNormals, &vertices, &skinningMatrices,
+            &skinnedTriangleVertexNormals));
+}
@@ -0,0 +1,46 @@
+#ifndef DUST3D_SKINNING_H
+#define DUST3D_SKINNING_H
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <vector>
+#include "rig.h"
+
+// Bone matrix reduced to its upper 3x4 part, rows stored one after another
+struct SkinningMatrix
+{
+    float m[12];
+};
+
+// Vertices and their bone influences in SoA form, prepared once and skinned for every pose.
+// Each influence slot has its own array of weights and matrix offsets (bone index * 12),
+// unused slots have zero weight and point to the first matrix, so the kernels don't branch
+struct SkinningVertices
+{
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<qint32> matrixOffsets[MAX_WEIGHT_NUM];
+    std::vector<float> weights[MAX_WEIGHT_NUM];
+
+    void prepare(const std::vector<QVector3D> &vertices, const RigWeights &rigWeights);
+    size_t size() const
+    {
+        return x.size();
+    }
+};
+
+void skinningMatricesFromTransforms(const std::vector<QMatrix4x4> &transforms,
+    std::vector<SkinningMatrix> &skinningMatrices);
+// Uses the AVX2 kernel when the CPU supports it, unless simdEnabled is false
+void skinVertices(const SkinningVertices &vertices,
+    const std::vector<SkinningMatrix> &skinningMatrices,
+    std::vector<QVector3D> &skinnedVertices,
+    bool simdEnabled=true);
+void skinTriangleVertexNormals(const std::vector<std::vector<size_t>> &triangles,
+    const std::vector<std::vector<QVector3D>> &triangleVertexNormals,
+    const SkinningVertices &vertices,
+    const std::vector<SkinningMatrix> &skinningMatrices,
+    std::vector<std::vector<QVector3D>> &skinnedTriangleVertexNormals);
+bool isSkinningSimdAvailable();
+
+#endif
@@ -0,0 +1,98 @@
+#include <QElapsedTimer>
+#include <QMatrix4x4>
+#include <QDebug>
+#include "skinningbenchmark.h"
+#include "skinning.h"
+#include "meshgenerator.h"
+#include "riggenerator.h"
+#include "util.h"
+
+// Number of poses skinned per iteration, a single pose of the example models takes well under a millisecond
+static const int g_posesPerIteration = 100;
+
+// Each bone turns around its head a little further than the previous pose,
+// the matrices are not meaningful as an animation, only the amount of work matters
+static void makePose(const std::vector<RigBone> &bones, int poseIndex,
+    std::vector<SkinningMatrix> *skinningMatrices)
+{
+    std::vector<QMatrix4x4> transforms(bones.size());
+    for (size_t i = 0; i < bones.size(); ++i) {
+        const auto &bone = bones[i];
+        QMatrix4x4 &transform = transforms[i];
+        transform.translate(bone.headPosition);
+        transform.rotate(poseIndex * 0.5f + i, QVector3D(0, 1, 0));
+        transform.translate(-bone.headPosition);
+    }
+    skinningMatricesFromTransforms(transforms, *skinningMatrices);
+}
+
+static double skinPoses(const SkinningVertices &skinningVertices,
+    const std::vector<std::vector<SkinningMatrix>> &poses, int iterations, bool simdEnabled)
+{
+    std::vector<QVector3D> skinnedVertices;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < iterations; ++i) {
+        for (const auto &pose: poses)
+            skinVertices(skinningVertices, pose, skinnedVertices, simdEnabled);
+    }
+    qint64 nanoseconds = timer.nsecsElapsed();
+    if (nanoseconds <= 0)
+        return 0.0;
+    return (double)skinningVertices.size() * poses.size() * iterations * 1000000000.0 / nanoseconds;
+}
+
+void runSkinningBenchmark(Benchmark *benchmark)
+{
+    for (const auto &filename: benchmark->modelFilenames()) {
+        QString name = Benchmark::modelName(filename);
+
+        Snapshot snapshot;
+        if (!Benchmark::loadModel(filename, &snapshot)) {
+            qDebug() << "Load model failed:" << filename;
+            continue;
+        }
+
+        RigType rigType = RigTypeFromString(valueOfKeyInMapOrEmpty(snapshot.canvas, "rigType").toUtf8().constData());
+        if (RigType::None == rigType)
+            continue;
+
+        MeshGenerator *meshGenerator = new MeshGenerator(new Snapshot(snapshot));
+        meshGenerator->generate();
+        Object *object = meshGenerator->takeObject();
+        delete meshGenerator;
+        if (nullptr == object)
+            continue;
+
+        RigGenerator *rigGenerator = new RigGenerator(rigType, *object);
+        rigGenerator->generate();
+        std::vector<RigBone> *rigBones = rigGenerator->takeResultBones();
+        RigWeights *rigWeights = rigGenerator->takeResultWeights();
+        delete rigGenerator;
+
+        if (nullptr != rigBones && nullptr != rigWeights && !rigBones->empty()) {
+            QElapsedTimer timer;
+            timer.start();
+            SkinningVertices skinningVertices;
+            skinningVertices.prepare(object->vertices, *rigWeights);
+            benchmark->addResult("skinning", name, "prepare.milliseconds", Benchmark::Kind::Time,
+                timer.nsecsElapsed() / 1000000.0);
+
+            std::vector<std::vector<SkinningMatrix>> poses(g_posesPerIteration);
+            for (int i = 0; i < g_posesPerIteration; ++i)
+                makePose(*rigBones, i, &poses[i]);
+
+            benchmark->addResult("skinning", name, "scalar.verticesPerSecond", Benchmark::Kind::Rate,
+                skinPoses(skinningVertices, poses, benchmark->iterations(), false));
+            if (isSkinningSimdAvailable()) {
+                benchmark->addResult("skinning", name, "simd.verticesPerSecond", Benchmark::Kind::Rate,
+                    skinPoses(skinningVertices, poses, benchmark->iterations(), true));
+            }
+            benchmark->addResult("skinning", name, "vertices", Benchmark::Kind::Count, skinningVertices.size());
+        }
+
+        delete rigBones;
+        delete rigWeights;
+        delete object;
+    }
+}
@@ -0,0 +1,7 @@
+#ifndef DUST3D_SKINNING_BENCHMARK_H
+#define DUST3D_SKINNING_BENCHMARK_H
+#include "benchmark.h"
+
+void runSkinningBenchmark(Benchmark *benchmark);
+
+#endif
@@ -0,0 +1,70 @@
+#include <QElapsedTimer>
+#include <QDebug>
+#include "strokemeshbenchmark.h"
+#include "strokemeshbuilder.h"
+#include "meshgenerator.h"
+
+static void addBuildResults(Benchmark *benchmark, const QString &name, const QString &mode,
+    size_t buildCount, qint64 nanoseconds, quint64 allocationCount)
+{
+    benchmark->addResult("strokeMesh", name, mode + ".partsPerSecond", Benchmark::Kind::Rate,
+        nanoseconds > 0 ? buildCount * 1000000000.0 / nanoseconds : 0.0);
+    benchmark->addResult("strokeMesh", name, mode + ".allocationsPerPart", Benchmark::Kind::Memory,
+        (double)allocationCount / buildCount);
+}
+
+void runStrokeMeshBenchmark(Benchmark *benchmark)
+{
+    for (const auto &filename: benchmark->modelFilenames()) {
+        QString name = Benchmark::modelName(filename);
+        
+        Snapshot snapshot;
+        if (!Benchmark::loadModel(filename, &snapshot)) {
+            qDebug() << "Load model failed:" << filename;
+            continue;
+        }
+        
+        // The part builders point to deform maps owned by the cache context, so it lives until the replays finish
+        GeneratedCacheContext cacheContext;
+        std::vector<StrokeMeshBuilder> recordedBuilders;
+        MeshGenerator *meshGenerator = new MeshGenerator(new Snapshot(snapshot));
+        meshGenerator->setGeneratedCacheContext(&cacheContext);
+        meshGenerator->recordStrokeMeshBuilders(&recordedBuilders);
+        meshGenerator->generate();
+        delete meshGenerator;
+        if (recordedBuilders.empty())
+            continue;
+        
+        size_t buildCount = recordedBuilders.size() * benchmark->iterations();
+        QElapsedTimer timer;
+        
+        // One new builder per part, as parts were built before the builders got reused
+        quint64 allocationCount = Benchmark::allocationCount();
+        timer.start();
+        for (int i = 0; i < benchmark->iterations(); ++i) {
+            for (const auto &recordedBuilder: recordedBuilders) {
+                StrokeMeshBuilder *strokeMeshBuilder = new StrokeMeshBuilder;
+                strokeMeshBuilder->copyInputs(recordedBuilder);
+                strokeMeshBuilder->build();
+                delete strokeMeshBuilder;
+            }
+        }
+        addBuildResults(benchmark, name, "fresh", buildCount, timer.nsecsElapsed(),
+            Benchmark::allocationCount() - allocationCount);
+        
+        // One builder for all the parts, as GeneratedCacheContext keeps it
+        StrokeMeshBuilder strokeMeshBuilder;
+        allocationCount = Benchmark::allocationCount();
+        timer.restart();
+        for (int i = 0; i < benchmark->iterations(); ++i) {
+            for (const auto &recordedBuilder: recordedBuilders) {
+                strokeMeshBuilder.copyInputs(recordedBuilder);
+                strokeMeshBuilder.build();
+            }
+        }
+        addBuildResults(benchmark, name, "reused", buildCount, timer.nsecsElapsed(),
+            Benchmark::allocationCount() - allocationCount);
+        
+        benchmark->addResult("strokeMesh", name, "parts", Benchmark::Kind::Count, recordedBuilders.size());
+    }
+}
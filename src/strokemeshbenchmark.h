@@ -0,0 +1,7 @@
+#ifndef DUST3D_STROKE_MESH_BENCHMARK_H
+#define DUST3D_STROKE_MESH_BENCHMARK_H
+#include "benchmark.h"
+
+void runStrokeMeshBenchmark(Benchmark *benchmark);
+
+#endif
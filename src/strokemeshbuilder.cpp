@@ -53,9 +53,9 @@ void StrokeMeshBuilder::setDeformUnified(bool unified)
     m_deformUnified = unified;
 }
 
-void StrokeMeshBuilder::setDeformMapImage(const QImage *image)
+void StrokeMeshBuilder::setDeformMap(const DeformMap *deformMap)
 {
-    m_deformMapImage = image;
+    m_deformMap = deformMap;
 }
 
 void StrokeMeshBuilder::setHollowThickness(float hollowThickness)
@@ -170,13 +170,14 @@ QVector3D StrokeMeshBuilder::calculateBaseNormalFromTraverseDirection(const QVec
     return reversed ? -baseNormal : baseNormal;
 }
 
-std::vector<QVector3D> StrokeMeshBuilder::makeCut(const QVector3D &cutCenter, 
+void StrokeMeshBuilder::makeCut(const QVector3D &cutCenter, 
     float radius, 
     const std::vector<QVector2D> &cutTemplate, 
     const QVector3D &cutNormal,
-    const QVector3D &baseNormal)
+    const QVector3D &baseNormal,
+    std::vector<QVector3D> &resultCut)
 {
-    std::vector<QVector3D> resultCut;
+    resultCut.clear();
     QVector3D u = QVector3D::crossProduct(cutNormal, baseNormal).normalized();
     QVector3D v = QVector3D::crossProduct(u, cutNormal).normalized();
     auto uFactor = u * radius;
@@ -184,7 +185,6 @@ std::vector<QVector3D> StrokeMeshBuilder::makeCut(const QVector3D &cutCenter,
     for (const auto &t: cutTemplate) {
         resultCut.push_back(cutCenter + (uFactor * t.x() + vFactor * t.y()));
     }
-    return resultCut;
 }
 
 void StrokeMeshBuilder::insertCutVertices(const std::vector<QVector3D> &cut,
@@ -231,6 +231,15 @@ void StrokeMeshBuilder::buildMesh()
         return;
     }
     
+    size_t totalCutVertices = 0;
+    for (const auto &nodeIndex: m_nodeIndices)
+        totalCutVertices += m_nodes[nodeIndex].cutTemplate.size();
+    m_generatedVertices.reserve(totalCutVertices);
+    m_generatedVerticesSourceNodeIndices.reserve(totalCutVertices);
+    m_generatedVerticesCutDirects.reserve(totalCutVertices);
+    m_generatedVerticesInfos.reserve(totalCutVertices);
+    m_cuts.resize(m_nodeIndices.size());
+    
     for (size_t i = 0; i < m_nodeIndices.size(); ++i) {
         auto &node = m_nodes[m_nodeIndices[i]];
         if (!qFuzzyIsNull(node.cutRotation)) {
@@ -239,11 +248,11 @@ void StrokeMeshBuilder::buildMesh()
             rotation.rotate(degree, node.traverseDirection);
             node.baseNormal = rotation * node.baseNormal;
         }
-        auto cutVertices = makeCut(node.position, node.radius, node.cutTemplate,
-            node.traverseDirection, node.baseNormal);
-        std::vector<size_t> cut;
-        insertCutVertices(cutVertices, &cut, node.index, node.traverseDirection);
-        m_cuts.push_back(cut);
+        makeCut(node.position, node.radius, node.cutTemplate,
+            node.traverseDirection, node.baseNormal, m_cutVertices);
+        auto &cut = m_cuts[i];
+        cut.clear();
+        insertCutVertices(m_cutVertices, &cut, node.index, node.traverseDirection);
     }
 }
 
@@ -267,7 +276,8 @@ void StrokeMeshBuilder::interpolateCutEdges()
     
     const auto &cut = m_cuts[bigCutIndex];
     double sumOfLegnth = 0;
-    std::vector<double> edgeLengths;
+    auto &edgeLengths = m_cutEdgeLengths;
+    edgeLengths.clear();
     edgeLengths.reserve(cut.size());
     for (size_t i = 0; i < cut.size(); ++i) {
         size_t j = (i + 1) % cut.size();
@@ -276,7 +286,10 @@ void StrokeMeshBuilder::interpolateCutEdges()
         sumOfLegnth += length;
     }
     double targetLength = 1.2 * sumOfLegnth / cut.size();
-    std::vector<std::vector<size_t>> newCuts(m_cuts.size());
+    auto &newCuts = m_interpolatedCuts;
+    newCuts.resize(m_cuts.size());
+    for (auto &it: newCuts)
+        it.clear();
     for (size_t index = 0; index < cut.size(); ++index) {
         size_t nextIndex = (index + 1) % cut.size();
         for (size_t cutIndex = 0; cutIndex < m_cuts.size(); ++cutIndex) {
@@ -306,23 +319,24 @@ void StrokeMeshBuilder::interpolateCutEdges()
         }
     }
 
-    m_cuts = newCuts;
+    // The old cuts are kept in the scratch buffer, so their capacity can be reused next time
+    m_cuts.swap(newCuts);
 }
 
 void StrokeMeshBuilder::stitchCuts()
 {
+    auto &edgeLoops = m_stitchingEdgeLoops;
+    edgeLoops.resize(2);
+    MeshStitcher stitcher;
+    stitcher.setVertices(&m_generatedVertices);
     for (size_t i = m_isRing ? 0 : 1; i < m_nodeIndices.size(); ++i) {
         size_t h = (i + m_nodeIndices.size() - 1) % m_nodeIndices.size();
         const auto &nodeH = m_nodes[m_nodeIndices[h]];
         const auto &nodeI = m_nodes[m_nodeIndices[i]];
-        const auto &cutH = m_cuts[h];
-        auto reversedCutI = edgeloopFlipped(m_cuts[i]);
-        std::vector<std::pair<std::vector<size_t>, QVector3D>> edgeLoops = {
-            {cutH, -nodeH.traverseDirection},
-            {reversedCutI, nodeI.traverseDirection},
-        };
-        MeshStitcher stitcher;
-        stitcher.setVertices(&m_generatedVertices);
+        edgeLoops[0].first = m_cuts[h];
+        edgeLoops[0].second = -nodeH.traverseDirection;
+        edgeLoops[1].first = edgeloopFlipped(m_cuts[i]);
+        edgeLoops[1].second = nodeI.traverseDirection;
         stitcher.stitch(edgeLoops);
         for (const auto &face: stitcher.newlyGeneratedFaces()) {
             m_generatedFaces.push_back(face);
@@ -752,8 +766,97 @@ QVector3D StrokeMeshBuilder::calculateDeformPosition(const QVector3D &vertexPosi
     return vertexPosition + (scaledProjct - projectRayOnRevisedNormal);
 }
 
+void StrokeMeshBuilder::DeformMapBatch::resize(size_t size)
+{
+    rayX.resize(size);
+    rayY.resize(size);
+    rayZ.resize(size);
+    baseNormalX.resize(size);
+    baseNormalY.resize(size);
+    baseNormalZ.resize(size);
+    traverseDirectionX.resize(size);
+    traverseDirectionY.resize(size);
+    traverseDirectionZ.resize(size);
+    mapX.resize(size);
+    cosines.resize(size);
+    sides.resize(size);
+    offsets.resize(size);
+}
+
+void StrokeMeshBuilder::applyDeformMap()
+{
+    size_t vertexCount = m_generatedVertices.size();
+    auto &batch = m_deformMapBatch;
+    batch.resize(vertexCount);
+    
+    float mapXFactor = (float)m_deformMap->width() / m_nodes.size();
+    for (size_t i = 0; i < vertexCount; ++i) {
+        const auto &position = m_generatedVertices[i];
+        const auto &node = m_nodes[m_generatedVerticesSourceNodeIndices[i]];
+        batch.rayX[i] = position.x() - node.position.x();
+        batch.rayY[i] = position.y() - node.position.y();
+        batch.rayZ[i] = position.z() - node.position.z();
+        batch.baseNormalX[i] = node.baseNormal.x();
+        batch.baseNormalY[i] = node.baseNormal.y();
+        batch.baseNormalZ[i] = node.baseNormal.z();
+        batch.traverseDirectionX[i] = node.traverseDirection.x();
+        batch.traverseDirectionY[i] = node.traverseDirection.y();
+        batch.traverseDirectionZ[i] = node.traverseDirection.z();
+        batch.mapX[i] = node.traverseOrder * mapXFactor;
+    }
+    
+    // Branch free part, the angle between base normal and ray is represented by cosine,
+    // and the side is the sign of (baseNormal x ray) . traverseDirection
+    float *rayX = batch.rayX.data();
+    float *rayY = batch.rayY.data();
+    float *rayZ = batch.rayZ.data();
+    const float *baseNormalX = batch.baseNormalX.data();
+    const float *baseNormalY = batch.baseNormalY.data();
+    const float *baseNormalZ = batch.baseNormalZ.data();
+    const float *traverseDirectionX = batch.traverseDirectionX.data();
+    const float *traverseDirectionY = batch.traverseDirectionY.data();
+    const float *traverseDirectionZ = batch.traverseDirectionZ.data();
+    float *cosines = batch.cosines.data();
+    float *sides = batch.sides.data();
+    for (size_t i = 0; i < vertexCount; ++i) {
+        float length2 = rayX[i] * rayX[i] + rayY[i] * rayY[i] + rayZ[i] * rayZ[i];
+        float inverseLength = length2 > 0.0f ? 1.0f / std::sqrt(length2) : 0.0f;
+        float cosine = (baseNormalX[i] * rayX[i] + baseNormalY[i] * rayY[i] + baseNormalZ[i] * rayZ[i]) * inverseLength;
+        cosines[i] = std::max(-1.0f, std::min(cosine, 1.0f));
+        float crossX = baseNormalY[i] * rayZ[i] - baseNormalZ[i] * rayY[i];
+        float crossY = baseNormalZ[i] * rayX[i] - baseNormalX[i] * rayZ[i];
+        float crossZ = baseNormalX[i] * rayY[i] - baseNormalY[i] * rayX[i];
+        sides[i] = crossX * traverseDirectionX[i] + crossY * traverseDirectionY[i] + crossZ * traverseDirectionZ[i];
+    }
+    
+    float mapYFactor = (float)m_deformMap->height() / 360.0f;
+    float *offsets = batch.offsets.data();
+    for (size_t i = 0; i < vertexCount; ++i) {
+        float degrees = std::acos(cosines[i]) * 180.0f / (float)M_PI;
+        if (sides[i] < 0)
+            degrees = 360.0f - degrees;
+        offsets[i] = m_deformMapScale * m_deformMap->sample(batch.mapX[i], degrees * mapYFactor);
+    }
+    
+    for (size_t i = 0; i < vertexCount; ++i) {
+        rayX[i] *= offsets[i];
+        rayY[i] *= offsets[i];
+        rayZ[i] *= offsets[i];
+    }
+    for (size_t i = 0; i < vertexCount; ++i) {
+        m_generatedVertices[i] += QVector3D(rayX[i], rayY[i], rayZ[i]);
+    }
+}
+
 void StrokeMeshBuilder::applyDeform()
 {
+    if (nullptr != m_deformMap && !m_deformMap->isNull())
+        applyDeformMap();
+    
+    if (qFuzzyCompare(m_deformThickness, (float)1.0) && 
+            qFuzzyCompare(m_deformWidth, (float)1.0))
+        return;
+    
     float maxRadius = 0.0;
     if (m_deformUnified) {
         for (const auto &node: m_nodes) {
@@ -766,16 +869,6 @@ void StrokeMeshBuilder::applyDeform()
         const auto &node = m_nodes[m_generatedVerticesSourceNodeIndices[i]];
         const auto &cutDirect = m_generatedVerticesCutDirects[i];
         auto ray = position - node.position;
-        if (nullptr != m_deformMapImage) {
-            float degrees = angleInRangle360BetweenTwoVectors(node.baseNormal, ray.normalized(), node.traverseDirection);
-            int x = (int)node.traverseOrder * m_deformMapImage->width() / m_nodes.size();
-            int y = degrees * m_deformMapImage->height() / 360.0;
-            if (y >= m_deformMapImage->height())
-                y = m_deformMapImage->height() - 1;
-            float gray = (float)(qGray(m_deformMapImage->pixelColor(x, y).rgb()) - 127) / 127;
-            position += m_deformMapScale * gray * ray;
-            ray = position - node.position;
-        }
         QVector3D sum;
         size_t count = 0;
         float deformUnifyFactor = m_deformUnified ? maxRadius / node.radius : 1.0;
@@ -799,6 +892,48 @@ bool StrokeMeshBuilder::buildBaseNormalsOnly()
     return prepare();
 }
 
+void StrokeMeshBuilder::clear()
+{
+    m_nodes.clear();
+    m_deformThickness = 1.0f;
+    m_deformWidth = 1.0f;
+    m_cutRotation = 0.0f;
+    m_baseNormalOnX = true;
+    m_baseNormalOnY = true;
+    m_baseNormalOnZ = true;
+    m_baseNormalAverageEnabled = false;
+    m_deformMap = nullptr;
+    m_deformMapScale = 0.0f;
+    m_hollowThickness = 0.0f;
+    m_deformUnified = false;
+    
+    m_isRing = false;
+    m_nodeIndices.clear();
+    m_generatedVertices.clear();
+    m_generatedVerticesCutDirects.clear();
+    m_generatedVerticesSourceNodeIndices.clear();
+    m_generatedVerticesInfos.clear();
+    m_generatedFaces.clear();
+    m_cuts.clear();
+}
+
+void StrokeMeshBuilder::copyInputs(const StrokeMeshBuilder &other)
+{
+    clear();
+    m_nodes = other.m_nodes;
+    m_deformThickness = other.m_deformThickness;
+    m_deformWidth = other.m_deformWidth;
+    m_cutRotation = other.m_cutRotation;
+    m_baseNormalOnX = other.m_baseNormalOnX;
+    m_baseNormalOnY = other.m_baseNormalOnY;
+    m_baseNormalOnZ = other.m_baseNormalOnZ;
+    m_baseNormalAverageEnabled = other.m_baseNormalAverageEnabled;
+    m_deformMap = other.m_deformMap;
+    m_deformMapScale = other.m_deformMapScale;
+    m_hollowThickness = other.m_hollowThickness;
+    m_deformUnified = other.m_deformUnified;
+}
+
 bool StrokeMeshBuilder::build()
 {
     if (!prepare())
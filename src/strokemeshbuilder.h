@@ -6,8 +6,8 @@
 #include <map>
 #include <set>
 #include <QMatrix4x4>
-#include <QImage>
 #include "positionkey.h"
+#include "deformmap.h"
 
 class StrokeMeshBuilder
 {
@@ -48,7 +48,7 @@ public:
     void setDeformThickness(float thickness);
     void setDeformWidth(float width);
     void setDeformUnified(bool unified);
-    void setDeformMapImage(const QImage *image);
+    void setDeformMap(const DeformMap *deformMap);
     void setDeformMapScale(float scale);
     void setHollowThickness(float hollowThickness);
     void enableBaseNormalOnX(bool enabled);
@@ -62,6 +62,9 @@ public:
     const QVector3D &nodeBaseNormal(size_t nodeIndex) const;
     size_t nodeTraverseOrder(size_t nodeIndex) const;
     bool build();
+    void clear();
+    // Takes the nodes, edges and settings of another builder which has not been built, keeping the buffers of this one
+    void copyInputs(const StrokeMeshBuilder &other);
     const std::vector<QVector3D> &generatedVertices();
     const std::vector<std::vector<size_t>> &generatedFaces();
     const std::vector<size_t> &generatedVerticesSourceNodeIndices();
@@ -83,7 +86,7 @@ private:
     bool m_baseNormalOnY = true;
     bool m_baseNormalOnZ = true;
     bool m_baseNormalAverageEnabled = false;
-    const QImage *m_deformMapImage = nullptr;
+    const DeformMap *m_deformMap = nullptr;
     float m_deformMapScale = 0.0f;
     float m_hollowThickness = 0.0f;
     bool m_deformUnified = false;
@@ -98,12 +101,40 @@ private:
     
     std::vector<std::vector<size_t>> m_cuts;
     
+    // Scratch buffers, kept across builds to avoid reallocation when the builder is reused
+    std::vector<QVector3D> m_cutVertices;
+    std::vector<std::vector<size_t>> m_interpolatedCuts;
+    std::vector<double> m_cutEdgeLengths;
+    std::vector<std::pair<std::vector<size_t>, QVector3D>> m_stitchingEdgeLoops;
+    
+    // Per vertex deform map inputs in SoA form, so the math can be batched
+    struct DeformMapBatch
+    {
+        std::vector<float> rayX;
+        std::vector<float> rayY;
+        std::vector<float> rayZ;
+        std::vector<float> baseNormalX;
+        std::vector<float> baseNormalY;
+        std::vector<float> baseNormalZ;
+        std::vector<float> traverseDirectionX;
+        std::vector<float> traverseDirectionY;
+        std::vector<float> traverseDirectionZ;
+        std::vector<float> mapX;
+        std::vector<float> cosines;
+        std::vector<float> sides;
+        std::vector<float> offsets;
+        
+        void resize(size_t size);
+    };
+    DeformMapBatch m_deformMapBatch;
+    
     bool prepare();
-    std::vector<QVector3D> makeCut(const QVector3D &cutCenter, 
+    void makeCut(const QVector3D &cutCenter, 
         float radius, 
         const std::vector<QVector2D> &cutTemplate, 
         const QVector3D &cutNormal,
-        const QVector3D &baseNormal);
+        const QVector3D &baseNormal,
+        std::vector<QVector3D> &resultCut);
     void insertCutVertices(const std::vector<QVector3D> &cut,
         std::vector<size_t> *vertices,
         size_t nodeIndex,
@@ -118,6 +149,7 @@ private:
     std::vector<size_t> edgeloopFlipped(const std::vector<size_t> &edgeLoop);
     void reviseNodeBaseNormal(Node &node);
     void applyDeform();
+    void applyDeformMap();
     void interpolateCutEdges();
     void stitchCuts();
 };
@@ -143,9 +143,9 @@ void StrokeModifier::finalize()
         createIntermediateCutTemplateEdges(node.cutTemplate, node.averageCutTemplateLength);
     }
     
-    auto oldEdges = m_edges;
+    m_oldEdges.swap(m_edges);
     m_edges.clear();
-    for (const auto &edge: oldEdges) {
+    for (const auto &edge: m_oldEdges) {
         const Node &firstNode = m_nodes[edge.firstNodeIndex];
         const Node &secondNode = m_nodes[edge.secondNodeIndex];
         //float edgeLengthThreshold = (firstNode.radius + secondNode.radius) * 0.75;
@@ -258,6 +258,15 @@ void StrokeModifier::smooth()
     }
 }
 
+void StrokeModifier::clear()
+{
+    m_nodes.clear();
+    m_edges.clear();
+    m_oldEdges.clear();
+    m_intermediateAdditionEnabled = false;
+    m_smooth = false;
+}
+
 const std::vector<StrokeModifier::Node> &StrokeModifier::nodes() const
 {
     return m_nodes;
@@ -34,11 +34,13 @@ public:
     const std::vector<Node> &nodes() const;
     const std::vector<Edge> &edges() const;
     void finalize();
+    void clear();
     
 private:
     
     std::vector<Node> m_nodes;
     std::vector<Edge> m_edges;
+    std::vector<Edge> m_oldEdges;
     bool m_intermediateAdditionEnabled = false;
     bool m_smooth = false;
     
@@ -10,6 +10,7 @@
 #include "texturetype.h"
 #include "material.h"
 #include "preferences.h"
+#include "profiler.h"
 
 QColor TextureGenerator::m_defaultTextureColor = Qt::transparent;
 
@@ -177,6 +178,7 @@ bool TextureGenerator::hasTransparencySettings()
 
 void TextureGenerator::generate()
 {
+    ProfileScope profileScope("textureGeneration");
     m_resultMesh = new Model(*m_object);
     
     if (nullptr == m_object->triangleVertexUvs())
@@ -1,4 +1,8 @@
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+#include <tbb/blocked_range.h>
 #include <map>
+#include <algorithm>
 #include "trianglesourcenoderesolve.h"
 #include "positionkey.h"
 
@@ -17,119 +21,343 @@ struct CandidateEdge
     float length;
 };
 
+struct TriangleHalfEdge
+{
+    int lowVertexIndex;
+    int highVertexIndex;
+    int triangleIndex;
+    int cornerIndex;
+    
+    bool operator<(const TriangleHalfEdge &other) const
+    {
+        if (lowVertexIndex != other.lowVertexIndex)
+            return lowVertexIndex < other.lowVertexIndex;
+        if (highVertexIndex != other.highVertexIndex)
+            return highVertexIndex < other.highVertexIndex;
+        if (triangleIndex != other.triangleIndex)
+            return triangleIndex < other.triangleIndex;
+        return cornerIndex < other.cornerIndex;
+    }
+};
+
+// Surviving colored half edge of one undirected edge, fromVertexIndex is -1 when none survived
+struct ColorEdgeState
+{
+    int fromVertexIndex;
+    int toVertexIndex;
+    HalfColorEdge edge;
+};
+
+class VertexSourceFinder
+{
+public:
+    VertexSourceFinder(const std::vector<QVector3D> *vertices,
+            const std::map<PositionKey, std::pair<QUuid, QUuid>> *positionMap,
+            std::vector<std::pair<QUuid, QUuid>> *vertexSources,
+            std::vector<char> *vertexHasSource) :
+        m_vertices(vertices),
+        m_positionMap(positionMap),
+        m_vertexSources(vertexSources),
+        m_vertexHasSource(vertexHasSource)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t x = range.begin(); x != range.end(); ++x) {
+            auto findPosition = m_positionMap->find(PositionKey((*m_vertices)[x]));
+            if (findPosition == m_positionMap->end())
+                continue;
+            (*m_vertexSources)[x] = findPosition->second;
+            (*m_vertexHasSource)[x] = 1;
+        }
+    }
+private:
+    const std::vector<QVector3D> *m_vertices = nullptr;
+    const std::map<PositionKey, std::pair<QUuid, QUuid>> *m_positionMap = nullptr;
+    std::vector<std::pair<QUuid, QUuid>> *m_vertexSources = nullptr;
+    std::vector<char> *m_vertexHasSource = nullptr;
+};
+
+class TriangleSourceChooser
+{
+public:
+    TriangleSourceChooser(const std::vector<std::vector<size_t>> *triangles,
+            const std::vector<std::pair<QUuid, QUuid>> *vertexSources,
+            const std::vector<char> *vertexHasSource,
+            std::vector<std::pair<QUuid, QUuid>> *triangleSourceNodes,
+            std::vector<char> *triangleBroken) :
+        m_triangles(triangles),
+        m_vertexSources(vertexSources),
+        m_vertexHasSource(vertexHasSource),
+        m_triangleSourceNodes(triangleSourceNodes),
+        m_triangleBroken(triangleBroken)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t x = range.begin(); x != range.end(); ++x) {
+            const auto &triangle = (*m_triangles)[x];
+            std::vector<std::pair<std::pair<QUuid, QUuid>, int>> colorTypes;
+            for (int i = 0; i < 3; i++) {
+                int index = triangle[i];
+                if (!(*m_vertexHasSource)[index])
+                    continue;
+                const std::pair<QUuid, QUuid> &source = (*m_vertexSources)[index];
+                bool colorExisted = false;
+                for (auto j = 0u; j < colorTypes.size(); j++) {
+                    if (colorTypes[j].first == source) {
+                        colorTypes[j].second++;
+                        colorExisted = true;
+                        break;
+                    }
+                }
+                if (!colorExisted) {
+                    colorTypes.push_back(std::make_pair(source, 1));
+                }
+            }
+            if (colorTypes.empty()) {
+                //qDebug() << "All vertices of a triangle can't find a color";
+                (*m_triangleSourceNodes)[x] = std::make_pair(QUuid(), QUuid());
+                (*m_triangleBroken)[x] = 1;
+                continue;
+            }
+            if (colorTypes.size() != 1 || 3 == colorTypes[0].second) {
+                std::sort(colorTypes.begin(), colorTypes.end(), [](const std::pair<std::pair<QUuid, QUuid>, int> &a, const std::pair<std::pair<QUuid, QUuid>, int> &b) -> bool {
+                    return a.second > b.second;
+                });
+            }
+            (*m_triangleSourceNodes)[x] = colorTypes[0].first;
+        }
+    }
+private:
+    const std::vector<std::vector<size_t>> *m_triangles = nullptr;
+    const std::vector<std::pair<QUuid, QUuid>> *m_vertexSources = nullptr;
+    const std::vector<char> *m_vertexHasSource = nullptr;
+    std::vector<std::pair<QUuid, QUuid>> *m_triangleSourceNodes = nullptr;
+    std::vector<char> *m_triangleBroken = nullptr;
+};
+
+class ColorEdgeFolder
+{
+public:
+    ColorEdgeFolder(const std::vector<std::vector<size_t>> *triangles,
+            const std::vector<std::pair<QUuid, QUuid>> *triangleSourceNodes,
+            const std::vector<TriangleHalfEdge> *halfEdges,
+            const std::vector<size_t> *edgeBegins,
+            std::vector<ColorEdgeState> *edgeStates) :
+        m_triangles(triangles),
+        m_triangleSourceNodes(triangleSourceNodes),
+        m_halfEdges(halfEdges),
+        m_edgeBegins(edgeBegins),
+        m_edgeStates(edgeStates)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t edgeIndex = range.begin(); edgeIndex != range.end(); ++edgeIndex) {
+            // Replay the colored half edges of this undirected edge in triangle order,
+            // a half edge cancels its opposite or else becomes the pending one
+            ColorEdgeState state;
+            state.fromVertexIndex = -1;
+            state.toVertexIndex = -1;
+            for (size_t i = (*m_edgeBegins)[edgeIndex]; i < (*m_edgeBegins)[edgeIndex + 1]; ++i) {
+                const auto &halfEdge = (*m_halfEdges)[i];
+                const auto &triangle = (*m_triangles)[halfEdge.triangleIndex];
+                int fromVertexIndex = triangle[halfEdge.cornerIndex];
+                int toVertexIndex = triangle[(halfEdge.cornerIndex + 1) % 3];
+                if (state.fromVertexIndex == toVertexIndex && state.toVertexIndex == fromVertexIndex) {
+                    state.fromVertexIndex = -1;
+                    state.toVertexIndex = -1;
+                    continue;
+                }
+                state.fromVertexIndex = fromVertexIndex;
+                state.toVertexIndex = toVertexIndex;
+                state.edge.cornVertexIndex = triangle[(halfEdge.cornerIndex + 2) % 3];
+                state.edge.source = (*m_triangleSourceNodes)[halfEdge.triangleIndex];
+            }
+            (*m_edgeStates)[edgeIndex] = state;
+        }
+    }
+private:
+    const std::vector<std::vector<size_t>> *m_triangles = nullptr;
+    const std::vector<std::pair<QUuid, QUuid>> *m_triangleSourceNodes = nullptr;
+    const std::vector<TriangleHalfEdge> *m_halfEdges = nullptr;
+    const std::vector<size_t> *m_edgeBegins = nullptr;
+    std::vector<ColorEdgeState> *m_edgeStates = nullptr;
+};
+
+class RemainVertexSourceFixer
+{
+public:
+    RemainVertexSourceFixer(const std::vector<size_t> *vertexTriangleBegins,
+            const std::vector<size_t> *vertexTriangles,
+            const std::vector<std::pair<QUuid, QUuid>> *triangleSourceNodes,
+            std::vector<std::pair<QUuid, QUuid>> *vertexSourceNodes) :
+        m_vertexTriangleBegins(vertexTriangleBegins),
+        m_vertexTriangles(vertexTriangles),
+        m_triangleSourceNodes(triangleSourceNodes),
+        m_vertexSourceNodes(vertexSourceNodes)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        std::vector<std::pair<QUuid, QUuid>> sources;
+        for (size_t vertexIndex = range.begin(); vertexIndex != range.end(); ++vertexIndex) {
+            size_t begin = (*m_vertexTriangleBegins)[vertexIndex];
+            size_t end = (*m_vertexTriangleBegins)[vertexIndex + 1];
+            if (begin == end)
+                continue;
+            if (!(*m_vertexSourceNodes)[vertexIndex].second.isNull())
+                continue;
+            sources.clear();
+            for (size_t i = begin; i < end; ++i)
+                sources.push_back((*m_triangleSourceNodes)[(*m_vertexTriangles)[i]]);
+            std::sort(sources.begin(), sources.end());
+            // The most used source wins, ties go to the smallest source
+            size_t bestCount = 0;
+            size_t bestIndex = 0;
+            for (size_t i = 0; i < sources.size(); ) {
+                size_t j = i + 1;
+                while (j < sources.size() && sources[j] == sources[i])
+                    ++j;
+                if (j - i > bestCount) {
+                    bestCount = j - i;
+                    bestIndex = i;
+                }
+                i = j;
+            }
+            (*m_vertexSourceNodes)[vertexIndex] = sources[bestIndex];
+        }
+    }
+private:
+    const std::vector<size_t> *m_vertexTriangleBegins = nullptr;
+    const std::vector<size_t> *m_vertexTriangles = nullptr;
+    const std::vector<std::pair<QUuid, QUuid>> *m_triangleSourceNodes = nullptr;
+    std::vector<std::pair<QUuid, QUuid>> *m_vertexSourceNodes = nullptr;
+};
+
 static void fixRemainVertexSourceNodes(const Object &object, std::vector<std::pair<QUuid, QUuid>> &triangleSourceNodes,
     std::vector<std::pair<QUuid, QUuid>> *vertexSourceNodes)
 {
     if (nullptr != vertexSourceNodes) {
-        std::map<size_t, std::map<std::pair<QUuid, QUuid>, size_t>> remainVertexSourcesMap;
-        for (size_t faceIndex = 0; faceIndex < object.triangles.size(); ++faceIndex) {
-            for (const auto &vertexIndex: object.triangles[faceIndex]) {
-                if (!(*vertexSourceNodes)[vertexIndex].second.isNull())
-                    continue;
-                remainVertexSourcesMap[vertexIndex][triangleSourceNodes[faceIndex]]++;
-            }
+        std::vector<size_t> vertexTriangleBegins(object.vertices.size() + 1, 0);
+        for (const auto &triangle: object.triangles) {
+            for (const auto &vertexIndex: triangle)
+                ++vertexTriangleBegins[vertexIndex + 1];
         }
-        for (const auto &it: remainVertexSourcesMap) {
-            (*vertexSourceNodes)[it.first] = std::max_element(it.second.begin(), it.second.end(), [](
-                    const std::map<std::pair<QUuid, QUuid>, size_t>::value_type &first,
-                    const std::map<std::pair<QUuid, QUuid>, size_t>::value_type &second) {
-                return first.second < second.second;
-            })->first;
+        for (size_t vertexIndex = 0; vertexIndex < object.vertices.size(); ++vertexIndex)
+            vertexTriangleBegins[vertexIndex + 1] += vertexTriangleBegins[vertexIndex];
+        std::vector<size_t> vertexTriangles(vertexTriangleBegins.back());
+        std::vector<size_t> nextSlots(vertexTriangleBegins.begin(), vertexTriangleBegins.end() - 1);
+        for (size_t faceIndex = 0; faceIndex < object.triangles.size(); ++faceIndex) {
+            for (const auto &vertexIndex: object.triangles[faceIndex])
+                vertexTriangles[nextSlots[vertexIndex]++] = faceIndex;
         }
+        tbb::parallel_for(tbb::blocked_range<size_t>(0, object.vertices.size()),
+            RemainVertexSourceFixer(&vertexTriangleBegins, &vertexTriangles, &triangleSourceNodes, vertexSourceNodes));
     }
 }
 
+static const HalfColorEdge *findHalfColorEdge(const std::vector<TriangleHalfEdge> &halfEdges,
+    const std::vector<size_t> &edgeBegins,
+    const std::vector<ColorEdgeState> &edgeStates,
+    int fromVertexIndex, int toVertexIndex)
+{
+    TriangleHalfEdge key = {std::min(fromVertexIndex, toVertexIndex), std::max(fromVertexIndex, toVertexIndex), -1, -1};
+    auto findEdge = std::upper_bound(edgeBegins.begin(), edgeBegins.end() - 1, key, [&](const TriangleHalfEdge &key, size_t begin) {
+        const auto &halfEdge = halfEdges[begin];
+        if (key.lowVertexIndex != halfEdge.lowVertexIndex)
+            return key.lowVertexIndex < halfEdge.lowVertexIndex;
+        return key.highVertexIndex < halfEdge.highVertexIndex;
+    });
+    if (findEdge == edgeBegins.begin())
+        return nullptr;
+    size_t edgeIndex = (findEdge - edgeBegins.begin()) - 1;
+    const auto &halfEdge = halfEdges[edgeBegins[edgeIndex]];
+    if (halfEdge.lowVertexIndex != key.lowVertexIndex || halfEdge.highVertexIndex != key.highVertexIndex)
+        return nullptr;
+    const auto &state = edgeStates[edgeIndex];
+    if (state.fromVertexIndex != fromVertexIndex || state.toVertexIndex != toVertexIndex)
+        return nullptr;
+    return &state.edge;
+}
+
 void triangleSourceNodeResolve(const Object &object, 
     const std::vector<std::pair<QVector3D, std::pair<QUuid, QUuid>>> &nodeVertices,
     std::vector<std::pair<QUuid, QUuid>> &triangleSourceNodes,
     std::vector<std::pair<QUuid, QUuid>> *vertexSourceNodes)
 {
-    std::map<int, std::pair<QUuid, QUuid>> vertexSourceMap;
     std::map<PositionKey, std::pair<QUuid, QUuid>> positionMap;
-    std::map<std::pair<int, int>, HalfColorEdge> halfColorEdgeMap;
-    std::set<int> brokenTriangleSet;
     for (const auto &it: nodeVertices) {
         positionMap.insert({PositionKey(it.first), it.second});
     }
-    if (nullptr != vertexSourceNodes)
+    std::vector<std::pair<QUuid, QUuid>> vertexSources(object.vertices.size());
+    std::vector<char> vertexHasSource(object.vertices.size(), 0);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, object.vertices.size()),
+        VertexSourceFinder(&object.vertices, &positionMap, &vertexSources, &vertexHasSource));
+    if (nullptr != vertexSourceNodes) {
         vertexSourceNodes->resize(object.vertices.size());
-    for (auto x = 0u; x < object.vertices.size(); x++) {
-        const QVector3D *resultVertex = &object.vertices[x];
-        std::pair<QUuid, QUuid> source;
-        auto findPosition = positionMap.find(PositionKey(*resultVertex));
-        if (findPosition != positionMap.end()) {
-            (*vertexSourceNodes)[x] = findPosition->second;
-            vertexSourceMap[x] = findPosition->second;
+        for (size_t x = 0; x < object.vertices.size(); ++x) {
+            if (vertexHasSource[x])
+                (*vertexSourceNodes)[x] = vertexSources[x];
         }
     }
+    
+    triangleSourceNodes.resize(object.triangles.size());
+    std::vector<char> triangleBroken(object.triangles.size(), 0);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, object.triangles.size()),
+        TriangleSourceChooser(&object.triangles, &vertexSources, &vertexHasSource,
+            &triangleSourceNodes, &triangleBroken));
+    
+    std::vector<int> brokenTriangles;
+    std::vector<TriangleHalfEdge> halfEdges;
+    halfEdges.reserve(object.triangles.size() * 3);
     for (auto x = 0u; x < object.triangles.size(); x++) {
-        const auto triangle = object.triangles[x];
-        std::vector<std::pair<std::pair<QUuid, QUuid>, int>> colorTypes;
-        for (int i = 0; i < 3; i++) {
-            int index = triangle[i];
-            const auto &findResult = vertexSourceMap.find(index);
-            if (findResult != vertexSourceMap.end()) {
-                std::pair<QUuid, QUuid> source = findResult->second;
-                bool colorExisted = false;
-                for (auto j = 0u; j < colorTypes.size(); j++) {
-                    if (colorTypes[j].first == source) {
-                        colorTypes[j].second++;
-                        colorExisted = true;
-                        break;
-                    }
-                }
-                if (!colorExisted) {
-                    colorTypes.push_back(std::make_pair(source, 1));
-                }
-            }
-        }
-        if (colorTypes.empty()) {
-            //qDebug() << "All vertices of a triangle can't find a color";
-            triangleSourceNodes.push_back(std::make_pair(QUuid(), QUuid()));
-            brokenTriangleSet.insert(x);
+        if (triangleBroken[x]) {
+            brokenTriangles.push_back(x);
             continue;
         }
-        if (colorTypes.size() != 1 || 3 == colorTypes[0].second) {
-            std::sort(colorTypes.begin(), colorTypes.end(), [](const std::pair<std::pair<QUuid, QUuid>, int> &a, const std::pair<std::pair<QUuid, QUuid>, int> &b) -> bool {
-                return a.second > b.second;
-            });
-        }
-        std::pair<QUuid, QUuid> choosenColor = colorTypes[0].first;
-        triangleSourceNodes.push_back(choosenColor);
+        const auto &triangle = object.triangles[x];
         for (int i = 0; i < 3; i++) {
-            int oppositeStartIndex = triangle[(i + 1) % 3];
-            int oppositeStopIndex = triangle[i];
-            auto oppositePair = std::make_pair(oppositeStartIndex, oppositeStopIndex);
-            if (halfColorEdgeMap.find(oppositePair) != halfColorEdgeMap.end()) {
-                halfColorEdgeMap.erase(oppositePair);
-                continue;
-            }
-            auto selfPair = std::make_pair(oppositeStopIndex, oppositeStartIndex);
-            HalfColorEdge edge;
-            edge.cornVertexIndex = triangle[(i + 2) % 3];
-            edge.source = choosenColor;
-            halfColorEdgeMap[selfPair] = edge;
+            int fromVertexIndex = triangle[i];
+            int toVertexIndex = triangle[(i + 1) % 3];
+            halfEdges.push_back({std::min(fromVertexIndex, toVertexIndex), std::max(fromVertexIndex, toVertexIndex), (int)x, i});
         }
     }
+    tbb::parallel_sort(halfEdges.begin(), halfEdges.end());
+    std::vector<size_t> edgeBegins;
+    for (size_t i = 0; i < halfEdges.size(); ++i) {
+        if (0 == i ||
+                halfEdges[i].lowVertexIndex != halfEdges[i - 1].lowVertexIndex ||
+                halfEdges[i].highVertexIndex != halfEdges[i - 1].highVertexIndex)
+            edgeBegins.push_back(i);
+    }
+    size_t edgeCount = edgeBegins.size();
+    edgeBegins.push_back(halfEdges.size());
+    std::vector<ColorEdgeState> edgeStates(edgeCount);
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, edgeCount),
+        ColorEdgeFolder(&object.triangles, &triangleSourceNodes, &halfEdges, &edgeBegins, &edgeStates));
+    
+    // Broken triangles are rare, so they are paired with the colored neighbours serially
     std::map<std::pair<int, int>, int> brokenTriangleMapByEdge;
     std::vector<CandidateEdge> candidateEdges;
-    for (const auto &x: brokenTriangleSet) {
-        const auto triangle = object.triangles[x];
+    for (const auto &x: brokenTriangles) {
+        const auto &triangle = object.triangles[x];
         for (int i = 0; i < 3; i++) {
             int oppositeStartIndex = triangle[(i + 1) % 3];
             int oppositeStopIndex = triangle[i];
             auto selfPair = std::make_pair(oppositeStopIndex, oppositeStartIndex);
             brokenTriangleMapByEdge[selfPair] = x;
-            auto oppositePair = std::make_pair(oppositeStartIndex, oppositeStopIndex);
-            const auto &findOpposite = halfColorEdgeMap.find(oppositePair);
-            if (findOpposite == halfColorEdgeMap.end())
+            const HalfColorEdge *findOpposite = findHalfColorEdge(halfEdges, edgeBegins, edgeStates,
+                oppositeStartIndex, oppositeStopIndex);
+            if (nullptr == findOpposite)
                 continue;
             QVector3D selfPositions[3] = {
                 object.vertices[triangle[i]], // A
                 object.vertices[triangle[(i + 1) % 3]], // B
                 object.vertices[triangle[(i + 2) % 3]] // C
             };
-            QVector3D oppositeCornPosition = object.vertices[findOpposite->second.cornVertexIndex]; // D
+            QVector3D oppositeCornPosition = object.vertices[findOpposite->cornVertexIndex]; // D
             QVector3D AB = selfPositions[1] - selfPositions[0];
             float length = AB.length();
             QVector3D AC = selfPositions[2] - selfPositions[0];
@@ -148,7 +376,7 @@ void triangleSourceNodeResolve(const Object &object,
             candidate.length = length;
             candidate.fromVertexIndex = triangle[i];
             candidate.toVertexIndex = triangle[(i + 1) % 3];
-            candidate.source = findOpposite->second.source;
+            candidate.source = findOpposite->source;
             candidateEdges.push_back(candidate);
         }
     }
@@ -163,9 +391,10 @@ void triangleSourceNodeResolve(const Object &object,
             return false;
         return a.length > b.length;
     });
+    size_t brokenTriangleCount = brokenTriangles.size();
     for (auto cand = 0u; cand < candidateEdges.size(); cand++) {
         const auto &candidate = candidateEdges[cand];
-        if (brokenTriangleSet.empty())
+        if (0 == brokenTriangleCount)
             break;
         //qDebug() << "candidate dot[" << cand << "]:" << candidate.dot;
         std::vector<std::pair<int, int>> toResolvePairs;
@@ -175,12 +404,13 @@ void triangleSourceNodeResolve(const Object &object,
             if (findTriangle == brokenTriangleMapByEdge.end())
                 continue;
             int x = findTriangle->second;
-            if (brokenTriangleSet.find(x) == brokenTriangleSet.end())
+            if (!triangleBroken[x])
                 continue;
-            brokenTriangleSet.erase(x);
+            triangleBroken[x] = 0;
+            --brokenTriangleCount;
             triangleSourceNodes[x] = candidate.source;
             //qDebug() << "resolved triangle:" << x;
-            const auto triangle = object.triangles[x];
+            const auto &triangle = object.triangles[x];
             for (int i = 0; i < 3; i++) {
                 int oppositeStartIndex = triangle[(i + 1) % 3];
                 int oppositeStopIndex = triangle[i];
@@ -1,8 +1,12 @@
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+#include <tbb/blocked_range.h>
 #include <cmath>
 #include <QtMath>
 #include <QFile>
 #include <unordered_set>
 #include <unordered_map>
+#include <algorithm>
 #include "util.h"
 #include "version.h"
 
@@ -150,105 +154,257 @@ bool pointInTriangle(const QVector3D &a, const QVector3D &b, const QVector3D &c,
     return r + t <= 1.0;
 }
 
+class TriangleCornerNormalWeighter
+{
+public:
+    TriangleCornerNormalWeighter(const std::vector<QVector3D> *vertices,
+            const std::vector<std::vector<size_t>> *triangles,
+            const std::vector<QVector3D> *triangleNormals,
+            const std::vector<size_t> *triangleCornerBegins,
+            std::vector<QVector3D> *angleAreaWeightedNormals) :
+        m_vertices(vertices),
+        m_triangles(triangles),
+        m_triangleNormals(triangleNormals),
+        m_triangleCornerBegins(triangleCornerBegins),
+        m_angleAreaWeightedNormals(angleAreaWeightedNormals)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t triangleIndex = range.begin(); triangleIndex != range.end(); ++triangleIndex) {
+            const auto &sourceTriangle = (*m_triangles)[triangleIndex];
+            if (sourceTriangle.size() != 3)
+                continue;
+            const auto &v1 = (*m_vertices)[sourceTriangle[0]];
+            const auto &v2 = (*m_vertices)[sourceTriangle[1]];
+            const auto &v3 = (*m_vertices)[sourceTriangle[2]];
+            float area = areaOfTriangle(v1, v2, v3);
+            float angles[] = {degreesBetweenVectors(v2-v1, v3-v1),
+                degreesBetweenVectors(v1-v2, v3-v2),
+                degreesBetweenVectors(v1-v3, v2-v3)};
+            size_t corner = (*m_triangleCornerBegins)[triangleIndex];
+            for (int i = 0; i < 3; ++i) {
+                if (sourceTriangle[i] >= m_vertices->size())
+                    continue;
+                (*m_angleAreaWeightedNormals)[corner++] = (*m_triangleNormals)[triangleIndex] * area * angles[i];
+            }
+        }
+    }
+private:
+    const std::vector<QVector3D> *m_vertices = nullptr;
+    const std::vector<std::vector<size_t>> *m_triangles = nullptr;
+    const std::vector<QVector3D> *m_triangleNormals = nullptr;
+    const std::vector<size_t> *m_triangleCornerBegins = nullptr;
+    std::vector<QVector3D> *m_angleAreaWeightedNormals = nullptr;
+};
+
+class VertexCornerNormalSmoother
+{
+public:
+    VertexCornerNormalSmoother(const std::vector<size_t> *vertexCornerBegins,
+            const std::vector<size_t> *vertexCorners,
+            const std::vector<size_t> *cornerTriangles,
+            const std::vector<QVector3D> *triangleNormals,
+            const std::vector<QVector3D> *angleAreaWeightedNormals,
+            float thresholdAngleDegrees,
+            std::vector<QVector3D> *triangleVertexNormals) :
+        m_vertexCornerBegins(vertexCornerBegins),
+        m_vertexCorners(vertexCorners),
+        m_cornerTriangles(cornerTriangles),
+        m_triangleNormals(triangleNormals),
+        m_angleAreaWeightedNormals(angleAreaWeightedNormals),
+        m_thresholdAngleDegrees(thresholdAngleDegrees),
+        m_triangleVertexNormals(triangleVertexNormals)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t vertexIndex = range.begin(); vertexIndex != range.end(); ++vertexIndex) {
+            size_t begin = (*m_vertexCornerBegins)[vertexIndex];
+            size_t end = (*m_vertexCornerBegins)[vertexIndex + 1];
+            for (size_t i = begin; i < end; ++i) {
+                size_t corner = (*m_vertexCorners)[i];
+                size_t triangleIndex = (*m_cornerTriangles)[corner];
+                QVector3D normal = (*m_angleAreaWeightedNormals)[corner];
+                for (size_t j = begin; j < end; ++j) {
+                    size_t otherCorner = (*m_vertexCorners)[j];
+                    size_t otherTriangleIndex = (*m_cornerTriangles)[otherCorner];
+                    if (triangleIndex == otherTriangleIndex)
+                        continue;
+                    if (degreesBetweenVectors((*m_triangleNormals)[triangleIndex], (*m_triangleNormals)[otherTriangleIndex]) > m_thresholdAngleDegrees)
+                        continue;
+                    normal += (*m_angleAreaWeightedNormals)[otherCorner];
+                }
+                normal.normalize();
+                (*m_triangleVertexNormals)[corner] = normal;
+            }
+        }
+    }
+private:
+    const std::vector<size_t> *m_vertexCornerBegins = nullptr;
+    const std::vector<size_t> *m_vertexCorners = nullptr;
+    const std::vector<size_t> *m_cornerTriangles = nullptr;
+    const std::vector<QVector3D> *m_triangleNormals = nullptr;
+    const std::vector<QVector3D> *m_angleAreaWeightedNormals = nullptr;
+    float m_thresholdAngleDegrees = 0;
+    std::vector<QVector3D> *m_triangleVertexNormals = nullptr;
+};
+
 void angleSmooth(const std::vector<QVector3D> &vertices,
     const std::vector<std::vector<size_t>> &triangles,
     const std::vector<QVector3D> &triangleNormals,
     float thresholdAngleDegrees,
     std::vector<QVector3D> &triangleVertexNormals)
 {
-    std::vector<std::vector<std::pair<size_t, size_t>>> triangleVertexNormalsMapByIndices(vertices.size());
-    std::vector<QVector3D> angleAreaWeightedNormals;
+    // Corners are numbered in triangle order and grouped by vertex, so each vertex smooths only its own corners
+    std::vector<size_t> triangleCornerBegins(triangles.size());
+    std::vector<size_t> cornerTriangles;
+    std::vector<size_t> cornerVertices;
+    cornerTriangles.reserve(triangles.size() * 3);
+    cornerVertices.reserve(triangles.size() * 3);
+    std::vector<size_t> vertexCornerBegins(vertices.size() + 1, 0);
     for (size_t triangleIndex = 0; triangleIndex < triangles.size(); ++triangleIndex) {
+        triangleCornerBegins[triangleIndex] = cornerTriangles.size();
         const auto &sourceTriangle = triangles[triangleIndex];
         if (sourceTriangle.size() != 3) {
             qDebug() << "Encounter non triangle";
             continue;
         }
-        const auto &v1 = vertices[sourceTriangle[0]];
-        const auto &v2 = vertices[sourceTriangle[1]];
-        const auto &v3 = vertices[sourceTriangle[2]];
-        float area = areaOfTriangle(v1, v2, v3);
-        float angles[] = {degreesBetweenVectors(v2-v1, v3-v1),
-            degreesBetweenVectors(v1-v2, v3-v2),
-            degreesBetweenVectors(v1-v3, v2-v3)};
         for (int i = 0; i < 3; ++i) {
             if (sourceTriangle[i] >= vertices.size()) {
                 qDebug() << "Invalid vertex index" << sourceTriangle[i] << "vertices size" << vertices.size();
                 continue;
             }
-            triangleVertexNormalsMapByIndices[sourceTriangle[i]].push_back({triangleIndex, angleAreaWeightedNormals.size()});
-            angleAreaWeightedNormals.push_back(triangleNormals[triangleIndex] * area * angles[i]);
+            cornerTriangles.push_back(triangleIndex);
+            cornerVertices.push_back(sourceTriangle[i]);
+            ++vertexCornerBegins[sourceTriangle[i] + 1];
         }
     }
-    triangleVertexNormals = angleAreaWeightedNormals;
-    std::map<std::pair<size_t, size_t>, float> degreesBetweenFacesMap;
-    for (size_t vertexIndex = 0; vertexIndex < vertices.size(); ++vertexIndex) {
-        const auto &triangleVertices = triangleVertexNormalsMapByIndices[vertexIndex];
-        for (const auto &triangleVertex: triangleVertices) {
-            for (const auto &otherTriangleVertex: triangleVertices) {
-                if (triangleVertex.first == otherTriangleVertex.first)
-                    continue;
-                float degrees = 0;
-                auto findDegreesResult = degreesBetweenFacesMap.find({triangleVertex.first, otherTriangleVertex.first});
-                if (findDegreesResult == degreesBetweenFacesMap.end()) {
-                    degrees = degreesBetweenVectors(triangleNormals[triangleVertex.first], triangleNormals[otherTriangleVertex.first]);
-                    degreesBetweenFacesMap.insert({{triangleVertex.first, otherTriangleVertex.first}, degrees});
-                    degreesBetweenFacesMap.insert({{otherTriangleVertex.first, triangleVertex.first}, degrees});
-                } else {
-                    degrees = findDegreesResult->second;
-                }
-                if (degrees > thresholdAngleDegrees) {
-                    continue;
-                }
-                triangleVertexNormals[triangleVertex.second] += angleAreaWeightedNormals[otherTriangleVertex.second];
+    for (size_t vertexIndex = 0; vertexIndex < vertices.size(); ++vertexIndex)
+        vertexCornerBegins[vertexIndex + 1] += vertexCornerBegins[vertexIndex];
+    std::vector<size_t> vertexCorners(cornerVertices.size());
+    std::vector<size_t> nextSlots(vertexCornerBegins.begin(), vertexCornerBegins.end() - 1);
+    for (size_t corner = 0; corner < cornerVertices.size(); ++corner)
+        vertexCorners[nextSlots[cornerVertices[corner]]++] = corner;
+    
+    std::vector<QVector3D> angleAreaWeightedNormals(cornerTriangles.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, triangles.size()),
+        TriangleCornerNormalWeighter(&vertices, &triangles, &triangleNormals,
+            &triangleCornerBegins, &angleAreaWeightedNormals));
+    
+    triangleVertexNormals.resize(angleAreaWeightedNormals.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, vertices.size()),
+        VertexCornerNormalSmoother(&vertexCornerBegins, &vertexCorners, &cornerTriangles,
+            &triangleNormals, &angleAreaWeightedNormals, thresholdAngleDegrees, &triangleVertexNormals));
+}
+
+struct QuadCandidateEdge
+{
+    size_t fromVertexIndex;
+    size_t toVertexIndex;
+    size_t triangleIndex;
+    size_t oppositeVertexIndex;
+    
+    bool operator<(const QuadCandidateEdge &other) const
+    {
+        if (fromVertexIndex != other.fromVertexIndex)
+            return fromVertexIndex < other.fromVertexIndex;
+        if (toVertexIndex != other.toVertexIndex)
+            return toVertexIndex < other.toVertexIndex;
+        return triangleIndex < other.triangleIndex;
+    }
+};
+
+class SharedQuadEdgeFinder
+{
+public:
+    SharedQuadEdgeFinder(const std::vector<QuadCandidateEdge> *edges,
+            const std::vector<PositionKey> *verticesPositionKeys,
+            const std::set<std::pair<PositionKey, PositionKey>> *sharedQuadEdges,
+            std::vector<size_t> *oppositeEdges) :
+        m_edges(edges),
+        m_verticesPositionKeys(verticesPositionKeys),
+        m_sharedQuadEdges(sharedQuadEdges),
+        m_oppositeEdges(oppositeEdges)
+    {
+    }
+    void operator()(const tbb::blocked_range<size_t> &range) const
+    {
+        for (size_t i = range.begin(); i != range.end(); ++i) {
+            const auto &edge = (*m_edges)[i];
+            auto pair = std::make_pair((*m_verticesPositionKeys)[edge.fromVertexIndex], (*m_verticesPositionKeys)[edge.toVertexIndex]);
+            if (m_sharedQuadEdges->find(pair) == m_sharedQuadEdges->end())
+                continue;
+            QuadCandidateEdge opposite = {edge.toVertexIndex, edge.fromVertexIndex, 0, 0};
+            auto findOpposite = std::lower_bound(m_edges->begin(), m_edges->end(), opposite);
+            if (findOpposite == m_edges->end() ||
+                    findOpposite->fromVertexIndex != opposite.fromVertexIndex ||
+                    findOpposite->toVertexIndex != opposite.toVertexIndex) {
+                //qDebug() << "Find opposite edge failed";
+                continue;
             }
+            (*m_oppositeEdges)[i] = findOpposite - m_edges->begin();
         }
     }
-    for (auto &item: triangleVertexNormals)
-        item.normalize();
-}
+private:
+    const std::vector<QuadCandidateEdge> *m_edges = nullptr;
+    const std::vector<PositionKey> *m_verticesPositionKeys = nullptr;
+    const std::set<std::pair<PositionKey, PositionKey>> *m_sharedQuadEdges = nullptr;
+    std::vector<size_t> *m_oppositeEdges = nullptr;
+};
 
 void recoverQuads(const std::vector<QVector3D> &vertices, const std::vector<std::vector<size_t>> &triangles, const std::set<std::pair<PositionKey, PositionKey>> &sharedQuadEdges, std::vector<std::vector<size_t>> &triangleAndQuads)
 {
     std::vector<PositionKey> verticesPositionKeys;
+    verticesPositionKeys.reserve(vertices.size());
     for (const auto &position: vertices) {
         verticesPositionKeys.push_back(PositionKey(position));
     }
-    std::map<std::pair<size_t, size_t>, std::pair<size_t, size_t>> triangleEdgeMap;
+    std::vector<QuadCandidateEdge> edges;
+    edges.reserve(triangles.size() * 3);
     for (size_t i = 0; i < triangles.size(); i++) {
         const auto &faceIndices = triangles[i];
         if (faceIndices.size() == 3) {
-            triangleEdgeMap[std::make_pair(faceIndices[0], faceIndices[1])] = std::make_pair(i, faceIndices[2]);
-            triangleEdgeMap[std::make_pair(faceIndices[1], faceIndices[2])] = std::make_pair(i, faceIndices[0]);
-            triangleEdgeMap[std::make_pair(faceIndices[2], faceIndices[0])] = std::make_pair(i, faceIndices[1]);
+            edges.push_back({faceIndices[0], faceIndices[1], i, faceIndices[2]});
+            edges.push_back({faceIndices[1], faceIndices[2], i, faceIndices[0]});
+            edges.push_back({faceIndices[2], faceIndices[0], i, faceIndices[1]});
         }
     }
-    std::unordered_set<size_t> unionedFaces;
-    std::vector<std::vector<size_t>> newUnionedFaceIndices;
-    for (const auto &edge: triangleEdgeMap) {
-        if (unionedFaces.find(edge.second.first) != unionedFaces.end())
+    // Sorted by vertex pair, the last triangle wins when several share the same half edge
+    tbb::parallel_sort(edges.begin(), edges.end());
+    size_t uniqueEdgeCount = 0;
+    for (size_t i = 0; i < edges.size(); ++i) {
+        if (i + 1 < edges.size() &&
+                edges[i + 1].fromVertexIndex == edges[i].fromVertexIndex &&
+                edges[i + 1].toVertexIndex == edges[i].toVertexIndex)
             continue;
-        auto pair = std::make_pair(verticesPositionKeys[edge.first.first], verticesPositionKeys[edge.first.second]);
-        if (sharedQuadEdges.find(pair) != sharedQuadEdges.end()) {
-            auto oppositeEdge = triangleEdgeMap.find(std::make_pair(edge.first.second, edge.first.first));
-            if (oppositeEdge == triangleEdgeMap.end()) {
-                //qDebug() << "Find opposite edge failed";
-            } else {
-                if (unionedFaces.find(oppositeEdge->second.first) == unionedFaces.end()) {
-                    unionedFaces.insert(edge.second.first);
-                    unionedFaces.insert(oppositeEdge->second.first);
-                    std::vector<size_t> indices;
-                    indices.push_back(edge.second.second);
-                    indices.push_back(edge.first.first);
-                    indices.push_back(oppositeEdge->second.second);
-                    indices.push_back(edge.first.second);
-                    triangleAndQuads.push_back(indices);
-                }
-            }
-        }
+        edges[uniqueEdgeCount++] = edges[i];
+    }
+    edges.resize(uniqueEdgeCount);
+    
+    std::vector<size_t> oppositeEdges(edges.size(), edges.size());
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, edges.size()),
+        SharedQuadEdgeFinder(&edges, &verticesPositionKeys, &sharedQuadEdges, &oppositeEdges));
+    
+    std::vector<bool> unionedFaces(triangles.size(), false);
+    for (size_t i = 0; i < edges.size(); ++i) {
+        if (oppositeEdges[i] == edges.size())
+            continue;
+        const auto &edge = edges[i];
+        const auto &oppositeEdge = edges[oppositeEdges[i]];
+        if (unionedFaces[edge.triangleIndex] || unionedFaces[oppositeEdge.triangleIndex])
+            continue;
+        unionedFaces[edge.triangleIndex] = true;
+        unionedFaces[oppositeEdge.triangleIndex] = true;
+        std::vector<size_t> indices;
+        indices.push_back(edge.oppositeVertexIndex);
+        indices.push_back(edge.fromVertexIndex);
+        indices.push_back(oppositeEdge.oppositeVertexIndex);
+        indices.push_back(edge.toVertexIndex);
+        triangleAndQuads.push_back(indices);
     }
     for (size_t i = 0; i < triangles.size(); i++) {
-        if (unionedFaces.find(i) == unionedFaces.end()) {
+        if (!unionedFaces[i]) {
             triangleAndQuads.push_back(triangles[i]);
         }
     }
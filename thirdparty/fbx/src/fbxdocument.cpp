@@ -13,6 +13,12 @@ namespace fbx {
 FBXDocument::FBXDocument()
 {
     version = 7400;
+    compressionLevel = 0;
+}
+
+void FBXDocument::setCompressionLevel(int level)
+{
+    compressionLevel = level;
 }
 
 void FBXDocument::read(string fname)
@@ -117,7 +123,8 @@ void FBXDocument::write(std::ofstream &output)
     writer.write(version);
 
     uint32_t offset = 27; // magic: 21+2, version: 4
-    for(FBXNode node : nodes) {
+    for(FBXNode &node : nodes) {
+        if(compressionLevel > 0) node.compressArrays(compressionLevel);
         offset += node.write(output, offset);
     }
     FBXNode nullNode;
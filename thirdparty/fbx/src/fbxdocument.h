@@ -15,6 +15,8 @@ public:
     void write(std::ofstream &output);
 
     void createBasicStructure();
+    // zlib level used for array properties on write, 0 writes them uncompressed
+    void setCompressionLevel(int level);
 
     std::vector<FBXNode> nodes;
 
@@ -23,6 +25,7 @@ public:
 
 private:
     std::uint32_t version;
+    int compressionLevel;
 };
 
 } // namespace fbx
@@ -64,28 +64,25 @@ uint32_t FBXNode::write(std::ofstream &output, uint32_t start_offset)
     }
 
     uint32_t propertyListLength = 0;
-    for(auto prop : properties) propertyListLength += prop.getBytes();
-    uint32_t bytes = 13 + name.length() + propertyListLength;
-    for(auto child : children) bytes += child.getBytes();
+    for(auto &prop : properties) propertyListLength += prop.getBytes();
 
-    if(bytes != getBytes()) throw std::string("bytes != getBytes()");
-    writer.write(start_offset + bytes); // endOffset
+    // endOffset is patched once the children have been streamed out
+    std::streampos endOffsetPos = output.tellp();
+    writer.write((uint32_t) 0); // endOffset
     writer.write((uint32_t) properties.size()); // numProperties
     writer.write(propertyListLength); // propertyListLength
     writer.write((uint8_t) name.length());
     writer.write(name);
 
-    //std::cout << "so: " << start_offset
-    //          << "\tbytes: " << bytes
-    //          << "\tnumProp: " << properties.size()
-    //          << "\tpropListLen: " << propertyListLength
-    //          << "\tnameLen: " << name.length()
-    //          << "\tname: " << name << "\n";
+    uint32_t bytes = 13 + name.length() + propertyListLength;
 
-    bytes = 13 + name.length() + propertyListLength;
+    for(auto &prop : properties) prop.write(output);
+    for(auto &child : children) bytes += child.write(output,  start_offset + bytes);
 
-    for(auto prop : properties) prop.write(output);
-    for(auto child : children) bytes += child.write(output,  start_offset + bytes);
+    std::streampos endPos = output.tellp();
+    output.seekp(endOffsetPos);
+    writer.write(start_offset + bytes); // endOffset
+    output.seekp(endPos);
 
     return bytes;
 }
@@ -137,47 +134,53 @@ void FBXNode::addProperty(float v) { addProperty(FBXProperty(v)); }
 void FBXNode::addProperty(double v) { addProperty(FBXProperty(v)); }
 void FBXNode::addProperty(int64_t v) { addProperty(FBXProperty(v)); }
 // arrays
-void FBXNode::addProperty(const std::vector<bool> v) { addProperty(FBXProperty(v)); }
-void FBXNode::addProperty(const std::vector<int32_t> v) { addProperty(FBXProperty(v)); }
-void FBXNode::addProperty(const std::vector<float> v) { addProperty(FBXProperty(v)); }
-void FBXNode::addProperty(const std::vector<double> v) { addProperty(FBXProperty(v)); }
-void FBXNode::addProperty(const std::vector<int64_t> v) { addProperty(FBXProperty(v)); }
+void FBXNode::addProperty(const std::vector<bool> &v) { addProperty(FBXProperty(v)); }
+void FBXNode::addProperty(const std::vector<int32_t> &v) { addProperty(FBXProperty(v)); }
+void FBXNode::addProperty(const std::vector<float> &v) { addProperty(FBXProperty(v)); }
+void FBXNode::addProperty(const std::vector<double> &v) { addProperty(FBXProperty(v)); }
+void FBXNode::addProperty(const std::vector<int64_t> &v) { addProperty(FBXProperty(v)); }
 // raw / string
-void FBXNode::addProperty(const std::vector<uint8_t> v, uint8_t type) { addProperty(FBXProperty(v, type)); }
+void FBXNode::addProperty(const std::vector<uint8_t> &v, uint8_t type) { addProperty(FBXProperty(v, type)); }
 void FBXNode::addProperty(const std::string v) { addProperty(FBXProperty(v)); }
 void FBXNode::addProperty(const char *v) { addProperty(FBXProperty(v)); }
 
-void FBXNode::addProperty(FBXProperty prop) { properties.push_back(prop); }
+void FBXNode::addProperty(FBXProperty prop) { properties.push_back(std::move(prop)); }
 
 
-void FBXNode::addPropertyNode(const std::string name, int16_t v) { FBXNode n(name); n.addProperty(v); addChild(n); }
-void FBXNode::addPropertyNode(const std::string name, bool v) { FBXNode n(name); n.addProperty(v); addChild(n); }
-void FBXNode::addPropertyNode(const std::string name, int32_t v) { FBXNode n(name); n.addProperty(v); addChild(n); }
-void FBXNode::addPropertyNode(const std::string name, float v) { FBXNode n(name); n.addProperty(v); addChild(n); }
-void FBXNode::addPropertyNode(const std::string name, double v) { FBXNode n(name); n.addProperty(v); addChild(n); }
-void FBXNode::addPropertyNode(const std::string name, int64_t v) { FBXNode n(name); n.addProperty(v); addChild(n); }
-void FBXNode::addPropertyNode(const std::string name, const std::vector<bool> v) { FBXNode n(name); n.addProperty(v); addChild(n); }
-void FBXNode::addPropertyNode(const std::string name, const std::vector<int32_t> v) { FBXNode n(name); n.addProperty(v); addChild(n); }
-void FBXNode::addPropertyNode(const std::string name, const std::vector<float> v) { FBXNode n(name); n.addProperty(v); addChild(n); }
-void FBXNode::addPropertyNode(const std::string name, const std::vector<double> v) { FBXNode n(name); n.addProperty(v); addChild(n); }
-void FBXNode::addPropertyNode(const std::string name, const std::vector<int64_t> v) { FBXNode n(name); n.addProperty(v); addChild(n); }
-void FBXNode::addPropertyNode(const std::string name, const std::vector<uint8_t> v, uint8_t type) { FBXNode n(name); n.addProperty(v, type); addChild(n); }
-void FBXNode::addPropertyNode(const std::string name, const std::string v) { FBXNode n(name); n.addProperty(v); addChild(n); }
-void FBXNode::addPropertyNode(const std::string name, const char *v) { FBXNode n(name); n.addProperty(v); addChild(n); }
+void FBXNode::addPropertyNode(const std::string name, int16_t v) { FBXNode n(name); n.addProperty(v); addChild(std::move(n)); }
+void FBXNode::addPropertyNode(const std::string name, bool v) { FBXNode n(name); n.addProperty(v); addChild(std::move(n)); }
+void FBXNode::addPropertyNode(const std::string name, int32_t v) { FBXNode n(name); n.addProperty(v); addChild(std::move(n)); }
+void FBXNode::addPropertyNode(const std::string name, float v) { FBXNode n(name); n.addProperty(v); addChild(std::move(n)); }
+void FBXNode::addPropertyNode(const std::string name, double v) { FBXNode n(name); n.addProperty(v); addChild(std::move(n)); }
+void FBXNode::addPropertyNode(const std::string name, int64_t v) { FBXNode n(name); n.addProperty(v); addChild(std::move(n)); }
+void FBXNode::addPropertyNode(const std::string name, const std::vector<bool> &v) { FBXNode n(name); n.addProperty(v); addChild(std::move(n)); }
+void FBXNode::addPropertyNode(const std::string name, const std::vector<int32_t> &v) { FBXNode n(name); n.addProperty(v); addChild(std::move(n)); }
+void FBXNode::addPropertyNode(const std::string name, const std::vector<float> &v) { FBXNode n(name); n.addProperty(v); addChild(std::move(n)); }
+void FBXNode::addPropertyNode(const std::string name, const std::vector<double> &v) { FBXNode n(name); n.addProperty(v); addChild(std::move(n)); }
+void FBXNode::addPropertyNode(const std::string name, const std::vector<int64_t> &v) { FBXNode n(name); n.addProperty(v); addChild(std::move(n)); }
+void FBXNode::addPropertyNode(const std::string name, const std::vector<uint8_t> &v, uint8_t type) { FBXNode n(name); n.addProperty(v, type); addChild(std::move(n)); }
+void FBXNode::addPropertyNode(const std::string name, const std::string v) { FBXNode n(name); n.addProperty(v); addChild(std::move(n)); }
+void FBXNode::addPropertyNode(const std::string name, const char *v) { FBXNode n(name); n.addProperty(v); addChild(std::move(n)); }
 
-void FBXNode::addChild(FBXNode child) { children.push_back(child); }
+void FBXNode::addChild(FBXNode child) { children.push_back(std::move(child)); }
 
 uint32_t FBXNode::getBytes() {
     uint32_t bytes = 13 + name.length();
-    for(auto child : children) {
+    for(auto &child : children) {
         bytes += child.getBytes();
     }
-    for(auto prop : properties) {
+    for(auto &prop : properties) {
         bytes += prop.getBytes();
     }
     return bytes;
 }
 
+void FBXNode::compressArrays(int level)
+{
+    for(auto &prop : properties) prop.compressArray(level);
+    for(auto &child : children) child.compressArrays(level);
+}
+
 const std::vector<FBXNode> FBXNode::getChildren()
 {
     return children;
@@ -22,12 +22,12 @@ public:
     void addProperty(float);
     void addProperty(double);
     void addProperty(int64_t);
-    void addProperty(const std::vector<bool>);
-    void addProperty(const std::vector<int32_t>);
-    void addProperty(const std::vector<float>);
-    void addProperty(const std::vector<double>);
-    void addProperty(const std::vector<int64_t>);
-    void addProperty(const std::vector<uint8_t>, uint8_t type);
+    void addProperty(const std::vector<bool> &);
+    void addProperty(const std::vector<int32_t> &);
+    void addProperty(const std::vector<float> &);
+    void addProperty(const std::vector<double> &);
+    void addProperty(const std::vector<int64_t> &);
+    void addProperty(const std::vector<uint8_t> &, uint8_t type);
     void addProperty(const std::string);
     void addProperty(const char*);
     void addProperty(FBXProperty);
@@ -38,17 +38,18 @@ public:
     void addPropertyNode(const std::string name, float);
     void addPropertyNode(const std::string name, double);
     void addPropertyNode(const std::string name, int64_t);
-    void addPropertyNode(const std::string name, const std::vector<bool>);
-    void addPropertyNode(const std::string name, const std::vector<int32_t>);
-    void addPropertyNode(const std::string name, const std::vector<float>);
-    void addPropertyNode(const std::string name, const std::vector<double>);
-    void addPropertyNode(const std::string name, const std::vector<int64_t>);
-    void addPropertyNode(const std::string name, const std::vector<uint8_t>, uint8_t type);
+    void addPropertyNode(const std::string name, const std::vector<bool> &);
+    void addPropertyNode(const std::string name, const std::vector<int32_t> &);
+    void addPropertyNode(const std::string name, const std::vector<float> &);
+    void addPropertyNode(const std::string name, const std::vector<double> &);
+    void addPropertyNode(const std::string name, const std::vector<int64_t> &);
+    void addPropertyNode(const std::string name, const std::vector<uint8_t> &, uint8_t type);
     void addPropertyNode(const std::string name, const std::string);
     void addPropertyNode(const std::string name, const char*);
 
     void addChild(FBXNode child);
     uint32_t getBytes();
+    void compressArrays(int level);
 
     const std::vector<FBXNode> getChildren();
     const std::string getName();
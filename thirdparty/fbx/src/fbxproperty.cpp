@@ -1,6 +1,7 @@
 #include "fbxproperty.h"
 #include "fbxutil.h"
 #include <functional>
+#include <cstring>
 // Change to miniz in Dust3D project
 #include <miniz.h>
 
@@ -62,16 +63,23 @@ namespace { // helpers for reading properties
         }
     };
 
-    class BufferAutoFree
+    template <typename T>
+    std::vector<uint8_t> packArray(const std::vector<T> &a)
     {
-    public:
-        uint8_t *buffer;
-        BufferAutoFree(uint8_t *buf):buffer(buf) {}
-
-        ~BufferAutoFree() {
-            free(buffer);
+        std::vector<uint8_t> data(a.size() * sizeof(T));
+        if(data.empty()) return data;
+        if(isLittleEndian()) {
+            memcpy(data.data(), a.data(), data.size());
+        } else {
+            for(size_t i = 0; i < a.size(); i++) {
+                const uint8_t *c = (const uint8_t *)&a[i];
+                for(size_t j = 0; j < sizeof(T); j++) {
+                    data[i * sizeof(T) + j] = c[sizeof(T) - 1 - j];
+                }
+            }
         }
-    };
+        return data;
+    }
 }
 
 FBXProperty::FBXProperty(std::ifstream &input)
@@ -88,36 +96,25 @@ FBXProperty::FBXProperty(std::ifstream &input)
     } else if(type < 'Z') { // primitive types
         value = readPrimitiveValue(reader, type);
     } else {
-        uint32_t arrayLength = reader.readUint32(); // number of elements in array
-        uint32_t encoding = reader.readUint32(); // 0 .. uncompressed, 1 .. zlib-compressed
+        arrayLength = reader.readUint32(); // number of elements in array
+        uint32_t arrayEncoding = reader.readUint32(); // 0 .. uncompressed, 1 .. zlib-compressed
         uint32_t compressedLength = reader.readUint32();
-        if(encoding) {
-            uint64_t uncompressedLength = arrayElementSize(type - ('a'-'A')) * arrayLength;
-
-            uint8_t *decompressedBuffer = (uint8_t*) malloc(uncompressedLength);
-            if(decompressedBuffer == NULL) throw std::string("Malloc failed");
-            BufferAutoFree baf(decompressedBuffer);
-
+        uint64_t uncompressedLength = arrayElementSize(type - ('a'-'A')) * (uint64_t)arrayLength;
+        // always kept decompressed in memory
+        arrayData.resize(uncompressedLength);
+        if(arrayEncoding) {
             std::vector<uint8_t> compressedBufferVector(compressedLength);
             uint8_t *compressedBuffer = compressedBufferVector.data();
             reader.read((char*)compressedBuffer, compressedLength);
 
             mz_ulong destLen = uncompressedLength;
             mz_ulong srcLen = compressedLength;
-            mz_uncompress(decompressedBuffer, &destLen, compressedBuffer, srcLen);
+            mz_uncompress(arrayData.data(), &destLen, compressedBuffer, srcLen);
 
             if(srcLen != compressedLength) throw std::string("compressedLength does not match data");
             if(destLen != uncompressedLength) throw std::string("uncompressedLength does not match data");
-
-            Reader r((char*)decompressedBuffer);
-
-            for(uint32_t i = 0; i < arrayLength; i++) {
-                values.push_back(readPrimitiveValue(r, type - ('a'-'A')));
-            }
         } else {
-            for(uint32_t i = 0; i < arrayLength; i++) {
-                values.push_back(readPrimitiveValue(reader, type - ('a'-'A')));
-            }
+            reader.read((char*)arrayData.data(), uncompressedLength);
         }
     }
 }
@@ -145,26 +142,37 @@ void FBXProperty::write(std::ofstream &output)
             writer.write((uint8_t)c);
         }
     } else {
-        writer.write((uint32_t) values.size()); // arrayLength
-        writer.write((uint32_t) 0); // encoding // TODO: support compression
-        uint32_t compressedLength = 0;
-        if(type == 'f') compressedLength = values.size() * 4;
-        else if(type == 'd') compressedLength = values.size() * 8;
-        else if(type == 'l') compressedLength = values.size() * 8;
-        else if(type == 'i') compressedLength = values.size() * 4;
-        else if(type == 'b') compressedLength = values.size() * 1;
-        else throw std::string("Invalid property");
-        writer.write(compressedLength);
+        if(arrayElementSize(type - ('a'-'A')) == 0) throw std::string("Invalid property");
+        writer.write(arrayLength);
+        writer.write(encoding); // 0 .. uncompressed, 1 .. zlib-compressed
+        writer.write((uint32_t) arrayData.size()); // compressedLength
+        writer.write(arrayData.data(), arrayData.size());
+    }
+}
 
-        for(auto e : values) {
-            if(type == 'f') writer.write(e.f32);
-            else if(type == 'd') writer.write(e.f64);
-            else if(type == 'l') writer.write((int64_t)(e.i64));
-            else if(type == 'i') writer.write(e.i32);
-            else if(type == 'b') writer.write((uint8_t)(e.boolean ? 1 : 0));
-            else throw std::string("Invalid property");
-        }
+void FBXProperty::compressArray(int level)
+{
+    // small arrays are not worth the zlib header
+    if(!is_array() || encoding || level <= 0 || arrayData.size() < 128) return;
+    mz_ulong compressedLength = mz_compressBound(arrayData.size());
+    std::vector<uint8_t> compressed(compressedLength);
+    if(mz_compress2(compressed.data(), &compressedLength, arrayData.data(), arrayData.size(), level) != MZ_OK) return;
+    if(compressedLength >= arrayData.size()) return;
+    compressed.resize(compressedLength);
+    arrayData.swap(compressed);
+    encoding = 1;
+}
+
+std::vector<uint8_t> FBXProperty::decodedArrayData()
+{
+    if(!encoding) return arrayData;
+    std::vector<uint8_t> data(arrayElementSize(type - ('a'-'A')) * (uint64_t)arrayLength);
+    mz_ulong destLen = data.size();
+    if(mz_uncompress(data.data(), &destLen, arrayData.data(), arrayData.size()) != MZ_OK
+            || destLen != data.size()) {
+        throw std::string("Invalid compressed array");
     }
+    return data;
 }
 
 // primitive values
@@ -175,53 +183,27 @@ FBXProperty::FBXProperty(float a) { type = 'F'; value.f32 = a; }
 FBXProperty::FBXProperty(double a) { type = 'D'; value.f64 = a; }
 FBXProperty::FBXProperty(int64_t a) { type = 'L'; value.i64 = a; }
 // arrays
-FBXProperty::FBXProperty(const std::vector<bool> a) : type('b') {
+FBXProperty::FBXProperty(const std::vector<bool> &a) : type('b') {
+    arrayLength = a.size();
+    arrayData.reserve(a.size());
     for(auto el : a) {
-        FBXPropertyValue v;
-        v.boolean = el;
-        values.push_back(v);
-    }
-}
-FBXProperty::FBXProperty(const std::vector<int32_t> a) : type('i') {
-    for(auto el : a) {
-        FBXPropertyValue v;
-        v.i32 = el;
-        values.push_back(v);
-    }
-}
-FBXProperty::FBXProperty(const std::vector<float> a) : type('f') {
-    for(auto el : a) {
-        FBXPropertyValue v;
-        v.f32 = el;
-        values.push_back(v);
-    }
-}
-FBXProperty::FBXProperty(const std::vector<double> a) : type('d') {
-    for(auto el : a) {
-        FBXPropertyValue v;
-        v.f64 = el;
-        values.push_back(v);
-    }
-}
-FBXProperty::FBXProperty(const std::vector<int64_t> a) : type('l') {
-    for(auto el : a) {
-        FBXPropertyValue v;
-        v.i64 = el;
-        values.push_back(v);
+        arrayData.push_back(el ? 1 : 0);
     }
 }
+FBXProperty::FBXProperty(const std::vector<int32_t> &a) : type('i'), arrayLength(a.size()), arrayData(packArray(a)) {}
+FBXProperty::FBXProperty(const std::vector<float> &a) : type('f'), arrayLength(a.size()), arrayData(packArray(a)) {}
+FBXProperty::FBXProperty(const std::vector<double> &a) : type('d'), arrayLength(a.size()), arrayData(packArray(a)) {}
+FBXProperty::FBXProperty(const std::vector<int64_t> &a) : type('l'), arrayLength(a.size()), arrayData(packArray(a)) {}
 // raw / string
-FBXProperty::FBXProperty(const std::vector<uint8_t> a, uint8_t type): raw(a) {
+FBXProperty::FBXProperty(const std::vector<uint8_t> &a, uint8_t type): raw(a) {
     if(type != 'R' && type != 'S') {
         throw std::string("Bad argument to FBXProperty constructor");
     }
     this->type = type;
 }
 // string
-FBXProperty::FBXProperty(const std::string a){
-    for(uint8_t v : a) {
-        raw.push_back(v);
-    }
+FBXProperty::FBXProperty(const std::string &a){
+    raw.assign(a.begin(), a.end());
     this->type = 'S';
 }
 FBXProperty::FBXProperty(const char *a){
@@ -242,6 +224,11 @@ namespace {
     }
 }
 
+bool FBXProperty::is_array()
+{
+    return type > 'Z';
+}
+
 char FBXProperty::getType()
 {
     return type;
@@ -272,7 +259,10 @@ string FBXProperty::to_string()
     } else {
         string s("[");
         bool hasPrev = false;
-        for(auto e : values) {
+        std::vector<uint8_t> data = decodedArrayData();
+        Reader r((char*)data.data());
+        for(uint32_t i = 0; i < arrayLength; i++) {
+            FBXPropertyValue e = readPrimitiveValue(r, type - ('a'-'A'));
             if(hasPrev) s += ", ";
             if(type == 'f') s += std::to_string(e.f32);
             else if(type == 'd') s += std::to_string(e.f64);
@@ -296,11 +286,7 @@ uint32_t FBXProperty::getBytes()
     else if(type == 'L') return 8 + 1;
     else if(type == 'R') return raw.size() + 5;
     else if(type == 'S') return raw.size() + 5;
-    else if(type == 'f') return values.size() * 4 + 13;
-    else if(type == 'd') return values.size() * 8 + 13;
-    else if(type == 'l') return values.size() * 8 + 13;
-    else if(type == 'i') return values.size() * 4 + 13;
-    else if(type == 'b') return values.size() * 1 + 13;
+    else if(type == 'f' || type == 'd' || type == 'l' || type == 'i' || type == 'b') return arrayData.size() + 13;
     throw std::string("Invalid property");
 }
 
@@ -32,17 +32,19 @@ public:
     FBXProperty(double);
     FBXProperty(int64_t);
     // arrays
-    FBXProperty(const std::vector<bool>);
-    FBXProperty(const std::vector<int32_t>);
-    FBXProperty(const std::vector<float>);
-    FBXProperty(const std::vector<double>);
-    FBXProperty(const std::vector<int64_t>);
+    FBXProperty(const std::vector<bool> &);
+    FBXProperty(const std::vector<int32_t> &);
+    FBXProperty(const std::vector<float> &);
+    FBXProperty(const std::vector<double> &);
+    FBXProperty(const std::vector<int64_t> &);
     // raw / string
-    FBXProperty(const std::vector<uint8_t>, uint8_t type);
-    FBXProperty(const std::string);
+    FBXProperty(const std::vector<uint8_t> &, uint8_t type);
+    FBXProperty(const std::string &);
     FBXProperty(const char *);
 
     void write(std::ofstream &output);
+    // deflate array payload, level 0 disables compression, 1..9 as zlib
+    void compressArray(int level);
 
     std::string to_string();
     char getType();
@@ -53,7 +55,12 @@ private:
     uint8_t type;
     FBXPropertyValue value;
     std::vector<uint8_t> raw;
-    std::vector<FBXPropertyValue> values;
+    // array elements packed little endian as in file, deflated when encoding is 1
+    uint32_t arrayLength = 0;
+    uint32_t encoding = 0;
+    std::vector<uint8_t> arrayData;
+
+    std::vector<uint8_t> decodedArrayData();
 };
 
 } // namespace fbx
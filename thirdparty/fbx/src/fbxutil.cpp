@@ -2,13 +2,11 @@
 
 namespace fbx {
 
-namespace {
-    bool isLittleEndian()
-    {
-        uint16_t number = 0x1;
-        char *numPtr = (char*)&number;
-        return (numPtr[0] == 1);
-    }
+bool isLittleEndian()
+{
+    uint16_t number = 0x1;
+    char *numPtr = (char*)&number;
+    return (numPtr[0] == 1);
 }
 
 uint8_t Reader::readUint8()
@@ -169,7 +167,7 @@ Writer::Writer(std::ofstream *output):ofstream(output){}
 
 void Writer::putc(uint8_t c)
 {
-    (*ofstream) << c;
+    ofstream->put(c);
 }
 
 void Writer::write(std::uint8_t a)
@@ -244,6 +242,11 @@ void Writer::write(std::string a)
     }
 }
 
+void Writer::write(const std::uint8_t *data, size_t size)
+{
+    if(size > 0) ofstream->write((const char *)data, size);
+}
+
 void Writer::write(float a)
 {
     char *c = (char *)(&a);
@@ -13,6 +13,8 @@ namespace fbx {
     // this assumes that float is 32bit and double is 64bit
     // both conforming to IEEE 754, it does not assume endianness
     // it also assumes that signed integers are two's complement
+    bool isLittleEndian();
+
     class Reader {
     public:
         Reader(std::ifstream *input);
@@ -51,6 +53,7 @@ namespace fbx {
         void write(std::string);
         void write(float);
         void write(double);
+        void write(const std::uint8_t *, size_t);
     private:
         void putc(uint8_t);
         std::ofstream *ofstream;